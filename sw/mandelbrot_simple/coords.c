@@ -0,0 +1,95 @@
+// coords.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// reader of fixed-point view tables, like the coords[] table of fw/main.c
+// NOTE: the parser is line based, an entry must not be split over lines
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "coords.h"
+
+
+//// coords_number() ////
+// parses a C integer literal (optional sign, any base, optional u/l suffixes) & the
+// blanks around it, moves *c past them, returns 0 on success
+static int coords_number(char** c, FP* v)
+{
+  char* s = *c;
+  while (*s == ' ' || *s == '\t') s++;
+  if (!((*s >= '0' && *s <= '9') || ((*s == '-' || *s == '+') && s[1] >= '0' && s[1] <= '9'))) return -1;
+  char* end = NULL;
+  *v = (*s == '-') ? (FP)strtoll(s, &end, 0) : (FP)strtoull(s, &end, 0);
+  while (*end == 'u' || *end == 'U' || *end == 'l' || *end == 'L') end++;
+  while (*end == ' ' || *end == '\t') end++;
+  *c = end;
+  return 0;
+}
+
+
+//// coords_entry() ////
+// parses the {x0, y0, xs, ys} entry starting at the brace c, returns 0 on success
+static int coords_entry(char* c, coords_t* e)
+{
+  FP v[4];
+  c++;
+  for (uint32_t i=0; i<4; i++) {
+    if (coords_number(&c, &v[i]) || *c++ != (i < 3 ? ',' : '}')) return -1;
+  }
+  e->x0 = v[0];
+  e->y0 = v[1];
+  e->xs = v[2];
+  e->ys = v[3];
+  return 0;
+}
+
+
+//// coords_read() ////
+coords_t* coords_read(const char* filename, uint32_t* n)
+{
+  FILE* fp = NULL;
+  if ((fp = fopen(filename, "rb")) == NULL) return NULL;
+  char line[1024];
+  // only the coords[] table, if there is one
+  uint32_t table = 0;
+  while (!table && fgets(line, sizeof(line), fp) != NULL) {
+    char* comment = strstr(line, "//");
+    if (comment != NULL) *comment = 0;
+    table = strstr(line, "coords[]") != NULL;
+  }
+  rewind(fp);
+  coords_t* entries = NULL;
+  uint32_t count = 0, size = 0;
+  uint32_t in_table = !table;
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    char* comment = strstr(line, "//");
+    if (comment != NULL) *comment = 0;
+    if (!in_table) {
+      in_table = strstr(line, "coords[]") != NULL;
+      continue;
+    }
+    for (char* c=strchr(line, '{'); c != NULL; c=strchr(c+1, '{')) {
+      coords_t e;
+      if (coords_entry(c, &e)) continue;
+      if (count == size) {
+        size = size ? 2*size : 64;
+        coords_t* a = NULL;
+        if ((a = (coords_t*)realloc(entries, size * sizeof(coords_t))) == NULL) {
+          free(entries);
+          fclose(fp);
+          return NULL;
+        }
+        entries = a;
+      }
+      entries[count++] = e;
+    }
+    if (table && strstr(line, "};") != NULL) break;
+  }
+  fclose(fp);
+  *n = count;
+  // an empty table is still a table
+  return entries != NULL ? entries : (coords_t*)malloc(sizeof(coords_t));
+}
+
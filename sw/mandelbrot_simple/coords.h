@@ -0,0 +1,35 @@
+// coords.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// reader of fixed-point view tables, like the coords[] table of fw/main.c
+
+
+#ifndef __COORDS_H__
+#define __COORDS_H__
+
+
+//// includes ////
+#include <stdint.h>
+#include "fp.h"
+
+
+//// types ////
+// coords_t
+// one view, pixel (x, y) is at (x0 + x*xs, y0 + y*ys), the same as man_coords_t of fw/main.c
+typedef struct {
+  FP x0;
+  FP y0;
+  FP xs;
+  FP ys;
+} coords_t;
+
+
+//// functions ////
+// reads the {x0, y0, xs, ys} entries of a view table: of the coords[] table if the file
+// has one (a C source, like fw/main.c), otherwise of the whole file; only braced
+// quadruples count, entries commented out with // are skipped & numbers can have C
+// integer suffixes; returns the entries (free() them) & their number in n, NULL on error
+coords_t* coords_read(const char* filename, uint32_t* n);
+
+
+#endif // __COORDS_H__
+
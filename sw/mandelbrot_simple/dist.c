@@ -0,0 +1,561 @@
+// dist.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// distributed rendering, a coordinator hands chunks of rows to worker processes over TCP
+// NOTE: all protocol words are 32-bit in network byte order; the coordinator sends the
+// view arguments, the worker answers with a hello, then the coordinator sends chunk
+// requests & the worker answers each with the chunk's statistics (64-bit, as two words,
+// high first) & iteration counts
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "dist.h"
+
+
+//// defines ////
+// protocol magic & version
+#define DIST_MAGIC      0x4d424432U
+// chunks a worker has queued at once, so it never waits for the next one
+#define DIST_DEPTH      2U
+// a new chunk gets 1/DIST_SPLIT of the worker's share of the rows left
+#define DIST_SPLIT      4U
+// minimal chunk height
+#define DIST_MIN_ROWS   4U
+// maximal number of view arguments & maximal argument length
+#define DIST_MAX_ARGS   256U
+#define DIST_MAX_ARG    4096U
+// words of a result header: gen, chunk, row_y, nrows, usec & the statistics
+#define DIST_RES_WORDS  (5U + 2U*DIST_COUNTS)
+
+
+//// types ////
+// dist_chunk_t
+// rows handed out together
+typedef struct {
+  uint32_t row_y;
+  uint32_t nrows;
+  uint32_t done;
+  uint32_t holders;           // number of live workers calculating it
+  double   issued;            // time it was first handed out
+} dist_chunk_t;
+
+// dist_slot_t
+// chunk queued on a worker
+typedef struct {
+  uint32_t gen;               // dist_rows() call it belongs to
+  uint32_t chunk;
+} dist_slot_t;
+
+// dist_worker_t
+// connection to one worker
+typedef struct {
+  int         fd;
+  uint32_t    alive;
+  uint32_t    nthreads;
+  double      speed;          // measured pixels per second, 0.0 - not known yet
+  dist_slot_t slots[DIST_DEPTH];
+  uint32_t    nslots;
+  char        name[256];
+} dist_worker_t;
+
+// dist_s
+// coordinator
+struct dist_s {
+  uint32_t       img_w;
+  uint32_t       img_h;
+  dist_worker_t* workers;
+  uint32_t       nworkers;
+  uint32_t       gen;
+  dist_stats_t   stats;
+};
+
+
+//// dist_now() ////
+// returns monotonic time in seconds
+static double dist_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec*1e-9;
+}
+
+
+//// dist_send() ////
+// sends the whole buffer, returns 0 on success
+static int dist_send(int fd, const void* buf, size_t len)
+{
+  const uint8_t* p = (const uint8_t*)buf;
+  while (len) {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    p   += n;
+    len -= n;
+  }
+  return 0;
+}
+
+
+//// dist_recv() ////
+// receives the whole buffer, returns 0 on success, 1 if the peer disconnected before the first byte
+static int dist_recv(int fd, void* buf, size_t len)
+{
+  uint8_t* p = (uint8_t*)buf;
+  size_t left = len;
+  while (left) {
+    ssize_t n = recv(fd, p, left, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n == 0 && left == len) return 1;
+    if (n <= 0) return -1;
+    p    += n;
+    left -= n;
+  }
+  return 0;
+}
+
+
+//// dist_send_words() ////
+// sends n (at most DIST_RES_WORDS, the longest message) words in network byte order,
+// returns 0 on success
+static int dist_send_words(int fd, const uint32_t* words, uint32_t n)
+{
+  uint32_t buf[DIST_RES_WORDS];
+  for (uint32_t i=0; i<n; i++) buf[i] = htonl(words[i]);
+  return dist_send(fd, buf, n*sizeof(uint32_t));
+}
+
+
+//// dist_recv_words() ////
+// receives n words in network byte order, returns like dist_recv()
+static int dist_recv_words(int fd, uint32_t* words, uint32_t n)
+{
+  int ret = dist_recv(fd, words, n*sizeof(uint32_t));
+  for (uint32_t i=0; i<n && ret == 0; i++) words[i] = ntohl(words[i]);
+  return ret;
+}
+
+
+//// dist_daemon() ////
+int dist_daemon(const char* address, uint32_t port, const char* progname, uint32_t nthreads, dist_args_fn check)
+{
+  int lfd = -1;
+  int one = 1;
+  char port_buf[16];
+  struct addrinfo hints;
+  struct addrinfo* res = NULL;
+  snprintf(port_buf, sizeof(port_buf), "%u", port);
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags    = AI_PASSIVE;
+  if (getaddrinfo(address, port_buf, &hints, &res)) return -1;
+  if ((lfd = socket(res->ai_family, res->ai_socktype, res->ai_protocol)) < 0 || setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+      bind(lfd, res->ai_addr, res->ai_addrlen) || listen(lfd, 64)) {
+    if (lfd >= 0) close(lfd);
+    freeaddrinfo(res);
+    return -1;
+  }
+  freeaddrinfo(res);
+  // workers are reaped automatically
+  signal(SIGCHLD, SIG_IGN);
+  for (;;) {
+    int fd = accept(lfd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      close(lfd);
+      return -1;
+    }
+    pid_t pid = fork();
+    if (pid != 0) {
+      close(fd);
+      continue;
+    }
+    // worker: read the view arguments & become this executable with them
+    close(lfd);
+    uint32_t hdr[2];
+    if (dist_recv_words(fd, hdr, 2) || hdr[0] != DIST_MAGIC || hdr[1] > DIST_MAX_ARGS) _exit(EXIT_FAILURE);
+    char* argv[DIST_MAX_ARGS+4];
+    char t_buf[16], fd_buf[16];
+    uint32_t argc = 0;
+    argv[argc++] = (char*)progname;
+    for (uint32_t i=0; i<hdr[1]; i++) {
+      uint32_t len = 0;
+      if (dist_recv_words(fd, &len, 1) || len > DIST_MAX_ARG || (argv[argc] = (char*)calloc(len+1, 1)) == NULL ||
+          (len && dist_recv(fd, argv[argc], len))) _exit(EXIT_FAILURE);
+      argc++;
+    }
+    // only the view, checked before it gets anywhere near the command line
+    if (check(argv+1, hdr[1])) _exit(EXIT_FAILURE);
+    if (nthreads) {
+      snprintf(t_buf, sizeof(t_buf), "%u", nthreads);
+      argv[argc++] = "-t";
+      argv[argc++] = t_buf;
+    }
+    // the connection is inherited, the worker finds it with dist_worker_fd()
+    snprintf(fd_buf, sizeof(fd_buf), "%d", fd);
+    if (setenv(DIST_WORKER_FD_ENV, fd_buf, 1)) _exit(EXIT_FAILURE);
+    argv[argc] = NULL;
+    signal(SIGCHLD, SIG_DFL);
+    execv("/proc/self/exe", argv);
+    _exit(EXIT_FAILURE);
+  }
+}
+
+
+//// dist_worker_fd() ////
+int dist_worker_fd(void)
+{
+  const char* env = getenv(DIST_WORKER_FD_ENV);
+  if (env == NULL) return -1;
+  char* end = NULL;
+  long fd = strtol(env, &end, 10);
+  unsetenv(DIST_WORKER_FD_ENV);
+  // only an inherited stream socket
+  struct stat st;
+  int type = 0;
+  socklen_t len = sizeof(type);
+  if (end == env || *end != '\0' || fd < 0 || fd > 65535 || fstat((int)fd, &st) || !S_ISSOCK(st.st_mode) ||
+      getsockopt((int)fd, SOL_SOCKET, SO_TYPE, &type, &len) || type != SOCK_STREAM) return -1;
+  return (int)fd;
+}
+
+
+//// dist_dial() ////
+// connects to host:port, returns the socket or -1
+static int dist_dial(const char* name)
+{
+  char host[256];
+  const char* colon = strrchr(name, ':');
+  if (colon == NULL || colon == name || (size_t)(colon-name) >= sizeof(host)) return -1;
+  memcpy(host, name, colon-name);
+  host[colon-name] = '\0';
+  struct addrinfo hints;
+  struct addrinfo* res = NULL;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, colon+1, &hints, &res)) return -1;
+  int fd = -1;
+  for (struct addrinfo* ai=res; ai && fd < 0; ai=ai->ai_next) {
+    if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0) continue;
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen)) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(res);
+  if (fd >= 0) {
+    // requests are small & latency bound
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return fd;
+}
+
+
+//// dist_connect() ////
+dist_t* dist_connect(const char* workers, char* const* args, uint32_t nargs, uint32_t img_w, uint32_t img_h)
+{
+  dist_t* d = NULL;
+  uint32_t n = 1;
+  for (const char* p=workers; *p; p++) n += *p == ',';
+  if (nargs > DIST_MAX_ARGS || (d = (dist_t*)calloc(1, sizeof(dist_t))) == NULL) return NULL;
+  if ((d->workers = (dist_worker_t*)calloc(n, sizeof(dist_worker_t))) == NULL) {
+    free(d);
+    return NULL;
+  }
+  d->img_w = img_w;
+  d->img_h = img_h;
+  // connect to all workers & send them the view, they set it up in parallel
+  const char* p = workers;
+  for (uint32_t i=0; i<n; i++) {
+    dist_worker_t* w = &d->workers[d->nworkers];
+    size_t len = strcspn(p, ",");
+    snprintf(w->name, sizeof(w->name), "%.*s", (int)len, p);
+    p += len + (p[len] == ',');
+    uint32_t hdr[2] = {DIST_MAGIC, nargs};
+    int ok = (w->fd = dist_dial(w->name)) >= 0 && dist_send_words(w->fd, hdr, 2) == 0;
+    for (uint32_t k=0; k<nargs && ok; k++) {
+      uint32_t arg_len = strlen(args[k]);
+      ok = dist_send_words(w->fd, &arg_len, 1) == 0 && dist_send(w->fd, args[k], arg_len) == 0;
+    }
+    if (!ok) {
+      fprintf(stderr, "Can't connect to worker %s, skipping it.\n", w->name);
+      if (w->fd >= 0) close(w->fd);
+      continue;
+    }
+    d->nworkers++;
+  }
+  // hello: magic, image size & number of threads of each worker
+  for (uint32_t i=0; i<d->nworkers; i++) {
+    dist_worker_t* w = &d->workers[i];
+    uint32_t hello[4];
+    if (dist_recv_words(w->fd, hello, 4) || hello[0] != DIST_MAGIC || hello[1] != img_w || hello[2] != img_h) {
+      fprintf(stderr, "Worker %s didn't set up the view, skipping it.\n", w->name);
+      close(w->fd);
+      continue;
+    }
+    w->alive    = 1;
+    w->nthreads = hello[3] ? hello[3] : 1;
+    d->stats.alive++;
+  }
+  d->stats.workers = d->nworkers;
+  if (d->stats.alive == 0) {
+    dist_close(d);
+    return NULL;
+  }
+  return d;
+}
+
+
+//// dist_close() ////
+void dist_close(dist_t* d)
+{
+  if (d == NULL) return;
+  for (uint32_t i=0; i<d->nworkers; i++) {
+    if (d->workers[i].alive) close(d->workers[i].fd);
+  }
+  free(d->workers);
+  free(d);
+}
+
+
+//// dist_dead() ////
+// drops a worker, its chunks nobody else calculates go back to the queue
+static void dist_dead(dist_t* d, dist_worker_t* w, dist_chunk_t* chunks, uint32_t* requeue, uint32_t* nrequeue)
+{
+  fprintf(stderr, "Worker %s died, reissuing its rows.\n", w->name);
+  close(w->fd);
+  w->alive = 0;
+  d->stats.alive--;
+  for (uint32_t i=0; i<w->nslots; i++) {
+    if (w->slots[i].gen != d->gen) continue;
+    dist_chunk_t* c = &chunks[w->slots[i].chunk];
+    if (--c->holders == 0 && !c->done) {
+      requeue[(*nrequeue)++] = w->slots[i].chunk;
+      d->stats.reissued++;
+    }
+  }
+  w->nslots = 0;
+}
+
+
+//// dist_next() ////
+// picks the next chunk for the worker: a reissued one, new rows sized by the worker's
+// share of the speed, or (when it's idle at the end) the oldest chunk only one other
+// worker calculates; returns the chunk index or -1 if there is nothing to do
+static int64_t dist_next(dist_t* d, dist_worker_t* w, dist_chunk_t* chunks, uint32_t* nchunks, uint32_t* next_y, uint32_t end_y, uint32_t* requeue, uint32_t* nrequeue)
+{
+  while (*nrequeue) {
+    uint32_t c = requeue[--(*nrequeue)];
+    if (!chunks[c].done) return c;
+  }
+  if (*next_y < end_y) {
+    // speed share, workers without a measurement count as their threads at the average
+    // measured speed per thread
+    double known = 0.0, known_threads = 0.0, sum = 0.0;
+    for (uint32_t i=0; i<d->nworkers; i++) {
+      if (!d->workers[i].alive || d->workers[i].speed == 0.0) continue;
+      known += d->workers[i].speed;
+      known_threads += d->workers[i].nthreads;
+    }
+    double per_thread = known_threads > 0.0 ? known/known_threads : 1.0;
+    for (uint32_t i=0; i<d->nworkers; i++) {
+      if (!d->workers[i].alive) continue;
+      sum += d->workers[i].speed > 0.0 ? d->workers[i].speed : d->workers[i].nthreads*per_thread;
+    }
+    double mine = w->speed > 0.0 ? w->speed : w->nthreads*per_thread;
+    uint32_t left = end_y - *next_y;
+    uint32_t h = (uint32_t)((double)left*mine/sum/DIST_SPLIT + 0.5);
+    if (h < DIST_MIN_ROWS) h = DIST_MIN_ROWS;
+    if (h > left) h = left;
+    dist_chunk_t* c = &chunks[*nchunks];
+    c->row_y   = *next_y;
+    c->nrows   = h;
+    c->done    = 0;
+    c->holders = 0;
+    c->issued  = dist_now();
+    *next_y += h;
+    return (*nchunks)++;
+  }
+  if (w->nslots) return -1;
+  int64_t best = -1;
+  for (uint32_t i=0; i<*nchunks; i++) {
+    if (chunks[i].done || chunks[i].holders != 1) continue;
+    if (best < 0 || chunks[i].issued < chunks[best].issued) best = i;
+  }
+  if (best >= 0) d->stats.duplicated++;
+  return best;
+}
+
+
+//// dist_result() ////
+// receives one chunk from the worker into iterations (or drops it if it's stale) & adds
+// its statistics to counts, if it's the chunk's first result; returns 0 on success
+static int dist_result(dist_t* d, dist_worker_t* w, dist_chunk_t* chunks, uint32_t row_y, uint32_t* iterations, uint64_t* counts, uint32_t* done_rows)
+{
+  uint32_t res[DIST_RES_WORDS];
+  if (dist_recv_words(w->fd, res, DIST_RES_WORDS)) return -1;
+  uint32_t gen = res[0], ci = res[1], usec = res[4];
+  uint32_t slot = 0;
+  while (slot < w->nslots && (w->slots[slot].gen != gen || w->slots[slot].chunk != ci)) slot++;
+  if (slot == w->nslots) return -1;
+  w->slots[slot] = w->slots[--w->nslots];
+  uint64_t npix = (uint64_t)res[3]*d->img_w;
+  if (gen != d->gen) {
+    // duplicate of a chunk of an earlier call, the rows are already written out
+    uint32_t buf[1024];
+    for (uint64_t i=0; i<npix; i+=1024) {
+      if (dist_recv(w->fd, buf, (npix-i < 1024 ? npix-i : 1024)*sizeof(uint32_t))) return -1;
+    }
+    return 0;
+  }
+  dist_chunk_t* c = &chunks[ci];
+  if (res[2] != c->row_y || res[3] != c->nrows) return -1;
+  // duplicates carry the same counts, so they may overwrite the rows
+  uint32_t* out = iterations + (uint64_t)(c->row_y-row_y)*d->img_w;
+  if (dist_recv(w->fd, out, npix*sizeof(uint32_t))) return -1;
+  for (uint64_t i=0; i<npix; i++) out[i] = ntohl(out[i]);
+  double speed = (double)npix/((double)(usec ? usec : 1)*1e-6);
+  w->speed = w->speed > 0.0 ? 0.5*(w->speed + speed) : speed;
+  c->holders--;
+  if (!c->done) {
+    c->done = 1;
+    *done_rows += c->nrows;
+    for (uint32_t i=0; i<DIST_COUNTS; i++) counts[i] += (uint64_t)res[5+2*i] << 32 | res[6+2*i];
+  }
+  return 0;
+}
+
+
+//// dist_rows() ////
+int dist_rows(dist_t* d, uint32_t row_y, uint32_t nrows, uint32_t* iterations, uint64_t* counts)
+{
+  // at most one chunk per row, reissued chunks are reused
+  dist_chunk_t* chunks = NULL;
+  uint32_t* requeue = NULL;
+  struct pollfd* pfds = NULL;
+  if ((chunks = (dist_chunk_t*)calloc(nrows, sizeof(dist_chunk_t))) == NULL ||
+      (requeue = (uint32_t*)calloc(nrows, sizeof(uint32_t))) == NULL ||
+      (pfds = (struct pollfd*)calloc(d->nworkers, sizeof(struct pollfd))) == NULL) {
+    free(chunks);
+    free(requeue);
+    return -1;
+  }
+  d->gen++;
+  uint32_t nchunks = 0, nrequeue = 0, next_y = row_y, done_rows = 0;
+  int ret = 0;
+  while (done_rows < nrows) {
+    // keep every live worker's queue full
+    for (uint32_t i=0; i<d->nworkers; i++) {
+      dist_worker_t* w = &d->workers[i];
+      while (w->alive && w->nslots < DIST_DEPTH) {
+        int64_t ci = dist_next(d, w, chunks, &nchunks, &next_y, row_y+nrows, requeue, &nrequeue);
+        if (ci < 0) break;
+        uint32_t req[4] = {d->gen, (uint32_t)ci, chunks[ci].row_y, chunks[ci].nrows};
+        chunks[ci].holders++;
+        w->slots[w->nslots].gen   = d->gen;
+        w->slots[w->nslots].chunk = (uint32_t)ci;
+        w->nslots++;
+        d->stats.chunks++;
+        if (dist_send_words(w->fd, req, 4)) dist_dead(d, w, chunks, requeue, &nrequeue);
+      }
+    }
+    if (d->stats.alive == 0) {
+      ret = -1;
+      break;
+    }
+    // wait for results
+    uint32_t npfds = 0;
+    for (uint32_t i=0; i<d->nworkers; i++) {
+      pfds[i].fd     = d->workers[i].alive && d->workers[i].nslots ? d->workers[i].fd : -1;
+      pfds[i].events = POLLIN;
+      npfds += pfds[i].fd >= 0;
+    }
+    if (npfds == 0) continue;
+    if (poll(pfds, d->nworkers, -1) < 0) {
+      if (errno == EINTR) continue;
+      ret = -1;
+      break;
+    }
+    for (uint32_t i=0; i<d->nworkers; i++) {
+      if (pfds[i].fd < 0 || pfds[i].revents == 0) continue;
+      if (dist_result(d, &d->workers[i], chunks, row_y, iterations, counts, &done_rows)) dist_dead(d, &d->workers[i], chunks, requeue, &nrequeue);
+    }
+  }
+  free(pfds);
+  free(requeue);
+  free(chunks);
+  return ret;
+}
+
+
+//// dist_stats() ////
+void dist_stats(const dist_t* d, dist_stats_t* stats)
+{
+  *stats = d->stats;
+}
+
+
+//// dist_serve() ////
+int dist_serve(int fd, uint32_t img_w, uint32_t img_h, uint32_t nthreads, dist_rows_fn fn, void* arg)
+{
+  uint32_t hello[4] = {DIST_MAGIC, img_w, img_h, nthreads};
+  if (dist_send_words(fd, hello, 4)) return -1;
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  uint32_t* buf = NULL;
+  uint32_t buf_rows = 0;
+  int ret = 0;
+  for (;;) {
+    // gen, chunk, row_y, nrows
+    uint32_t req[4];
+    if ((ret = dist_recv_words(fd, req, 4)) != 0) break;
+    if (req[3] == 0 || req[2] >= img_h || req[3] > img_h-req[2]) {
+      ret = -1;
+      break;
+    }
+    if (req[3] > buf_rows) {
+      free(buf);
+      if ((buf = (uint32_t*)malloc((uint64_t)req[3]*img_w*sizeof(uint32_t))) == NULL) {
+        ret = -1;
+        break;
+      }
+      buf_rows = req[3];
+    }
+    uint64_t counts[DIST_COUNTS] = {0};
+    double t0 = dist_now();
+    fn(arg, req[2], req[3], buf, counts);
+    double usec = (dist_now() - t0)*1e6;
+    uint32_t res[DIST_RES_WORDS] = {req[0], req[1], req[2], req[3], usec < 4e9 ? (uint32_t)usec : 0xffffffffU};
+    for (uint32_t i=0; i<DIST_COUNTS; i++) {
+      res[5+2*i] = (uint32_t)(counts[i] >> 32);
+      res[6+2*i] = (uint32_t)counts[i];
+    }
+    uint64_t npix = (uint64_t)req[3]*img_w;
+    for (uint64_t i=0; i<npix; i++) buf[i] = htonl(buf[i]);
+    if (dist_send_words(fd, res, DIST_RES_WORDS) || dist_send(fd, buf, npix*sizeof(uint32_t))) {
+      ret = -1;
+      break;
+    }
+  }
+  free(buf);
+  close(fd);
+  // the coordinator hanging up between chunks is the normal end
+  return ret == 1 ? 0 : -1;
+}
+
@@ -0,0 +1,80 @@
+// dist.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// distributed rendering, a coordinator hands chunks of rows to worker processes over TCP
+
+
+#ifndef __DIST_H__
+#define __DIST_H__
+
+
+//// includes ////
+#include <stdint.h>
+
+
+//// defines ////
+// environment variable that passes the coordinator connection to a worker process
+#define DIST_WORKER_FD_ENV  "MANDELBROT_WORKER_FD"
+// number of statistics a worker returns with each chunk
+#define DIST_COUNTS         7U
+
+
+//// types ////
+// dist_t
+// opaque coordinator, connected to all workers
+typedef struct dist_s dist_t;
+
+// dist_rows_fn
+// calculates image rows row_y .. row_y+nrows-1 into iterations (nrows rows) & stores
+// the statistics of the rows (DIST_COUNTS numbers, their meaning is up to fn) in counts
+typedef void (*dist_rows_fn)(void* arg, uint32_t row_y, uint32_t nrows, uint32_t* iterations, uint64_t* counts);
+
+// dist_args_fn
+// checks the view arguments a coordinator sent, returns 0 if the worker may run with them
+typedef int (*dist_args_fn)(char* const* args, uint32_t nargs);
+
+// dist_stats_t
+// coordinator statistics
+typedef struct {
+  uint32_t workers;           // number of workers connected
+  uint32_t alive;             // number of workers still alive
+  uint32_t chunks;            // number of chunks handed out
+  uint32_t reissued;          // chunks handed out again, because their worker died
+  uint32_t duplicated;        // chunks handed out again to idle workers at the end
+} dist_stats_t;
+
+
+//// functions ////
+// listens on address:port & forks a worker for each coordinator that connects; the worker
+// checks the coordinator's arguments with check & runs progname (this executable) with
+// them, followed by -t nthreads (if nonzero), the connection is passed in the environment
+// (dist_worker_fd()); only returns on error
+int dist_daemon(const char* address, uint32_t port, const char* progname, uint32_t nthreads, dist_args_fn check);
+
+// returns the coordinator connection of a worker process started by dist_daemon(), -1 if
+// this isn't one
+int dist_worker_fd(void);
+
+// connects to the workers (comma separated host:port list) & sends them the view
+// arguments args[0] .. args[nargs-1], returns NULL if no worker could be reached
+dist_t* dist_connect(const char* workers, char* const* args, uint32_t nargs, uint32_t img_w, uint32_t img_h);
+
+// disconnects from the workers & frees the coordinator
+void dist_close(dist_t* d);
+
+// calculates rows row_y .. row_y+nrows-1 on the workers into iterations; chunks shrink
+// as the rows run out & are sized by each worker's measured speed, chunks of dead
+// workers are handed out again & idle workers duplicate the slowest chunks at the end;
+// the workers' statistics of the chunks (of the first result of each) are added to
+// counts (DIST_COUNTS numbers); returns 0 on success, -1 if all workers died
+int dist_rows(dist_t* d, uint32_t row_y, uint32_t nrows, uint32_t* iterations, uint64_t* counts);
+
+// returns the coordinator statistics
+void dist_stats(const dist_t* d, dist_stats_t* stats);
+
+// serves the coordinator on fd: tells it the image size & nthreads, then calculates the
+// chunks it asks for with fn until it disconnects; returns 0 on a clean disconnect
+int dist_serve(int fd, uint32_t img_w, uint32_t img_h, uint32_t nthreads, dist_rows_fn fn, void* arg);
+
+
+#endif // __DIST_H__
+
@@ -0,0 +1,236 @@
+// dzi.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// Deep Zoom (.dzi) image pyramid writer, all levels are written in one pass over the rows
+// NOTE: level n has the image size divided by 2^(nlevels-1-n) (rounded up), level 0 is
+// a single pixel; a missing last column or row of a 2x2 reduction repeats the one before
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "dzi.h"
+#include "png.h"
+
+
+//// defines ////
+// tile edge, without the overlap (the Deep Zoom default)
+#define DZI_TILE_SIZE   254U
+// pixels shared by neighbouring tiles, on each side
+#define DZI_OVERLAP     1U
+// longest file name
+#define DZI_PATH_MAX    1024U
+
+
+//// types ////
+// dzi_level_t
+// one level of the pyramid, with the rows of its current tile row
+typedef struct {
+  uint32_t w;
+  uint32_t h;
+  uint32_t row;               // rows received so far
+  uint32_t win_y;             // first row in the window
+  uint8_t* win;               // rgb rows of the current tile row (& the overlap of the next)
+  uint8_t* even;              // last even row, waiting for the odd one to be reduced with
+  uint32_t tile_row;          // current tile row
+} dzi_level_t;
+
+// dzi_s
+// image pyramid open for writing
+struct dzi_s {
+  char*        filename;
+  char*        dir;           // name_files
+  uint32_t     img_w;
+  uint32_t     img_h;
+  uint32_t     nlevels;
+  dzi_level_t* levels;
+  int          ok;
+};
+
+// dzi_job_t
+// tile row of a level, written a tile per task
+typedef struct {
+  const dzi_t* d;
+  uint32_t     level;
+  uint32_t     y0;
+  uint32_t     y1;
+  int          ok;
+} dzi_job_t;
+
+
+//// dzi_tile_rows() ////
+// returns the rows y0 .. y1-1 of tile row (or column) r of a level n pixels high (wide)
+static void dzi_tile_rows(uint32_t r, uint32_t n, uint32_t* y0, uint32_t* y1)
+{
+  *y0 = r ? r*DZI_TILE_SIZE - DZI_OVERLAP : 0;
+  *y1 = (r+1)*DZI_TILE_SIZE + DZI_OVERLAP < n ? (r+1)*DZI_TILE_SIZE + DZI_OVERLAP : n;
+}
+
+
+//// dzi_tile_task() ////
+// writes the tile in column task of the job's tile row
+static void dzi_tile_task(void* arg, uint32_t worker, uint32_t task)
+{
+  dzi_job_t* j = (dzi_job_t*)arg;
+  const dzi_level_t* l = &j->d->levels[j->level];
+  uint32_t x0, x1;
+  dzi_tile_rows(task, l->w, &x0, &x1);
+  char path[DZI_PATH_MAX];
+  png_t* t = NULL;
+  int n = snprintf(path, sizeof(path), "%s/%u/%u_%u.png", j->d->dir, j->level, task, l->tile_row);
+  if (n <= 0 || (uint32_t)n >= sizeof(path) || (t = png_open(path, x1-x0, j->y1-j->y0, 1)) == NULL) {
+    j->ok = 0;
+    return;
+  }
+  for (uint32_t y=j->y0; y<j->y1; y++) {
+    if (png_put_rows(t, NULL, l->win + 3*((uint64_t)(y-l->win_y)*l->w + x0), 1)) break;
+  }
+  if (png_close(t)) j->ok = 0;
+}
+
+
+//// dzi_tiles() ////
+// writes the tiles of the current tile row of a level, one tile per task on the workers
+// of s (NULL - on the calling thread), returns 0 on success
+static int dzi_tiles(dzi_t* d, sched_t* s, uint32_t level)
+{
+  const dzi_level_t* l = &d->levels[level];
+  dzi_job_t j = {d, level, 0, 0, 1};
+  dzi_tile_rows(l->tile_row, l->h, &j.y0, &j.y1);
+  uint32_t ncols = (l->w + DZI_TILE_SIZE-1) / DZI_TILE_SIZE;
+  if (s) {
+    sched_run(s, ncols, dzi_tile_task, &j);
+  } else {
+    for (uint32_t c=0; c<ncols; c++) dzi_tile_task(&j, 0, c);
+  }
+  return j.ok ? 0 : -1;
+}
+
+
+//// dzi_level_row() ////
+// takes the next row of a level, which is already in its window: reduces it with the
+// even row before it into the next row of the coarser level & writes the tile row once
+// it is complete
+static void dzi_level_row(dzi_t* d, sched_t* s, uint32_t level)
+{
+  dzi_level_t* l = &d->levels[level];
+  uint8_t* row = l->win + 3*(uint64_t)(l->row - l->win_y)*l->w;
+  uint32_t y = l->row++;
+  if (level > 0) {
+    if (y % 2 == 0 && y+1 < l->h) {
+      memcpy(l->even, row, 3*(uint64_t)l->w);
+    } else {
+      // 2x2 box filter, rounded
+      dzi_level_t* c = &d->levels[level-1];
+      const uint8_t* r0 = y % 2 ? l->even : row;
+      uint8_t* out = c->win + 3*(uint64_t)(c->row - c->win_y)*c->w;
+      for (uint32_t x=0; x<c->w; x++) {
+        uint32_t x0 = 3*2*x;
+        uint32_t x1 = 2*x+1 < l->w ? x0+3 : x0;
+        for (uint32_t k=0; k<3; k++) {
+          out[3*x+k] = (r0[x0+k] + r0[x1+k] + row[x0+k] + row[x1+k] + 2) >> 2;
+        }
+      }
+      dzi_level_row(d, s, level-1);
+    }
+  }
+  uint32_t y0, y1;
+  dzi_tile_rows(l->tile_row, l->h, &y0, &y1);
+  if (l->row < y1) return;
+  if (dzi_tiles(d, s, level)) d->ok = 0;
+  // keep the overlap rows of the next tile row
+  if (y1 < l->h) {
+    dzi_tile_rows(++l->tile_row, l->h, &y0, &y1);
+    memmove(l->win, l->win + 3*(uint64_t)(y0 - l->win_y)*l->w, 3*(uint64_t)(l->row - y0)*l->w);
+    l->win_y = y0;
+  }
+}
+
+
+//// dzi_open() ////
+dzi_t* dzi_open(const char* filename, uint32_t img_w, uint32_t img_h)
+{
+  dzi_t* d = NULL;
+  if (img_w == 0 || img_h == 0 || (d = (dzi_t*)calloc(1, sizeof(dzi_t))) == NULL) return NULL;
+  d->img_w = img_w;
+  d->img_h = img_h;
+  d->ok    = 1;
+  // levels down to a single pixel
+  uint32_t max = img_w > img_h ? img_w : img_h;
+  d->nlevels = 1;
+  while ((1ULL << (d->nlevels-1)) < max) d->nlevels++;
+  // tiles go to the directory named as the file, without the .dzi extension, & _files
+  size_t len = strlen(filename);
+  size_t base_len = len >= 4 && !strcmp(filename+len-4, ".dzi") ? len-4 : len;
+  if ((d->filename = strdup(filename)) == NULL || (d->dir = (char*)malloc(base_len + 7)) == NULL ||
+      (d->levels = (dzi_level_t*)calloc(d->nlevels, sizeof(dzi_level_t))) == NULL) {
+    dzi_close(d);
+    return NULL;
+  }
+  snprintf(d->dir, base_len + 7, "%.*s_files", (int)base_len, filename);
+  if (mkdir(d->dir, 0755) && errno != EEXIST) d->ok = 0;
+  for (uint32_t i=0; i<d->nlevels && d->ok; i++) {
+    dzi_level_t* l = &d->levels[i];
+    uint32_t shift = d->nlevels-1-i;
+    l->w = (uint32_t)(((uint64_t)img_w + (1ULL << shift)-1) >> shift);
+    l->h = (uint32_t)(((uint64_t)img_h + (1ULL << shift)-1) >> shift);
+    char path[DZI_PATH_MAX];
+    int n = snprintf(path, sizeof(path), "%s/%u", d->dir, i);
+    if (n <= 0 || (uint32_t)n >= sizeof(path) || (mkdir(path, 0755) && errno != EEXIST) ||
+        (l->win = (uint8_t*)malloc(3*(uint64_t)(DZI_TILE_SIZE + 2*DZI_OVERLAP)*l->w)) == NULL ||
+        (l->even = (uint8_t*)malloc(3*(uint64_t)l->w)) == NULL) {
+      d->ok = 0;
+    }
+  }
+  if (!d->ok) {
+    dzi_close(d);
+    return NULL;
+  }
+  return d;
+}
+
+
+//// dzi_put_rows() ////
+int dzi_put_rows(dzi_t* d, sched_t* s, const uint8_t* rgb, uint32_t nrows)
+{
+  dzi_level_t* l = &d->levels[d->nlevels-1];
+  if (nrows > l->h - l->row) d->ok = 0;
+  for (uint32_t i=0; i<nrows && d->ok; i++) {
+    memcpy(l->win + 3*(uint64_t)(l->row - l->win_y)*l->w, rgb + 3*(uint64_t)i*l->w, 3*(uint64_t)l->w);
+    dzi_level_row(d, s, d->nlevels-1);
+  }
+  return d->ok ? 0 : -1;
+}
+
+
+//// dzi_close() ////
+int dzi_close(dzi_t* d)
+{
+  int ret = d->ok && d->levels != NULL && d->levels[d->nlevels-1].row == d->img_h ? 0 : -1;
+  if (ret == 0) {
+    // the description is written last, so there is none for an incomplete pyramid
+    FILE* fp = NULL;
+    if ((fp = fopen(d->filename, "wb")) == NULL) {
+      ret = -1;
+    } else {
+      fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+      fprintf(fp, "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"png\" Overlap=\"%u\" TileSize=\"%u\">\n", DZI_OVERLAP, DZI_TILE_SIZE);
+      fprintf(fp, "  <Size Width=\"%u\" Height=\"%u\"/>\n", d->img_w, d->img_h);
+      fprintf(fp, "</Image>\n");
+      if (fclose(fp)) ret = -1;
+    }
+  }
+  for (uint32_t i=0; i<d->nlevels && d->levels != NULL; i++) {
+    free(d->levels[i].win);
+    free(d->levels[i].even);
+  }
+  free(d->levels);
+  free(d->dir);
+  free(d->filename);
+  free(d);
+  return ret;
+}
+
@@ -0,0 +1,39 @@
+// dzi.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// Deep Zoom (.dzi) image pyramid writer, all levels are written in one pass over the rows
+
+
+#ifndef __DZI_H__
+#define __DZI_H__
+
+
+//// includes ////
+#include <stdint.h>
+#include "sched.h"
+
+
+//// types ////
+// dzi_t
+// opaque image pyramid open for writing, filled top to bottom
+typedef struct dzi_s dzi_t;
+
+
+//// functions ////
+// creates the tile directories of the img_w x img_h pyramid described by filename
+// (name.dzi, the tiles go to name_files/level/column_row.png), returns NULL on error
+dzi_t* dzi_open(const char* filename, uint32_t img_w, uint32_t img_h);
+
+// appends nrows rows of packed rgb pixels to the full resolution level; each level keeps
+// only the rows of its current tile row, writes the tiles as soon as that is complete
+// (the tiles of a row as tasks on the workers of s, NULL - on the calling thread) &
+// passes every pair of rows, reduced 2x2, on to the next coarser level; returns 0 on
+// success
+int dzi_put_rows(dzi_t* d, sched_t* s, const uint8_t* rgb, uint32_t nrows);
+
+// writes the pyramid description & frees the writer, returns 0 if all rows (& so all
+// tiles) were written
+int dzi_close(dzi_t* d);
+
+
+#endif // __DZI_H__
+
@@ -0,0 +1,210 @@
+// expmap.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// exponential map (log-polar strip) zoom videos, streamed out as YUV4MPEG2
+// NOTE: point (row a, column u) of the strip is at offset exp(u_min + u*du) * e^(i*a*du)
+// from the zoom center; a frame at zoom z only shifts the strip columns by log(z)/du,
+// so the strip is rendered once & every frame is resampled from it
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "expmap.h"
+
+
+//// types ////
+// expmap_s
+// log-polar strip & the frame pixels' positions in it
+struct expmap_s {
+  uint32_t         img_w;
+  uint32_t         img_h;
+  double           zoom0;
+  double           zoom1;
+  uint32_t         n_angle;
+  uint32_t         n_radius;
+  double           u_min;     // log radius of the first column
+  double           du;        // step in log radius & in angle
+  uint32_t*        strip;     // n_angle rows of n_radius iteration counts
+  float*           pix_u;     // column of each frame pixel at zoom 1.0, without u_min
+  uint32_t*        pix_a;     // row of each frame pixel
+  float*           pix_wa;    // weight of the next row
+  expmap_points_fn fn;        // points function of the running expmap_render()
+  void*            arg;
+};
+
+// expmap_frame_t
+// shared state of the frame resampling tasks
+typedef struct {
+  const expmap_t* e;
+  const rgb_t*    palette;
+  double          shift;      // column offset of the frame
+  uint8_t*        y;
+  uint8_t*        u;
+  uint8_t*        v;
+} expmap_frame_t;
+
+
+//// expmap_create() ////
+expmap_t* expmap_create(uint32_t img_w, uint32_t img_h, double zoom0, double zoom1)
+{
+  expmap_t* e = NULL;
+  if (img_w == 0 || img_h == 0 || !(zoom0 > 0.0) || !(zoom1 > 0.0)) return NULL;
+  if ((e = (expmap_t*)calloc(1, sizeof(expmap_t))) == NULL) return NULL;
+  e->img_w = img_w;
+  e->img_h = img_h;
+  e->zoom0 = zoom0;
+  e->zoom1 = zoom1;
+  // one pixel of angle at the frame corner, the same step in log radius from half
+  // a pixel of the deepest frame to the corner of the widest one (& a column to interpolate with)
+  double corner = hypot((double)img_w/(double)img_h, 1.0);
+  double zoom_min = zoom0 < zoom1 ? zoom0 : zoom1;
+  double zoom_max = zoom0 < zoom1 ? zoom1 : zoom0;
+  e->n_angle  = (uint32_t)ceil(M_PI*(double)img_h*corner);
+  e->du       = 2.0*M_PI/(double)e->n_angle;
+  e->u_min    = log(zoom_min/(double)img_h);
+  e->n_radius = (uint32_t)ceil((log(zoom_max*corner) - e->u_min)/e->du) + 2;
+  uint64_t npoints = (uint64_t)e->n_angle*e->n_radius;
+  uint64_t npixels = (uint64_t)img_w*img_h;
+  if ((e->strip  = (uint32_t*)malloc(npoints*sizeof(uint32_t))) == NULL ||
+      (e->pix_u  = (float*)malloc(npixels*sizeof(float))) == NULL ||
+      (e->pix_a  = (uint32_t*)malloc(npixels*sizeof(uint32_t))) == NULL ||
+      (e->pix_wa = (float*)malloc(npixels*sizeof(float))) == NULL) {
+    expmap_destroy(e);
+    return NULL;
+  }
+  // strip position of every frame pixel, offsets as in mandelbrot_simple (2/img_h per pixel at zoom 1.0)
+  for (uint32_t img_y=0; img_y<img_h; img_y++) {
+    for (uint32_t img_x=0; img_x<img_w; img_x++) {
+      uint64_t i = (uint64_t)img_y*img_w + img_x;
+      double dx = ((double)img_x - 0.5*(double)img_w)*2.0/(double)img_h;
+      double dy = ((double)img_y - 0.5*(double)img_h)*2.0/(double)img_h;
+      double fa = atan2(dy, dx)/e->du;
+      if (fa < 0.0) fa += (double)e->n_angle;
+      uint32_t a = (uint32_t)fa;
+      e->pix_wa[i] = (float)(fa - (double)a);
+      e->pix_a[i]  = a < e->n_angle ? a : a - e->n_angle;
+      // the center pixel has no angle & goes to the first column
+      e->pix_u[i]  = dx == 0.0 && dy == 0.0 ? -HUGE_VALF : (float)(log(hypot(dx, dy))/e->du);
+    }
+  }
+  return e;
+}
+
+
+//// expmap_destroy() ////
+void expmap_destroy(expmap_t* e)
+{
+  if (e == NULL) return;
+  free(e->strip);
+  free(e->pix_u);
+  free(e->pix_a);
+  free(e->pix_wa);
+  free(e);
+}
+
+
+//// expmap_size() ////
+void expmap_size(const expmap_t* e, uint32_t* n_angle, uint32_t* n_radius)
+{
+  *n_angle  = e->n_angle;
+  *n_radius = e->n_radius;
+}
+
+
+//// expmap_row() ////
+// calculates one row (angle) of the strip
+static void expmap_row(void* arg, uint32_t worker, uint32_t task)
+{
+  const expmap_t* e = (const expmap_t*)arg;
+  double dc_x[EXPMAP_CHUNK];
+  double dc_y[EXPMAP_CHUNK];
+  double c = cos((double)task*e->du);
+  double s = sin((double)task*e->du);
+  uint32_t* row = e->strip + (uint64_t)task*e->n_radius;
+  for (uint32_t i=0; i<e->n_radius; i+=EXPMAP_CHUNK) {
+    uint32_t n = e->n_radius-i < EXPMAP_CHUNK ? e->n_radius-i : EXPMAP_CHUNK;
+    for (uint32_t j=0; j<n; j++) {
+      double r = exp(e->u_min + (double)(i+j)*e->du);
+      dc_x[j] = r*c;
+      dc_y[j] = r*s;
+    }
+    e->fn(e->arg, worker, dc_x, dc_y, n, row+i);
+  }
+}
+
+
+//// expmap_render() ////
+void expmap_render(expmap_t* e, sched_t* s, expmap_points_fn fn, void* arg)
+{
+  e->fn  = fn;
+  e->arg = arg;
+  sched_run(s, e->n_angle, expmap_row, e);
+  e->fn  = NULL;
+  e->arg = NULL;
+}
+
+
+//// expmap_frame_row() ////
+// resamples one frame row from the strip & converts it to BT.601 (studio range) YUV
+static void expmap_frame_row(void* arg, uint32_t worker, uint32_t task)
+{
+  const expmap_frame_t* f = (const expmap_frame_t*)arg;
+  const expmap_t* e = f->e;
+  float shift = (float)f->shift;
+  float u_max = (float)(e->n_radius-1);
+  uint64_t first = (uint64_t)task*e->img_w;
+  for (uint64_t i=first; i<first+e->img_w; i++) {
+    // column & its weight, clamped to the strip
+    float fu = e->pix_u[i] + shift;
+    if (!(fu > 0.0f)) fu = 0.0f;
+    if (fu >= u_max) fu = u_max;
+    uint32_t u0 = (uint32_t)fu;
+    if (u0 > e->n_radius-2) u0 = e->n_radius-2;
+    float wu = fu - (float)u0;
+    float wa = e->pix_wa[i];
+    uint32_t a0 = e->pix_a[i];
+    uint32_t a1 = a0+1 < e->n_angle ? a0+1 : 0;
+    const uint32_t* s0 = e->strip + (uint64_t)a0*e->n_radius + u0;
+    const uint32_t* s1 = e->strip + (uint64_t)a1*e->n_radius + u0;
+    const rgb_t* c00 = &f->palette[s0[0]];
+    const rgb_t* c01 = &f->palette[s0[1]];
+    const rgb_t* c10 = &f->palette[s1[0]];
+    const rgb_t* c11 = &f->palette[s1[1]];
+    float w00 = (1.0f-wa)*(1.0f-wu);
+    float w01 = (1.0f-wa)*wu;
+    float w10 = wa*(1.0f-wu);
+    float w11 = wa*wu;
+    float r = w00*c00->r + w01*c01->r + w10*c10->r + w11*c11->r;
+    float g = w00*c00->g + w01*c01->g + w10*c10->g + w11*c11->g;
+    float b = w00*c00->b + w01*c01->b + w10*c10->b + w11*c11->b;
+    f->y[i] = (uint8_t)( 16.0f + 0.256788f*r + 0.504129f*g + 0.097906f*b + 0.5f);
+    f->u[i] = (uint8_t)(128.0f - 0.148223f*r - 0.290993f*g + 0.439216f*b + 0.5f);
+    f->v[i] = (uint8_t)(128.0f + 0.439216f*r - 0.367788f*g - 0.071427f*b + 0.5f);
+  }
+}
+
+
+//// expmap_write_y4m() ////
+int expmap_write_y4m(const expmap_t* e, sched_t* s, FILE* fp, uint32_t nframes, uint32_t fps, const rgb_t* palette)
+{
+  uint64_t npixels = (uint64_t)e->img_w*e->img_h;
+  uint8_t* yuv = NULL;
+  if ((yuv = (uint8_t*)malloc(3*npixels)) == NULL) return -1;
+  expmap_frame_t f = {e, palette, 0.0, yuv, yuv+npixels, yuv+2*npixels};
+  int ok = fprintf(fp, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n", e->img_w, e->img_h, fps) > 0;
+  for (uint32_t k=0; k<nframes && ok; k++) {
+    // the same zoom factor between all frames
+    double t = nframes > 1 ? (double)k/(double)(nframes-1) : 0.0;
+    double zoom = e->zoom0*pow(e->zoom1/e->zoom0, t);
+    f.shift = (log(zoom) - e->u_min)/e->du;
+    sched_run(s, e->img_h, expmap_frame_row, &f);
+    ok = fputs("FRAME\n", fp) >= 0 && fwrite(yuv, 1, 3*npixels, fp) == 3*npixels;
+  }
+  free(yuv);
+  if (ok && fflush(fp)) ok = 0;
+  return ok ? 0 : -1;
+}
+
@@ -0,0 +1,57 @@
+// expmap.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// exponential map (log-polar strip) zoom videos, streamed out as YUV4MPEG2
+
+
+#ifndef __EXPMAP_H__
+#define __EXPMAP_H__
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdint.h>
+#include "sched.h"
+#include "ppm.h"
+
+
+//// defines ////
+// maximal number of points passed to the points function at once
+#define EXPMAP_CHUNK 256U
+
+
+//// types ////
+// expmap_t
+// opaque log-polar strip around the zoom center, one row per angle & one column per
+// log radius, with the same step in both, so that the strip is conformal to the frames
+typedef struct expmap_s expmap_t;
+
+// expmap_points_fn
+// calculates number of iterations for n (at most EXPMAP_CHUNK) points at offsets
+// (dc_x[i], dc_y[i]) from the zoom center
+typedef void (*expmap_points_fn)(void* arg, uint32_t worker, const double* dc_x, const double* dc_y, uint32_t n, uint32_t* iterations);
+
+
+//// functions ////
+// creates the strip for img_w x img_h frames zooming from zoom0 to zoom1 (half of the
+// frame height, as -z); it covers the corners of the first frame down to half a pixel
+// of the last one, returns NULL on error
+expmap_t* expmap_create(uint32_t img_w, uint32_t img_h, double zoom0, double zoom1);
+
+// frees the strip
+void expmap_destroy(expmap_t* e);
+
+// returns the number of strip rows (angles) & columns (log radii)
+void expmap_size(const expmap_t* e, uint32_t* n_angle, uint32_t* n_radius);
+
+// calculates all points of the strip on all workers
+void expmap_render(expmap_t* e, sched_t* s, expmap_points_fn fn, void* arg);
+
+// resamples nframes frames, zoom0 to zoom1 with the same zoom factor between frames,
+// from the strip (bilinear, in color), colors them with palette (one entry per iteration
+// count) & writes them to fp as a 4:4:4 YUV4MPEG2 stream at fps frames per second;
+// returns 0 on success
+int expmap_write_y4m(const expmap_t* e, sched_t* s, FILE* fp, uint32_t nframes, uint32_t fps, const rgb_t* palette);
+
+
+#endif // __EXPMAP_H__
+
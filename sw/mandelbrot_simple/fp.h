@@ -0,0 +1,29 @@
+// fp.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// fixed-point format of the FPGA Mandelbrot engine (see mandelbrot_calc.v)
+
+
+#ifndef __FP_H__
+#define __FP_H__
+
+
+//// includes ////
+#include <stdint.h>
+
+
+//// types ////
+typedef int64_t FP;
+
+
+//// FP ////
+#define MAX_MUL_WIDTH 54UL
+#define FP_S 1UL
+#define FP_I 4UL
+#define FP_F (MAX_MUL_WIDTH-FP_S-FP_I)
+#define DBL2FP(x) ((FP)((x)*(1UL<<FP_F)))
+#define FP2DBL(x) ((double)(x)/(1UL<<FP_F))
+#define FPMUL(x, y) ({__int128 v128 = (__int128)(x) * (__int128)(y); FP v64 = (FP)(v128>>FP_F); v64;})
+
+
+#endif // __FP_H__
+
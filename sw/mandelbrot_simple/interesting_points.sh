@@ -1,4 +1,5 @@
 ./mandelbrot_simple -cx -0.0452407411 -cy 0.986816213 -z 1.75E-7 -iw 8192 -ih 4096
 ./mandelbrot_simple -cx -0.7463 -cy 0.1102 -z 0.005 -iw 8192 -ih 4096
 ./mandelbrot_simple -cx 2.613577e-1 -cy -2.018128e-3 -z 0.000298081606398 -iw 8000 -ih 6000
+./mandelbrot_simple -cx -0.743643887037158704752191506114774 -cy 0.131825904205311970493132056385139 -z 1E-30 -n 200000 -pt
 
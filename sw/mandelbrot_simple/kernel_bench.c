@@ -0,0 +1,664 @@
+// kernel_bench.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// escape time kernel throughput benchmark (float & double-double vs double), & the
+// benchmark suite: all kernels over the interesting points & the firmware views at
+// several thread counts, with JSON results compared against a stored baseline
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "kernel_dbl.h"
+#include "kernel_flt.h"
+#include "kernel_dd.h"
+#include "kernel_fp.h"
+#include "sched.h"
+#include "prec.h"
+#include "coords.h"
+
+
+//// defines ////
+// default width of the benchmark view
+#define IMG_WIDTH       256U
+// default height of the benchmark view
+#define IMG_HEIGHT      128U
+// default maximum number of iterations
+#define NITERATIONS     1000U
+// default Mandelbrot zoom
+#define MANDELBROT_ZOOM 0.005
+// default Mandelbrot center x coordinate
+#define MANDELBROT_CX   -0.7463
+// default Mandelbrot center y coordinate
+#define MANDELBROT_CY   0.1102
+// default number of timed runs per kernel (the fastest one is reported)
+#define NRUNS           3U
+// default suite views, the mandelbrot_simple command lines
+#define POINTS_FILENAME "interesting_points.sh"
+// default suite firmware views, the coords[] table
+#define FW_FILENAME     "../../fw/main.c"
+// maximum iterations of views without -n (the mandelbrot_simple default) & of the
+// firmware views (the FPGA MAXITERS)
+#define VIEW_NITER      256U
+// firmware screen size, the coords[] steps are for it
+#define FW_WIDTH        800U
+#define FW_HEIGHT       600U
+// default throughput loss (in %) reported as a regression
+#define THRESHOLD       10.0
+// maximum number of suite kernels & thread counts
+#define MAX_KERNELS     32U
+#define MAX_THREADS     16U
+
+
+//// types ////
+// family_t
+// kernel families, by number format
+typedef enum {
+  FAMILY_DOUBLE = 0,
+  FAMILY_FLOAT,
+  FAMILY_DD,
+  FAMILY_FP
+} family_t;
+
+// view_t
+// one suite view
+typedef struct {
+  char     name[32];
+  char     cx[64];            // center, as given (full precision)
+  char     cy[64];
+  double   zoom;
+  uint32_t niter;
+} view_t;
+
+// kernel_t
+// one suite kernel & its accumulated results, per thread count
+typedef struct {
+  family_t    family;
+  const char* name;
+  uint32_t    lanes;
+  const void* k;              // kernel_dbl_t, kernel_flt_t, kernel_dd_t or kernel_fp_t
+  uint32_t    nviews;         // views precise enough for the kernel
+  double      secs[MAX_THREADS];
+  uint64_t    pixels[MAX_THREADS];
+  uint64_t    iters[MAX_THREADS];
+} kernel_t;
+
+// bench_t
+// one kernel over one view, a row per task
+typedef struct {
+  const kernel_t* kernel;
+  uint32_t        img_w;
+  uint32_t        niter;
+  const double*   man_x;
+  const double*   man_xl;
+  const double*   man_y;
+  const double*   man_yl;
+  const float*    man_xf;
+  const float*    man_yf;
+  const FP*       man_x_fp;
+  const FP*       man_y_fp;
+  uint32_t*       iterations;
+} bench_t;
+
+
+//// usage() ////
+void usage(char* progname)
+{
+  fprintf(stderr, "Usage: %s [-h] [-iw image_width] [-ih image_height] [-n niterations] [-cx x_coord] [-cy y_coord] [-z zoom] [-r nruns] [-suite] [-points file] [-fw file] [-threads list] [-json file] [-baseline file] [-threshold pct]\n", progname);
+  fprintf(stderr, "  -h               - show this help\n");
+  fprintf(stderr, "  -iw image_width  - set benchmark view width to image_width (default: %u)\n", IMG_WIDTH);
+  fprintf(stderr, "  -ih image_height - set benchmark view height to image_height (default: %u)\n", IMG_HEIGHT);
+  fprintf(stderr, "  -n niterations   - set maximal iterations to niterations (default: %u)\n", NITERATIONS);
+  fprintf(stderr, "  -cx x_coord      - set Mandelbrot center x coordinate to x_coord (default: %f)\n", MANDELBROT_CX);
+  fprintf(stderr, "  -cy y_coord      - set Mandelbrot center y coordinate to y_coord (default: %f)\n", MANDELBROT_CY);
+  fprintf(stderr, "  -z zoom          - set Mandelbrot zoom to zoom (default: %f)\n", MANDELBROT_ZOOM);
+  fprintf(stderr, "  -r nruns         - set number of timed runs per kernel to nruns (default: %u)\n", NRUNS);
+  fprintf(stderr, "  -suite           - run all kernels over the suite views (the size is set by -iw & -ih) at all thread counts\n");
+  fprintf(stderr, "  -points file     - read suite views from the mandelbrot_simple command lines in file (default: %s)\n", POINTS_FILENAME);
+  fprintf(stderr, "  -fw file         - read suite views from the coords[] table in file (default: %s)\n", FW_FILENAME);
+  fprintf(stderr, "  -threads list    - set suite thread counts to the comma separated list (default: 1, 2, 4, ... & number of cpus)\n");
+  fprintf(stderr, "  -json file       - write suite results to file\n");
+  fprintf(stderr, "  -baseline file   - compare suite results with the ones in file (written by -json), fail on regressions or no matching results\n");
+  fprintf(stderr, "  -threshold pct   - set the Giter/s loss reported as a regression to pct %% (default: %.0f)\n", THRESHOLD);
+  exit(EXIT_FAILURE);
+}
+
+
+//// now() ////
+// returns monotonic time in seconds
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec*1e-9;
+}
+
+
+//// report() ////
+// prints kernel throughput, relative to the reference throughput (if set)
+static void report(const char* family, const char* name, uint32_t lanes, double secs, uint64_t sum, double ref)
+{
+  double mips = (double)sum/secs*1e-6;
+  printf("%-6s %-8s %2u lanes  %9.3f ms  %10.1f Miter/s", family, name, lanes, secs*1e3, mips);
+  if (ref > 0.0) printf("  (%.2fx)", mips/ref);
+  printf("\n");
+}
+
+
+//// read_points() ////
+// reads views from mandelbrot_simple command lines (-cx, -cy, -z & -n), appends them to
+// views, returns 0 on success
+static int read_points(const char* filename, view_t* views, uint32_t max_views, uint32_t* nviews)
+{
+  FILE* fp = NULL;
+  if ((fp = fopen(filename, "rb")) == NULL) return -1;
+  char line[1024];
+  uint32_t nline = 0;
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    nline++;
+    if (strstr(line, "mandelbrot_simple") == NULL || *nviews == max_views) continue;
+    view_t* v = &views[*nviews];
+    memset(v, 0, sizeof(view_t));
+    snprintf(v->name, sizeof(v->name), "points:%u", nline);
+    snprintf(v->cx, sizeof(v->cx), "%.17g", -0.75);
+    snprintf(v->cy, sizeof(v->cy), "%.17g", 0.0);
+    v->zoom  = 1.2;
+    v->niter = VIEW_NITER;
+    char* save = NULL;
+    for (char* tok=strtok_r(line, " \t\r\n", &save); tok != NULL; tok=strtok_r(NULL, " \t\r\n", &save)) {
+      char* val = NULL;
+      if (!strcmp(tok, "-cx") || !strcmp(tok, "-cy") || !strcmp(tok, "-z") || !strcmp(tok, "-n")) {
+        if ((val = strtok_r(NULL, " \t\r\n", &save)) == NULL) break;
+      }
+      if (!strcmp(tok, "-cx")) snprintf(v->cx, sizeof(v->cx), "%s", val);
+      if (!strcmp(tok, "-cy")) snprintf(v->cy, sizeof(v->cy), "%s", val);
+      if (!strcmp(tok, "-z"))  v->zoom = strtod(val, NULL);
+      if (!strcmp(tok, "-n"))  v->niter = strtoul(val, NULL, 0);
+    }
+    (*nviews)++;
+  }
+  fclose(fp);
+  return 0;
+}
+
+
+//// read_fw() ////
+// reads views from the {x0, y0, xs, ys} FP entries of the coords[] table (commented out
+// entries are skipped), appends them to views, returns 0 on success
+static int read_fw(const char* filename, view_t* views, uint32_t max_views, uint32_t* nviews)
+{
+  coords_t* coords = NULL;
+  uint32_t ncoords = 0;
+  if ((coords = coords_read(filename, &ncoords)) == NULL) return -1;
+  for (uint32_t i=0; i<ncoords && *nviews<max_views; i++) {
+    // center & zoom of the screen the steps are for
+    view_t* w = &views[*nviews];
+    memset(w, 0, sizeof(view_t));
+    snprintf(w->name, sizeof(w->name), "fw:%u", i);
+    snprintf(w->cx, sizeof(w->cx), "%.17g", FP2DBL(coords[i].x0) + FP2DBL(coords[i].xs)*(FW_WIDTH/2));
+    snprintf(w->cy, sizeof(w->cy), "%.17g", FP2DBL(coords[i].y0) + FP2DBL(coords[i].ys)*(FW_HEIGHT/2));
+    w->zoom  = FP2DBL(coords[i].ys)*(FW_HEIGHT/2);
+    w->niter = VIEW_NITER;
+    (*nviews)++;
+  }
+  free(coords);
+  return ncoords ? 0 : -1;
+}
+
+
+//// bench_row() ////
+// calculates one row of the view with the kernel
+static void bench_row(void* arg, uint32_t worker, uint32_t task)
+{
+  (void)worker;
+  const bench_t* b = (const bench_t*)arg;
+  uint64_t i = (uint64_t)task*b->img_w;
+  switch (b->kernel->family) {
+    case FAMILY_DOUBLE:
+      ((const kernel_dbl_t*)b->kernel->k)->fn(b->man_x+i, b->man_y+i, b->img_w, b->niter, -1.0, b->iterations+i);
+      break;
+    case FAMILY_FLOAT:
+      ((const kernel_flt_t*)b->kernel->k)->fn(b->man_xf+i, b->man_yf+i, b->img_w, b->niter, -1.0, b->iterations+i);
+      break;
+    case FAMILY_DD:
+      ((const kernel_dd_t*)b->kernel->k)->fn(b->man_x+i, b->man_xl+i, b->man_y+i, b->man_yl+i, b->img_w, b->niter, -1.0, b->iterations+i);
+      break;
+    case FAMILY_FP:
+      ((const kernel_fp_t*)b->kernel->k)->fn(b->man_x_fp+i, b->man_y_fp+i, b->img_w, b->niter, 0, b->iterations+i);
+      break;
+  }
+}
+
+
+//// suite() ////
+// runs all kernels over all views at all thread counts, prints the throughput & the
+// scaling efficiency (relative to the lowest thread count), writes the results as JSON
+// & compares them with the baseline ones (exits if none match); returns the number of
+// regressions
+static uint32_t suite(const view_t* views, uint32_t nviews, uint32_t img_w, uint32_t img_h, uint32_t nruns, const uint32_t* threads, uint32_t nthreads,
+                      const char* json_filename, const char* baseline_filename, double threshold)
+{
+  static const char* family_names[] = {"double", "float", "dd", "fp"};
+  static const uint32_t family_bits[] = {53, 24, 106, FP_F};
+  static const char* names[] = {"scalar", "sse2", "avx2", "avx512", "avx512ifma"};
+
+  // all kernels supported by the cpu
+  kernel_t* kernels = NULL;
+  uint32_t nkernels = 0;
+  if ((kernels = (kernel_t*)calloc(MAX_KERNELS, sizeof(kernel_t))) == NULL) {
+    fprintf(stderr, "Can't allocate kernels array, exiting.\n");
+    exit(EXIT_FAILURE);
+  }
+  for (uint32_t f=FAMILY_DOUBLE; f<=FAMILY_FP; f++) {
+    for (uint32_t k_i=0; k_i<sizeof(names)/sizeof(names[0]) && nkernels<MAX_KERNELS; k_i++) {
+      kernel_t* kn = &kernels[nkernels];
+      // fp kernels have no sse2 variant, the others no avx512ifma one
+      const void* k = NULL;
+      if (f == FAMILY_DOUBLE && strcmp(names[k_i], "avx512ifma") && (k = kernel_dbl_select(names[k_i])) != NULL) {
+        kn->name  = ((const kernel_dbl_t*)k)->name;
+        kn->lanes = ((const kernel_dbl_t*)k)->lanes;
+      } else if (f == FAMILY_FLOAT && strcmp(names[k_i], "avx512ifma") && (k = kernel_flt_select(names[k_i])) != NULL) {
+        kn->name  = ((const kernel_flt_t*)k)->name;
+        kn->lanes = ((const kernel_flt_t*)k)->lanes;
+      } else if (f == FAMILY_DD && strcmp(names[k_i], "avx512ifma") && (k = kernel_dd_select(names[k_i])) != NULL) {
+        kn->name  = ((const kernel_dd_t*)k)->name;
+        kn->lanes = ((const kernel_dd_t*)k)->lanes;
+      } else if (f == FAMILY_FP && strcmp(names[k_i], "sse2") && (k = kernel_fp_select(names[k_i])) != NULL) {
+        kn->name  = ((const kernel_fp_t*)k)->name;
+        kn->lanes = ((const kernel_fp_t*)k)->lanes;
+      } else {
+        continue;
+      }
+      kn->k = k;
+      kn->family = (family_t)f;
+      nkernels++;
+    }
+  }
+
+  // a thread pool per thread count
+  sched_t* scheds[MAX_THREADS];
+  for (uint32_t t=0; t<nthreads; t++) {
+    if ((scheds[t] = sched_create(threads[t])) == NULL) {
+      fprintf(stderr, "Can't create worker threads, exiting.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // view points in all number formats
+  uint32_t n = img_w*img_h;
+  double* man_x  = (double*)malloc(n * sizeof(double));
+  double* man_y  = (double*)malloc(n * sizeof(double));
+  double* man_xl = (double*)malloc(n * sizeof(double));
+  double* man_yl = (double*)malloc(n * sizeof(double));
+  float* man_xf  = (float*)malloc(n * sizeof(float));
+  float* man_yf  = (float*)malloc(n * sizeof(float));
+  FP* man_x_fp   = (FP*)malloc(n * sizeof(FP));
+  FP* man_y_fp   = (FP*)malloc(n * sizeof(FP));
+  uint32_t* iterations = (uint32_t*)malloc(n * sizeof(uint32_t));
+  if (man_x == NULL || man_y == NULL || man_xl == NULL || man_yl == NULL || man_xf == NULL || man_yf == NULL || man_x_fp == NULL || man_y_fp == NULL || iterations == NULL) {
+    fprintf(stderr, "Can't allocate benchmark arrays, exiting.\n");
+    exit(EXIT_FAILURE);
+  }
+  printf("Benchmark suite with %u views of %u points, best of %u runs.\n", nviews, n, nruns);
+  for (uint32_t v=0; v<nviews; v++) {
+    const view_t* view = &views[v];
+    double cx_hi, cx_lo, cy_hi, cy_lo;
+    if (kernel_dd_parse(view->cx, &cx_hi, &cx_lo) || kernel_dd_parse(view->cy, &cy_hi, &cy_lo)) {
+      fprintf(stderr, "Can't parse center coordinates of view %s, exiting.\n", view->name);
+      exit(EXIT_FAILURE);
+    }
+    for (uint32_t img_y=0; img_y<img_h; img_y++) {
+      for (uint32_t img_x=0; img_x<img_w; img_x++) {
+        uint32_t i = img_y*img_w + img_x;
+        double dc_x = ((double)img_x/(double)img_w - 0.5) * 2.0*(double)img_w/(double)img_h*view->zoom;
+        double dc_y = ((double)img_y/(double)img_h - 0.5) * 2.0*view->zoom;
+        kernel_dd_add_dbl(cx_hi, cx_lo, dc_x, &man_x[i], &man_xl[i]);
+        kernel_dd_add_dbl(cy_hi, cy_lo, dc_y, &man_y[i], &man_yl[i]);
+        man_xf[i]   = (float)man_x[i];
+        man_yf[i]   = (float)man_y[i];
+        man_x_fp[i] = DBL2FP(man_x[i]);
+        man_y_fp[i] = DBL2FP(man_y[i]);
+      }
+    }
+    // only the kernels precise enough for the view
+    uint32_t bits = prec_bits(cx_hi, cy_hi, view->zoom, img_w, img_h, view->niter);
+    uint32_t nrun = 0;
+    for (uint32_t k=0; k<nkernels; k++) {
+      kernel_t* kn = &kernels[k];
+      if (bits > family_bits[kn->family]) continue;
+      bench_t b = {kn, img_w, view->niter, man_x, man_xl, man_y, man_yl, man_xf, man_yf, man_x_fp, man_y_fp, iterations};
+      for (uint32_t t=0; t<nthreads; t++) {
+        double best = 1e30;
+        for (uint32_t r=0; r<nruns; r++) {
+          double t0 = now();
+          sched_run(scheds[t], img_h, bench_row, &b);
+          double secs = now() - t0;
+          best = secs < best ? secs : best;
+        }
+        uint64_t sum = 0;
+        for (uint32_t i=0; i<n; i++) sum += iterations[i];
+        kn->secs[t]   += best;
+        kn->pixels[t] += n;
+        kn->iters[t]  += sum;
+      }
+      kn->nviews++;
+      nrun++;
+    }
+    if (nrun == 0) {
+      printf("view %-12s needs %u bits, more than any kernel has, skipped\n", view->name, bits);
+    }
+  }
+
+  // results, the scaling efficiency is relative to the first thread count
+  FILE* json = NULL;
+  if (json_filename != NULL) {
+    if ((json = fopen(json_filename, "wb")) == NULL) {
+      fprintf(stderr, "Can't open output file %s, exiting.\n", json_filename);
+      exit(EXIT_FAILURE);
+    }
+    fprintf(json, "{\n  \"points\": %u,\n  \"views\": %u,\n  \"runs\": %u,\n  \"results\": [\n", n, nviews, nruns);
+  }
+  uint32_t nresults = 0;
+  for (uint32_t k=0; k<nkernels; k++) {
+    const kernel_t* kn = &kernels[k];
+    if (kn->nviews == 0) continue;
+    double base = (double)kn->iters[0]/kn->secs[0];
+    for (uint32_t t=0; t<nthreads; t++) {
+      double mpixels = (double)kn->pixels[t]/kn->secs[t]*1e-6;
+      double giters  = (double)kn->iters[t]/kn->secs[t]*1e-9;
+      double eff     = (double)kn->iters[t]/kn->secs[t] / base * (double)threads[0]/(double)threads[t];
+      printf("%-6s %-10s %2u lanes %3u threads %2u views  %9.1f Mpixel/s  %8.3f Giter/s  %6.1f%% scaling\n",
+             family_names[kn->family], kn->name, kn->lanes, threads[t], kn->nviews, mpixels, giters, 100.0*eff);
+      if (json != NULL) {
+        fprintf(json, "%s    {\"kernel\": \"%s/%s\", \"threads\": %u, \"views\": %u, \"mpixels_s\": %.3f, \"giters_s\": %.5f, \"efficiency\": %.4f}",
+                nresults ? ",\n" : "", family_names[kn->family], kn->name, threads[t], kn->nviews, mpixels, giters, eff);
+      }
+      nresults++;
+    }
+  }
+  if (json != NULL) {
+    fprintf(json, "\n  ]\n}\n");
+    if (fclose(json)) {
+      fprintf(stderr, "Can't write output file %s, exiting.\n", json_filename);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // compare with the baseline results of the same kernels, thread counts & views
+  uint32_t nregressions = 0;
+  if (baseline_filename != NULL) {
+    FILE* fp = NULL;
+    if ((fp = fopen(baseline_filename, "rb")) == NULL) {
+      fprintf(stderr, "Can't open baseline file %s, exiting.\n", baseline_filename);
+      exit(EXIT_FAILURE);
+    }
+    char line[1024];
+    uint32_t ncompared = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+      char name[64];
+      uint32_t nthr, nv, npoints;
+      double mpixels, giters;
+      if (sscanf(line, " \"points\": %u", &npoints) == 1 && npoints != n) {
+        fprintf(stderr, "Baseline %s is for views of %u points, not %u, exiting.\n", baseline_filename, npoints, n);
+        exit(EXIT_FAILURE);
+      }
+      const char* entry = strstr(line, "{\"kernel\"");
+      if (entry == NULL || sscanf(entry, "{\"kernel\": \"%63[^\"]\", \"threads\": %u, \"views\": %u, \"mpixels_s\": %lf, \"giters_s\": %lf", name, &nthr, &nv, &mpixels, &giters) != 5) continue;
+      for (uint32_t k=0; k<nkernels; k++) {
+        const kernel_t* kn = &kernels[k];
+        char kname[64];
+        snprintf(kname, sizeof(kname), "%s/%s", family_names[kn->family], kn->name);
+        for (uint32_t t=0; t<nthreads && kn->nviews; t++) {
+          if (strcmp(kname, name) || threads[t] != nthr || kn->nviews != nv) continue;
+          double now_giters = (double)kn->iters[t]/kn->secs[t]*1e-9;
+          double change = 100.0*(now_giters/giters - 1.0);
+          ncompared++;
+          if (change < -threshold) {
+            printf("regression: %s, %u threads: %.3f Giter/s, baseline %.3f Giter/s (%.1f%%)\n", kname, nthr, now_giters, giters, change);
+            nregressions++;
+          }
+        }
+      }
+    }
+    fclose(fp);
+    printf("baseline:           %u of %u results compared, %u regressions (over %.1f%%)\n", ncompared, nresults, nregressions, threshold);
+    // a baseline of other kernels, thread counts or views checks nothing
+    if (ncompared == 0) {
+      fprintf(stderr, "Baseline %s has none of the results, exiting.\n", baseline_filename);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for (uint32_t t=0; t<nthreads; t++) sched_destroy(scheds[t]);
+  free(kernels);
+  free(man_x);
+  free(man_y);
+  free(man_xl);
+  free(man_yl);
+  free(man_xf);
+  free(man_yf);
+  free(man_x_fp);
+  free(man_y_fp);
+  free(iterations);
+  return nregressions;
+}
+
+
+//// main() ////
+int main(int argc, char*argv[])
+{
+  // default values
+  uint32_t img_w  = IMG_WIDTH;
+  uint32_t img_h  = IMG_HEIGHT;
+  uint32_t niter  = NITERATIONS;
+  double man_cx   = MANDELBROT_CX;
+  double man_cy   = MANDELBROT_CY;
+  double man_zoom = MANDELBROT_ZOOM;
+  uint32_t nruns  = NRUNS;
+  const char* man_cx_str = NULL;
+  const char* man_cy_str = NULL;
+  uint32_t run_suite = 0;
+  const char* points_filename = POINTS_FILENAME;
+  const char* fw_filename = FW_FILENAME;
+  const char* threads_list = NULL;
+  const char* json_filename = NULL;
+  const char* baseline_filename = NULL;
+  double threshold = THRESHOLD;
+
+  // parse cmd args
+  int curpos = 1;
+  while (curpos < argc) {
+    if        (!strcmp(argv[curpos], "-h")) {
+      usage(argv[0]);
+    } else if (!strcmp(argv[curpos], "-iw")) {\
+      curpos++;
+      img_w = strtoul(argv[curpos++], NULL, 0);
+    } else if (!strcmp(argv[curpos], "-ih")) {\
+      curpos++;
+      img_h = strtoul(argv[curpos++], NULL, 0);
+    } else if (!strcmp(argv[curpos], "-n")) {\
+      curpos++;
+      niter = strtoul(argv[curpos++], NULL, 0);
+    } else if (!strcmp(argv[curpos], "-cx")) {\
+      curpos++;
+      man_cx_str = argv[curpos];
+      man_cx = strtod(argv[curpos++], NULL);
+    } else if (!strcmp(argv[curpos], "-cy")) {\
+      curpos++;
+      man_cy_str = argv[curpos];
+      man_cy = strtod(argv[curpos++], NULL);
+    } else if (!strcmp(argv[curpos], "-z")) {\
+      curpos++;
+      man_zoom = strtod(argv[curpos++], NULL);
+    } else if (!strcmp(argv[curpos], "-r")) {\
+      curpos++;
+      nruns = strtoul(argv[curpos++], NULL, 0);
+    } else if (!strcmp(argv[curpos], "-suite")) {\
+      curpos++;
+      run_suite = 1;
+    } else if (!strcmp(argv[curpos], "-points")) {\
+      curpos++;
+      points_filename = argv[curpos++];
+    } else if (!strcmp(argv[curpos], "-fw")) {\
+      curpos++;
+      fw_filename = argv[curpos++];
+    } else if (!strcmp(argv[curpos], "-threads")) {\
+      curpos++;
+      threads_list = argv[curpos++];
+    } else if (!strcmp(argv[curpos], "-json")) {\
+      curpos++;
+      json_filename = argv[curpos++];
+    } else if (!strcmp(argv[curpos], "-baseline")) {\
+      curpos++;
+      baseline_filename = argv[curpos++];
+    } else if (!strcmp(argv[curpos], "-threshold")) {\
+      curpos++;
+      threshold = strtod(argv[curpos++], NULL);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (nruns == 0) nruns = 1;
+
+  if (run_suite) {
+    // views of both files
+    static view_t views[256];
+    uint32_t nviews = 0;
+    if (read_points(points_filename, views, sizeof(views)/sizeof(views[0]), &nviews)) {
+      fprintf(stderr, "Can't read views from %s, exiting.\n", points_filename);
+      exit(EXIT_FAILURE);
+    }
+    if (read_fw(fw_filename, views, sizeof(views)/sizeof(views[0]), &nviews)) {
+      fprintf(stderr, "Can't read views from %s, exiting.\n", fw_filename);
+      exit(EXIT_FAILURE);
+    }
+    // thread counts: the list, or powers of two up to the number of cpus & that number
+    uint32_t threads[MAX_THREADS];
+    uint32_t nthreads = 0;
+    if (threads_list != NULL) {
+      for (const char* c=threads_list; *c && nthreads<MAX_THREADS; ) {
+        char* end = NULL;
+        uint32_t t = strtoul(c, &end, 0);
+        if (end == c) break;
+        if (t > 0) threads[nthreads++] = t;
+        c = *end == ',' ? end+1 : end;
+      }
+    } else {
+      long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+      uint32_t max = ncpus > 0 ? (uint32_t)ncpus : 1;
+      for (uint32_t t=1; t<max && nthreads<MAX_THREADS-1; t*=2) threads[nthreads++] = t;
+      threads[nthreads++] = max;
+    }
+    if (nviews == 0 || nthreads == 0) {
+      fprintf(stderr, "No views or thread counts, exiting.\n");
+      exit(EXIT_FAILURE);
+    }
+    if (suite(views, nviews, img_w, img_h, nruns, threads, nthreads, json_filename, baseline_filename, threshold)) {
+      fprintf(stderr, "Throughput regressed, exiting.\n");
+      exit(EXIT_FAILURE);
+    }
+    exit(EXIT_SUCCESS);
+  }
+
+  // benchmark points, as double & as double-double (float copies are made later)
+  uint32_t n = img_w*img_h;
+  double* man_x  = (double*)malloc(n * sizeof(double));
+  double* man_y  = (double*)malloc(n * sizeof(double));
+  double* man_xl = (double*)malloc(n * sizeof(double));
+  double* man_yl = (double*)malloc(n * sizeof(double));
+  float* man_xf  = (float*)malloc(n * sizeof(float));
+  float* man_yf  = (float*)malloc(n * sizeof(float));
+  uint32_t* iterations = (uint32_t*)malloc(n * sizeof(uint32_t));
+  if (man_x == NULL || man_y == NULL || man_xl == NULL || man_yl == NULL || man_xf == NULL || man_yf == NULL || iterations == NULL) {
+    fprintf(stderr, "Can't allocate benchmark arrays, exiting.\n");
+    exit(EXIT_FAILURE);
+  }
+  double cx_hi = man_cx, cx_lo = 0.0;
+  double cy_hi = man_cy, cy_lo = 0.0;
+  if ((man_cx_str && kernel_dd_parse(man_cx_str, &cx_hi, &cx_lo)) || (man_cy_str && kernel_dd_parse(man_cy_str, &cy_hi, &cy_lo))) {
+    fprintf(stderr, "Can't parse center coordinates, exiting.\n");
+    exit(EXIT_FAILURE);
+  }
+  for (uint32_t img_y=0; img_y<img_h; img_y++) {
+    for (uint32_t img_x=0; img_x<img_w; img_x++) {
+      uint32_t i = img_y*img_w + img_x;
+      double dc_x = ((double)img_x/(double)img_w - 0.5) * 2.0*(double)img_w/(double)img_h*man_zoom;
+      double dc_y = ((double)img_y/(double)img_h - 0.5) * 2.0*man_zoom;
+      kernel_dd_add_dbl(cx_hi, cx_lo, dc_x, &man_x[i], &man_xl[i]);
+      kernel_dd_add_dbl(cy_hi, cy_lo, dc_y, &man_y[i], &man_yl[i]);
+    }
+  }
+  printf("Benchmark with %u points & %u max iterations, best of %u runs.\n", n, niter, nruns);
+
+  // double kernels
+  static const char* names[] = {"scalar", "sse2", "avx2", "avx512"};
+  double ref = 0.0;
+  for (uint32_t k=0; k<sizeof(names)/sizeof(names[0]); k++) {
+    const kernel_dbl_t* kernel = kernel_dbl_select(names[k]);
+    if (kernel == NULL) continue;
+    double best = 1e30;
+    uint64_t sum = 0;
+    for (uint32_t r=0; r<nruns; r++) {
+      double t0 = now();
+      kernel->fn(man_x, man_y, n, niter, -1.0, iterations);
+      double t = now() - t0;
+      best = t < best ? t : best;
+    }
+    for (uint32_t i=0; i<n; i++) sum += iterations[i];
+    report("double", kernel->name, kernel->lanes, best, sum, 0.0);
+    // the fastest double kernel is the reference
+    double mips = (double)sum/best*1e-6;
+    ref = mips > ref ? mips : ref;
+  }
+
+  // float kernels
+  for (uint32_t i=0; i<n; i++) {
+    man_xf[i] = (float)man_x[i];
+    man_yf[i] = (float)man_y[i];
+  }
+  for (uint32_t k=0; k<sizeof(names)/sizeof(names[0]); k++) {
+    const kernel_flt_t* kernel = kernel_flt_select(names[k]);
+    if (kernel == NULL) continue;
+    double best = 1e30;
+    uint64_t sum = 0;
+    for (uint32_t r=0; r<nruns; r++) {
+      double t0 = now();
+      kernel->fn(man_xf, man_yf, n, niter, -1.0, iterations);
+      double t = now() - t0;
+      best = t < best ? t : best;
+    }
+    for (uint32_t i=0; i<n; i++) sum += iterations[i];
+    report("float", kernel->name, kernel->lanes, best, sum, ref);
+  }
+
+  // double-double kernels
+  for (uint32_t k=0; k<sizeof(names)/sizeof(names[0]); k++) {
+    const kernel_dd_t* kernel = kernel_dd_select(names[k]);
+    if (kernel == NULL) continue;
+    double best = 1e30;
+    uint64_t sum = 0;
+    for (uint32_t r=0; r<nruns; r++) {
+      double t0 = now();
+      kernel->fn(man_x, man_xl, man_y, man_yl, n, niter, -1.0, iterations);
+      double t = now() - t0;
+      best = t < best ? t : best;
+    }
+    for (uint32_t i=0; i<n; i++) sum += iterations[i];
+    report("dd", kernel->name, kernel->lanes, best, sum, ref);
+  }
+
+  free(man_x);
+  free(man_y);
+  free(man_xl);
+  free(man_yl);
+  free(man_xf);
+  free(man_yf);
+  free(iterations);
+
+  // exit
+  exit(EXIT_SUCCESS);
+}
+
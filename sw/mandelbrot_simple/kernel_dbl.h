@@ -0,0 +1,54 @@
+// kernel_dbl.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// double precision escape time kernels (scalar & SIMD)
+
+
+#ifndef __KERNEL_DBL_H__
+#define __KERNEL_DBL_H__
+
+
+//// includes ////
+#include <stdint.h>
+
+
+//// types ////
+// kernel_dbl_fn
+// calculates number of iterations for n points (man_x[i], man_y[i]),
+// results are bit-identical across all kernel variants;
+// with period_eps >= 0, orbits that come back within period_eps of an earlier Zn
+// (Brent's cycle detection) are stopped & given niter-1 iterations, with
+// period_eps = 0 (exact match) the result is the same as without the detection;
+// returns the number of points stopped by the cycle detection
+typedef uint32_t (*kernel_dbl_fn)(const double* man_x, const double* man_y, uint32_t n, uint32_t niter, double period_eps, uint32_t* iterations);
+
+// kernel_dbl_t
+// describes one kernel variant
+typedef struct {
+  const char*   name;   // kernel name (scalar, sse2, avx2, avx512)
+  uint32_t      lanes;  // number of pixels processed per instruction
+  kernel_dbl_fn fn;     // kernel function
+} kernel_dbl_t;
+
+
+//// kernel_dbl_inside() ////
+// closed-form test for points inside the main cardioid or the period-2 bulb,
+// these never escape, so their iteration count is niter-1 without iterating
+static inline int kernel_dbl_inside(double man_x, double man_y)
+{
+  double y2 = man_y*man_y;
+  double xq = man_x - 0.25;
+  double q  = xq*xq + y2;
+  if (q*(q + xq) < 0.25*y2) return 1;
+  double xb = man_x + 1.0;
+  return xb*xb + y2 < 0.0625;
+}
+
+
+//// functions ////
+// returns kernel with requested name (or best supported by the cpu if name is NULL),
+// returns NULL if requested kernel is unknown or not supported by the cpu
+const kernel_dbl_t* kernel_dbl_select(const char* name);
+
+
+#endif // __KERNEL_DBL_H__
+
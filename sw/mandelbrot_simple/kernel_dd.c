@@ -0,0 +1,205 @@
+// kernel_dd.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// double-double (~106-bit mantissa) escape time kernels (scalar & SIMD)
+// built on error-free transforms, products are split exactly with fused multiply-add
+// NOTE: must be compiled with -ffp-contract=off, the two-sum sequences fall apart
+// if the compiler fuses or reorders them
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "mpfix.h"
+#include "kernel_dd.h"
+
+
+//// types ////
+// dd_t
+// unevaluated sum hi + lo, |lo| <= ulp(hi)/2
+typedef struct {
+  double hi;
+  double lo;
+} dd_t;
+
+
+//// dd_quick_two_sum() ////
+// a + b exactly, for |a| >= |b|
+static inline dd_t dd_quick_two_sum(double a, double b)
+{
+  double s = a + b;
+  return (dd_t){s, b - (s - a)};
+}
+
+
+//// dd_add() ////
+static inline dd_t dd_add(dd_t a, dd_t b)
+{
+  double s  = a.hi + b.hi;
+  double bb = s - a.hi;
+  double e  = (a.hi - (s - bb)) + (b.hi - bb);
+  double t  = a.lo + b.lo;
+  double tb = t - a.lo;
+  double f  = (a.lo - (t - tb)) + (b.lo - tb);
+  dd_t r = dd_quick_two_sum(s, e + t);
+  return dd_quick_two_sum(r.hi, r.lo + f);
+}
+
+
+//// dd_mul() ////
+static inline dd_t dd_mul(dd_t a, dd_t b)
+{
+  double p = a.hi * b.hi;
+  double e = fma(a.hi, b.hi, -p);
+  e = fma(a.hi, b.lo, e);
+  e = fma(a.lo, b.hi, e);
+  return dd_quick_two_sum(p, e);
+}
+
+
+//// dd_sqr() ////
+static inline dd_t dd_sqr(dd_t a)
+{
+  double p = a.hi * a.hi;
+  double e = fma(a.hi, a.hi, -p);
+  e = fma(2.0*a.hi, a.lo, e);
+  return dd_quick_two_sum(p, e);
+}
+
+
+//// dd_diff() ////
+// a - b rounded to double, for the cycle detection
+static inline double dd_diff(dd_t a, dd_t b)
+{
+  return (a.hi - b.hi) + (a.lo - b.lo);
+}
+
+
+//// kernel_dd_scalar() ////
+// reference kernel, one pixel at a time
+static uint32_t kernel_dd_scalar(const double* cx_hi, const double* cx_lo, const double* cy_hi, const double* cy_lo, uint32_t n, uint32_t niter, double period_eps, uint32_t* iterations)
+{
+  uint32_t nperiodic = 0;
+  for (uint32_t i=0; i<n; i++) {
+    dd_t cx = {cx_hi[i], cx_lo[i]};
+    dd_t cy = {cy_hi[i], cy_lo[i]};
+    // initialize Zn to 0 + i0
+    dd_t zn_x = {0.0, 0.0};
+    dd_t zn_y = {0.0, 0.0};
+    // initialize niterations to 0
+    uint32_t niterations = 0;
+    // initialize temporary variables
+    dd_t x2 = {0.0, 0.0};
+    dd_t y2 = {0.0, 0.0};
+    // Brent's cycle detection
+    dd_t saved_x = {0.0, 0.0};
+    dd_t saved_y = {0.0, 0.0};
+    uint32_t period_cnt = 0;
+    uint32_t period_len = 1;
+    while (x2.hi + y2.hi <= 4.0 && niterations < niter-1) {
+      dd_t t = dd_mul(zn_x, zn_y);
+      zn_y = dd_add((dd_t){2.0*t.hi, 2.0*t.lo}, cy);
+      zn_x = dd_add(dd_add(x2, (dd_t){-y2.hi, -y2.lo}), cx);
+      x2   = dd_sqr(zn_x);
+      y2   = dd_sqr(zn_y);
+      niterations++;
+      if (period_eps >= 0.0) {
+        if (fabs(dd_diff(zn_x, saved_x)) <= period_eps && fabs(dd_diff(zn_y, saved_y)) <= period_eps) {
+          niterations = niter-1;
+          nperiodic++;
+          break;
+        }
+        if (++period_cnt == period_len) {
+          saved_x = zn_x;
+          saved_y = zn_y;
+          period_cnt = 0;
+          period_len <<= 1;
+        }
+      }
+    }
+    // save number of iterations to iterations array
+    iterations[i] = niterations;
+  }
+  return nperiodic;
+}
+
+
+//// SIMD kernels ////
+#if defined(__x86_64__) || defined(__i386__)
+
+#define KERNEL_NAME     kernel_dd_avx2
+#define KERNEL_TARGET   "avx2,fma"
+#define KERNEL_LANES    4
+#define KERNEL_ANY(m)   _mm256_movemask_pd((__m256d)(m))
+#define KERNEL_DD
+#define KERNEL_FMA(a, b, c) _mm256_fmadd_pd((__m256d)(a), (__m256d)(b), (__m256d)(c))
+#define KERNEL_SCALAR   kernel_dd_scalar
+#include "kernel_tmpl.h"
+
+#define KERNEL_NAME     kernel_dd_avx512
+#define KERNEL_TARGET   "avx512f"
+#define KERNEL_LANES    8
+#define KERNEL_ANY(m)   _mm512_test_epi64_mask((__m512i)(m), (__m512i)(m))
+#define KERNEL_DD
+#define KERNEL_FMA(a, b, c) _mm512_fmadd_pd((__m512d)(a), (__m512d)(b), (__m512d)(c))
+#define KERNEL_SCALAR   kernel_dd_scalar
+#include "kernel_tmpl.h"
+
+#endif
+
+
+//// kernel list ////
+// ordered from the most to the least preferred
+static const kernel_dd_t kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+  {"avx512", 8, kernel_dd_avx512},
+  {"avx2",   4, kernel_dd_avx2  },
+#endif
+  {"scalar", 1, kernel_dd_scalar}
+};
+
+
+//// kernel_dd_supported() ////
+// checks cpuid for the instruction set the kernel needs
+static int kernel_dd_supported(const kernel_dd_t* k)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (!strcmp(k->name, "avx512")) return __builtin_cpu_supports("avx512f");
+  if (!strcmp(k->name, "avx2"))   return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+  return 1;
+}
+
+
+//// kernel_dd_select() ////
+const kernel_dd_t* kernel_dd_select(const char* name)
+{
+  for (uint32_t i=0; i<sizeof(kernels)/sizeof(kernels[0]); i++) {
+    if (name != NULL && strcmp(kernels[i].name, name)) continue;
+    if (kernel_dd_supported(&kernels[i])) return &kernels[i];
+    if (name != NULL) return NULL;
+  }
+  return NULL;
+}
+
+
+//// kernel_dd_parse() ////
+int kernel_dd_parse(const char* s, double* hi, double* lo)
+{
+  // parse with enough fraction bits for the low part, hi is the rounded value, lo the rest
+  mpfix_t x, h, r;
+  uint32_t n = mpfix_limbs(192);
+  if (mpfix_from_str(&x, n, s)) return -1;
+  *hi = mpfix_to_dbl(&x);
+  mpfix_from_dbl(&h, n, *hi);
+  mpfix_sub(&r, &x, &h);
+  *lo = mpfix_to_dbl(&r);
+  return 0;
+}
+
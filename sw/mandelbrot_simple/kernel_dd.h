@@ -0,0 +1,52 @@
+// kernel_dd.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// double-double (~106-bit mantissa) escape time kernels (scalar & SIMD)
+
+
+#ifndef __KERNEL_DD_H__
+#define __KERNEL_DD_H__
+
+
+//// includes ////
+#include <stdint.h>
+
+
+//// types ////
+// kernel_dd_fn
+// calculates number of iterations for n points (cx_hi[i]+cx_lo[i], cy_hi[i]+cy_lo[i]),
+// results are bit-identical across all kernel variants;
+// period_eps works like for kernel_dbl_fn, returns the number of periodic points
+typedef uint32_t (*kernel_dd_fn)(const double* cx_hi, const double* cx_lo, const double* cy_hi, const double* cy_lo, uint32_t n, uint32_t niter, double period_eps, uint32_t* iterations);
+
+// kernel_dd_t
+// describes one kernel variant
+typedef struct {
+  const char*  name;  // kernel name (scalar, avx2, avx512)
+  uint32_t     lanes; // number of pixels processed per instruction
+  kernel_dd_fn fn;    // kernel function
+} kernel_dd_t;
+
+
+//// kernel_dd_add_dbl() ////
+// (hi, lo) = (a_hi, a_lo) + b, offsets a double-double center by a (double) pixel offset
+static inline void kernel_dd_add_dbl(double a_hi, double a_lo, double b, double* hi, double* lo)
+{
+  double s  = a_hi + b;
+  double bb = s - a_hi;
+  double e  = (a_hi - (s - bb)) + (b - bb) + a_lo;
+  *hi = s + e;
+  *lo = e - (*hi - s);
+}
+
+
+//// functions ////
+// parses a decimal number string to a double-double, returns 0 on success
+int kernel_dd_parse(const char* s, double* hi, double* lo);
+
+// returns kernel with requested name (or best supported by the cpu if name is NULL),
+// returns NULL if requested kernel is unknown or not supported by the cpu
+const kernel_dd_t* kernel_dd_select(const char* name);
+
+
+#endif // __KERNEL_DD_H__
+
@@ -0,0 +1,137 @@
+// kernel_flt.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// single precision escape time kernels (scalar & SIMD), twice the lanes of double
+// NOTE: must be compiled with -ffp-contract=off, otherwise the compiler is free to
+// fuse multiply-adds in the FMA-capable variants, which breaks bit-exactness
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "kernel_flt.h"
+
+
+//// kernel_flt_scalar() ////
+// reference kernel, one pixel at a time
+static uint32_t kernel_flt_scalar(const float* man_x, const float* man_y, uint32_t n, uint32_t niter, double period_eps, uint32_t* iterations)
+{
+  // compared in single precision, like the SIMD kernels do
+  const float eps = (float)period_eps;
+  uint32_t nperiodic = 0;
+  for (uint32_t i=0; i<n; i++) {
+    // initialize Zn to 0 + i0
+    float zn_x = 0.0f;
+    float zn_y = 0.0f;
+    // initialize niterations to 0
+    uint32_t niterations = 0;
+    // initialize temporary variables
+    float x2 = 0.0f;
+    float y2 = 0.0f;
+    // Brent's cycle detection
+    float saved_x = 0.0f;
+    float saved_y = 0.0f;
+    uint32_t period_cnt = 0;
+    uint32_t period_len = 1;
+    while (x2 + y2 <= 4.0f && niterations < niter-1) {
+      zn_y = 2*zn_x*zn_y + man_y[i];
+      zn_x = x2 - y2 + man_x[i];
+      x2   = zn_x*zn_x;
+      y2   = zn_y*zn_y;
+      niterations++;
+      if (period_eps >= 0.0) {
+        if (fabsf(zn_x - saved_x) <= eps && fabsf(zn_y - saved_y) <= eps) {
+          niterations = niter-1;
+          nperiodic++;
+          break;
+        }
+        if (++period_cnt == period_len) {
+          saved_x = zn_x;
+          saved_y = zn_y;
+          period_cnt = 0;
+          period_len <<= 1;
+        }
+      }
+    }
+    // save number of iterations to iterations array
+    iterations[i] = niterations;
+  }
+  return nperiodic;
+}
+
+
+//// SIMD kernels ////
+#if defined(__x86_64__) || defined(__i386__)
+
+#define KERNEL_NAME     kernel_flt_sse2
+#define KERNEL_TARGET   "sse2"
+#define KERNEL_LANES    4
+#define KERNEL_ANY(m)   _mm_movemask_ps((__m128)(m))
+#define KERNEL_REAL     float
+#define KERNEL_INT      int32_t
+#define KERNEL_SCALAR   kernel_flt_scalar
+#include "kernel_tmpl.h"
+
+#define KERNEL_NAME     kernel_flt_avx2
+#define KERNEL_TARGET   "avx2"
+#define KERNEL_LANES    8
+#define KERNEL_ANY(m)   _mm256_movemask_ps((__m256)(m))
+#define KERNEL_REAL     float
+#define KERNEL_INT      int32_t
+#define KERNEL_SCALAR   kernel_flt_scalar
+#include "kernel_tmpl.h"
+
+#define KERNEL_NAME     kernel_flt_avx512
+#define KERNEL_TARGET   "avx512f"
+#define KERNEL_LANES    16
+#define KERNEL_ANY(m)   _mm512_test_epi32_mask((__m512i)(m), (__m512i)(m))
+#define KERNEL_REAL     float
+#define KERNEL_INT      int32_t
+#define KERNEL_SCALAR   kernel_flt_scalar
+#include "kernel_tmpl.h"
+
+#endif
+
+
+//// kernel list ////
+// ordered from the most to the least preferred
+static const kernel_flt_t kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+  {"avx512", 16, kernel_flt_avx512},
+  {"avx2",   8,  kernel_flt_avx2  },
+  {"sse2",   4,  kernel_flt_sse2  },
+#endif
+  {"scalar", 1,  kernel_flt_scalar}
+};
+
+
+//// kernel_flt_supported() ////
+// checks cpuid for the instruction set the kernel needs
+static int kernel_flt_supported(const kernel_flt_t* k)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (!strcmp(k->name, "avx512")) return __builtin_cpu_supports("avx512f");
+  if (!strcmp(k->name, "avx2"))   return __builtin_cpu_supports("avx2");
+  if (!strcmp(k->name, "sse2"))   return __builtin_cpu_supports("sse2");
+#endif
+  return 1;
+}
+
+
+//// kernel_flt_select() ////
+const kernel_flt_t* kernel_flt_select(const char* name)
+{
+  for (uint32_t i=0; i<sizeof(kernels)/sizeof(kernels[0]); i++) {
+    if (name != NULL && strcmp(kernels[i].name, name)) continue;
+    if (kernel_flt_supported(&kernels[i])) return &kernels[i];
+    if (name != NULL) return NULL;
+  }
+  return NULL;
+}
+
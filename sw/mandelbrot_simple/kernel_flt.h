@@ -0,0 +1,40 @@
+// kernel_flt.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// single precision escape time kernels (scalar & SIMD), twice the lanes of double
+
+
+#ifndef __KERNEL_FLT_H__
+#define __KERNEL_FLT_H__
+
+
+//// includes ////
+#include <stdint.h>
+
+
+//// types ////
+// kernel_flt_fn
+// calculates number of iterations for n points (man_x[i], man_y[i]),
+// results are bit-identical across all kernel variants;
+// with period_eps >= 0, orbits that come back within period_eps of an earlier Zn
+// (Brent's cycle detection) are stopped & given niter-1 iterations, with
+// period_eps = 0 (exact match) the result is the same as without the detection;
+// returns the number of points stopped by the cycle detection
+typedef uint32_t (*kernel_flt_fn)(const float* man_x, const float* man_y, uint32_t n, uint32_t niter, double period_eps, uint32_t* iterations);
+
+// kernel_flt_t
+// describes one kernel variant
+typedef struct {
+  const char*   name;   // kernel name (scalar, sse2, avx2, avx512)
+  uint32_t      lanes;  // number of pixels processed per instruction
+  kernel_flt_fn fn;     // kernel function
+} kernel_flt_t;
+
+
+//// functions ////
+// returns kernel with requested name (or best supported by the cpu if name is NULL),
+// returns NULL if requested kernel is unknown or not supported by the cpu
+const kernel_flt_t* kernel_flt_select(const char* name);
+
+
+#endif // __KERNEL_FLT_H__
+
@@ -0,0 +1,230 @@
+// kernel_fp.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// fixed-point escape time kernels (scalar & SIMD), bit-exact with FPMUL / mandelbrot_calc.v
+// NOTE: like FPMUL, the kernels keep full 64-bit intermediates; the FPGA truncates them
+// to 54 bits, which only makes a difference for coordinates outside of the FP range
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "kernel_fp.h"
+
+
+//// kernel_fp_scalar() ////
+// reference kernel, one pixel at a time
+static uint32_t kernel_fp_scalar(const FP* man_x, const FP* man_y, uint32_t n, uint32_t niter, uint32_t period, uint32_t* iterations)
+{
+  uint32_t nperiodic = 0;
+  for (uint32_t i=0; i<n; i++) {
+    // initialize Zn to 0 + i0
+    FP zn_x_fp = 0L;
+    FP zn_y_fp = 0L;
+    // initialize niterations to 0
+    uint32_t niterations = 0;
+    // initialize temporary variables
+    FP x2_fp = 0L;
+    FP y2_fp = 0L;
+    // Brent's cycle detection
+    FP saved_x_fp = 0L;
+    FP saved_y_fp = 0L;
+    uint32_t period_cnt = 0;
+    uint32_t period_len = 1;
+    while (x2_fp + y2_fp <= DBL2FP(4.0) && niterations < niter-1) {
+      zn_y_fp = FPMUL(zn_x_fp, zn_y_fp);
+      zn_y_fp <<= 1;
+      zn_y_fp += man_y[i];
+      zn_x_fp = x2_fp - y2_fp + man_x[i];
+      x2_fp = FPMUL(zn_x_fp, zn_x_fp);
+      y2_fp = FPMUL(zn_y_fp, zn_y_fp);
+      niterations++;
+      if (period) {
+        if (zn_x_fp == saved_x_fp && zn_y_fp == saved_y_fp) {
+          niterations = niter-1;
+          nperiodic++;
+          break;
+        }
+        if (++period_cnt == period_len) {
+          saved_x_fp = zn_x_fp;
+          saved_y_fp = zn_y_fp;
+          period_cnt = 0;
+          period_len <<= 1;
+        }
+      }
+    }
+    // save number of iterations to iterations array
+    iterations[i] = niterations;
+  }
+  return nperiodic;
+}
+
+
+//// SIMD kernels ////
+#if defined(__x86_64__) || defined(__i386__)
+
+#define KERNEL_NAME       kernel_fp_avx2
+#define KERNEL_TARGET     "avx2"
+#define KERNEL_LANES      4
+#define KERNEL_ANY(m)     _mm256_movemask_pd((__m256d)(m))
+#define KERNEL_MUL32(a,b) ((kernel_fp_avx2_vi)_mm256_mul_epi32((__m256i)(a), (__m256i)(b)))
+#include "kernel_fp_tmpl.h"
+
+#define KERNEL_NAME       kernel_fp_avx512
+#define KERNEL_TARGET     "avx512f"
+#define KERNEL_LANES      8
+#define KERNEL_ANY(m)     _mm512_test_epi64_mask((__m512i)(m), (__m512i)(m))
+#define KERNEL_MUL32(a,b) ((kernel_fp_avx512_vi)_mm512_mul_epi32((__m512i)(a), (__m512i)(b)))
+#include "kernel_fp_tmpl.h"
+
+
+//// fpmul_ifma() ////
+// FPMUL on the 52-bit IFMA multiplier: multiplies magnitudes (must be < 2^52),
+// then rounds towards minus infinity for negative products, like the arithmetic
+// shift in FPMUL does
+__attribute__ ((target ("avx512f,avx512ifma"), always_inline))
+static inline __m512i fpmul_ifma(__m512i a, __m512i b)
+{
+  const __m512i zero = _mm512_setzero_si512();
+  __m512i ma = _mm512_abs_epi64(a);
+  __m512i mb = _mm512_abs_epi64(b);
+  __m512i lo = _mm512_madd52lo_epu64(zero, ma, mb);
+  __m512i hi = _mm512_madd52hi_epu64(zero, ma, mb);
+  __m512i q  = _mm512_or_si512(_mm512_slli_epi64(hi, 52-FP_F), _mm512_srli_epi64(lo, FP_F));
+  __mmask8 neg = _mm512_cmplt_epi64_mask(_mm512_xor_si512(a, b), zero);
+  __mmask8 rem = _mm512_test_epi64_mask(lo, _mm512_set1_epi64((1L<<FP_F)-1));
+  __m512i qc = _mm512_mask_add_epi64(q, rem, q, _mm512_set1_epi64(1));
+  return _mm512_mask_sub_epi64(q, neg, zero, qc);
+}
+
+//// fpsqr_ifma() ////
+// square on the IFMA multiplier, the product is never negative
+__attribute__ ((target ("avx512f,avx512ifma"), always_inline))
+static inline __m512i fpsqr_ifma(__m512i a)
+{
+  const __m512i zero = _mm512_setzero_si512();
+  __m512i ma = _mm512_abs_epi64(a);
+  __m512i lo = _mm512_madd52lo_epu64(zero, ma, ma);
+  __m512i hi = _mm512_madd52hi_epu64(zero, ma, ma);
+  return _mm512_or_si512(_mm512_slli_epi64(hi, 52-FP_F), _mm512_srli_epi64(lo, FP_F));
+}
+
+
+//// kernel_fp_avx512ifma_block() ////
+// while |c| < 4, Zn of non-escaped pixels stays below 8 in magnitude (< 2^52 in FP),
+// which fits the IFMA multiplier
+__attribute__ ((target ("avx512f,avx512ifma"), always_inline))
+static inline uint32_t kernel_fp_avx512ifma_block(__m512i cx, __m512i cy, uint32_t niter, const int period, uint32_t* iterations)
+{
+  const __m512i limit = _mm512_set1_epi64(DBL2FP(4.0));
+  const __m512i nmax = _mm512_set1_epi64((int64_t)niter-1);
+  // initialize Zn to 0 + i0
+  __m512i zn_x = _mm512_setzero_si512();
+  __m512i zn_y = _mm512_setzero_si512();
+  __m512i x2   = _mm512_setzero_si512();
+  __m512i y2   = _mm512_setzero_si512();
+  __m512i saved_x = _mm512_setzero_si512();
+  __m512i saved_y = _mm512_setzero_si512();
+  // per-lane iteration counters & active mask
+  __m512i niterations = _mm512_setzero_si512();
+  __mmask8 active = _mm512_cmplt_epi64_mask(niterations, nmax);
+  __mmask8 periodic = 0;
+  // Brent's cycle detection window, common to all lanes as they iterate in lockstep
+  uint32_t period_cnt = 0;
+  uint32_t period_len = 1;
+  while (active) {
+    __m512i zy = fpmul_ifma(zn_x, zn_y);
+    zy = _mm512_add_epi64(_mm512_add_epi64(zy, zy), cy);
+    __m512i zx = _mm512_add_epi64(_mm512_sub_epi64(x2, y2), cx);
+    zn_x = _mm512_mask_mov_epi64(zn_x, active, zx);
+    zn_y = _mm512_mask_mov_epi64(zn_y, active, zy);
+    x2   = fpsqr_ifma(zn_x);
+    y2   = fpsqr_ifma(zn_y);
+    niterations = _mm512_mask_add_epi64(niterations, active, niterations, _mm512_set1_epi64(1));
+    if (period) {
+      __mmask8 p = active & _mm512_cmpeq_epi64_mask(zn_x, saved_x) & _mm512_cmpeq_epi64_mask(zn_y, saved_y);
+      niterations = _mm512_mask_mov_epi64(niterations, p, nmax);
+      periodic |= p;
+      active &= ~p;
+      if (++period_cnt == period_len) {
+        saved_x = zn_x;
+        saved_y = zn_y;
+        period_cnt = 0;
+        period_len <<= 1;
+      }
+    }
+    active &= _mm512_cmple_epi64_mask(_mm512_add_epi64(x2, y2), limit) & _mm512_cmplt_epi64_mask(niterations, nmax);
+  }
+  _mm256_storeu_si256((__m256i*)iterations, _mm512_cvtepi64_epi32(niterations));
+  return __builtin_popcount(periodic);
+}
+
+
+//// kernel_fp_avx512ifma() ////
+// blocks with points further out than |c| < 4 use the limb kernel
+__attribute__ ((target ("avx512f,avx512ifma")))
+static uint32_t kernel_fp_avx512ifma(const FP* man_x, const FP* man_y, uint32_t n, uint32_t niter, uint32_t period, uint32_t* iterations)
+{
+  const __m512i crange = _mm512_set1_epi64(DBL2FP(4.0));
+  uint32_t nperiodic = 0;
+  uint32_t i = 0;
+  for (; i+8<=n; i+=8) {
+    __m512i cx = _mm512_loadu_si512(man_x+i);
+    __m512i cy = _mm512_loadu_si512(man_y+i);
+    if (_mm512_cmpge_epi64_mask(_mm512_abs_epi64(cx), crange) | _mm512_cmpge_epi64_mask(_mm512_abs_epi64(cy), crange)) {
+      nperiodic += kernel_fp_avx512(man_x+i, man_y+i, 8, niter, period, iterations+i);
+    } else if (period) {
+      nperiodic += kernel_fp_avx512ifma_block(cx, cy, niter, 1, iterations+i);
+    } else {
+      kernel_fp_avx512ifma_block(cx, cy, niter, 0, iterations+i);
+    }
+  }
+  // leftover pixels
+  if (i < n) nperiodic += kernel_fp_scalar(man_x+i, man_y+i, n-i, niter, period, iterations+i);
+  return nperiodic;
+}
+
+#endif
+
+
+//// kernel list ////
+// ordered from the most to the least preferred
+static const kernel_fp_t kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+  {"avx512ifma", 8, kernel_fp_avx512ifma},
+  {"avx512",     8, kernel_fp_avx512    },
+  {"avx2",       4, kernel_fp_avx2      },
+#endif
+  {"scalar",     1, kernel_fp_scalar    }
+};
+
+
+//// kernel_fp_supported() ////
+// checks cpuid for the instruction set the kernel needs
+static int kernel_fp_supported(const kernel_fp_t* k)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (!strcmp(k->name, "avx512ifma")) return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512ifma");
+  if (!strcmp(k->name, "avx512"))     return __builtin_cpu_supports("avx512f");
+  if (!strcmp(k->name, "avx2"))       return __builtin_cpu_supports("avx2");
+#endif
+  return 1;
+}
+
+
+//// kernel_fp_select() ////
+const kernel_fp_t* kernel_fp_select(const char* name)
+{
+  for (uint32_t i=0; i<sizeof(kernels)/sizeof(kernels[0]); i++) {
+    if (name != NULL && strcmp(kernels[i].name, name)) continue;
+    if (kernel_fp_supported(&kernels[i])) return &kernels[i];
+    if (name != NULL) return NULL;
+  }
+  return NULL;
+}
+
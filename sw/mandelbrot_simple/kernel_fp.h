@@ -0,0 +1,55 @@
+// kernel_fp.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// fixed-point escape time kernels (scalar & SIMD), bit-exact with FPMUL / mandelbrot_calc.v
+
+
+#ifndef __KERNEL_FP_H__
+#define __KERNEL_FP_H__
+
+
+//// includes ////
+#include <stdint.h>
+#include "fp.h"
+
+
+//// types ////
+// kernel_fp_fn
+// calculates number of iterations for n points (man_x[i], man_y[i]),
+// results are bit-identical across all kernel variants;
+// with period set, orbits that come back to exactly the same FP value of an earlier
+// Zn (Brent's cycle detection) are stopped & given niter-1 iterations, which is
+// exactly what they would end with anyway;
+// returns the number of points stopped by the cycle detection
+typedef uint32_t (*kernel_fp_fn)(const FP* man_x, const FP* man_y, uint32_t n, uint32_t niter, uint32_t period, uint32_t* iterations);
+
+// kernel_fp_t
+// describes one kernel variant
+typedef struct {
+  const char*  name;  // kernel name (scalar, avx2, avx512, avx512ifma)
+  uint32_t     lanes; // number of pixels processed per instruction
+  kernel_fp_fn fn;    // kernel function
+} kernel_fp_t;
+
+
+//// kernel_fp_inside() ////
+// closed-form test for points inside the main cardioid or the period-2 bulb in FP,
+// these never escape, so their iteration count is niter-1 without iterating
+static inline int kernel_fp_inside(FP man_x, FP man_y)
+{
+  FP y2 = FPMUL(man_y, man_y);
+  FP xq = man_x - DBL2FP(0.25);
+  FP q  = FPMUL(xq, xq) + y2;
+  if (FPMUL(q, q + xq) < (y2 >> 2)) return 1;
+  FP xb = man_x + DBL2FP(1.0);
+  return FPMUL(xb, xb) + y2 < DBL2FP(0.0625);
+}
+
+
+//// functions ////
+// returns kernel with requested name (or best supported by the cpu if name is NULL),
+// returns NULL if requested kernel is unknown or not supported by the cpu
+const kernel_fp_t* kernel_fp_select(const char* name);
+
+
+#endif // __KERNEL_FP_H__
+
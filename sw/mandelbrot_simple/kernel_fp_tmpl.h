@@ -0,0 +1,124 @@
+// kernel_fp_tmpl.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// SIMD fixed-point escape time kernel template
+// include with KERNEL_NAME, KERNEL_TARGET, KERNEL_LANES, KERNEL_ANY(mask) & KERNEL_MUL32(a, b) defined,
+// KERNEL_MUL32 must be a signed 32x32->64 bit multiply of the low halves of each lane
+
+
+//// template helpers ////
+#define KT_CAT2(a, b)   a ## _ ## b
+#define KT_CAT(a, b)    KT_CAT2(a, b)
+#define KT(x)           KT_CAT(KERNEL_NAME, x)
+
+
+//// types ////
+// vector of FP values / masks / counters
+typedef int64_t KT(vi) __attribute__ ((vector_size (KERNEL_LANES*sizeof(int64_t))));
+
+
+//// KT(fpmul)() ////
+// FPMUL on 27-bit limbs, the same split the FPGA DSP blocks use:
+//   a*b = H*2^54 + M*2^27 + L,  H = ah*bh,  M = ah*bl + al*bh,  L = al*bl
+// M is split again at bit 22, so that (a*b)>>FP_F can be assembled without a
+// 128-bit intermediate:
+//   (a*b)>>49 = H*2^5 + (M>>22) + (((M & (2^22-1))<<27) + L)>>49
+// all partial products fit into 64 bits for |a|,|b| < 2^58
+__attribute__ ((target (KERNEL_TARGET), always_inline))
+static inline KT(vi) KT(fpmul)(KT(vi) a, KT(vi) b)
+{
+  KT(vi) al = a & ((1L<<27)-1);
+  KT(vi) ah = a >> 27;
+  KT(vi) bl = b & ((1L<<27)-1);
+  KT(vi) bh = b >> 27;
+  KT(vi) h  = KERNEL_MUL32(ah, bh);
+  KT(vi) m  = KERNEL_MUL32(ah, bl) + KERNEL_MUL32(al, bh);
+  KT(vi) l  = KERNEL_MUL32(al, bl);
+  return (h << (2*27-FP_F)) + (m >> (FP_F-27)) + ((((m & ((1L<<(FP_F-27))-1)) << 27) + l) >> FP_F);
+}
+
+
+//// KT(block)() ////
+// iterates KERNEL_LANES pixels; escaped lanes are frozen with the active mask, so
+// their values stay within the range the limb multiply handles; with period set,
+// lanes whose Zn comes back to the exact value saved by Brent's algorithm are
+// stopped as well
+__attribute__ ((target (KERNEL_TARGET), always_inline))
+static inline uint32_t KT(block)(const FP* man_x, const FP* man_y, uint32_t niter, const int period, uint32_t* iterations)
+{
+  KT(vi) cx, cy;
+  memcpy(&cx, man_x, sizeof(cx));
+  memcpy(&cy, man_y, sizeof(cy));
+  // initialize Zn to 0 + i0
+  KT(vi) zn_x = {0};
+  KT(vi) zn_y = {0};
+  KT(vi) x2   = {0};
+  KT(vi) y2   = {0};
+  KT(vi) saved_x = {0};
+  KT(vi) saved_y = {0};
+  // per-lane iteration counters & active mask
+  KT(vi) niterations = {0};
+  KT(vi) periodic = {0};
+  KT(vi) active = (x2 + y2 <= DBL2FP(4.0)) & (niterations < (int64_t)niter-1);
+  // Brent's cycle detection window, common to all lanes as they iterate in lockstep
+  uint32_t period_cnt = 0;
+  uint32_t period_len = 1;
+  while (KERNEL_ANY(active)) {
+    KT(vi) zy = KT(fpmul)(zn_x, zn_y);
+    zy = zy + zy + cy;
+    KT(vi) zx = x2 - y2 + cx;
+    zn_x = (zx & active) | (zn_x & ~active);
+    zn_y = (zy & active) | (zn_y & ~active);
+    x2   = KT(fpmul)(zn_x, zn_x);
+    y2   = KT(fpmul)(zn_y, zn_y);
+    niterations -= active;
+    if (period) {
+      KT(vi) p = active & (zn_x == saved_x) & (zn_y == saved_y);
+      niterations = (niterations & ~p) | (((int64_t)niter-1) & p);
+      periodic |= p;
+      active &= ~p;
+      if (++period_cnt == period_len) {
+        saved_x = zn_x;
+        saved_y = zn_y;
+        period_cnt = 0;
+        period_len <<= 1;
+      }
+    }
+    active &= (x2 + y2 <= DBL2FP(4.0)) & (niterations < (int64_t)niter-1);
+  }
+  uint32_t nperiodic = 0;
+  for (uint32_t l=0; l<KERNEL_LANES; l++) {
+    iterations[l] = niterations[l];
+    nperiodic += periodic[l] & 1;
+  }
+  return nperiodic;
+}
+
+
+//// KERNEL_NAME() ////
+__attribute__ ((target (KERNEL_TARGET)))
+static uint32_t KERNEL_NAME(const FP* man_x, const FP* man_y, uint32_t n, uint32_t niter, uint32_t period, uint32_t* iterations)
+{
+  uint32_t nperiodic = 0;
+  uint32_t i = 0;
+  for (; i+KERNEL_LANES<=n; i+=KERNEL_LANES) {
+    if (period) {
+      nperiodic += KT(block)(man_x+i, man_y+i, niter, 1, iterations+i);
+    } else {
+      KT(block)(man_x+i, man_y+i, niter, 0, iterations+i);
+    }
+  }
+  // leftover pixels
+  if (i < n) nperiodic += kernel_fp_scalar(man_x+i, man_y+i, n-i, niter, period, iterations+i);
+  return nperiodic;
+}
+
+
+#undef KT
+#undef KT_CAT
+#undef KT_CAT2
+#undef KERNEL_NAME
+#undef KERNEL_TARGET
+#undef KERNEL_LANES
+#undef KERNEL_ANY
+#undef KERNEL_MUL32
+
@@ -0,0 +1,278 @@
+// kernel_tmpl.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// SIMD escape time kernel template, specialised at compile time on a numeric policy
+// include with KERNEL_NAME, KERNEL_TARGET, KERNEL_LANES, KERNEL_ANY(mask) & KERNEL_SCALAR
+// (reference kernel for the leftover pixels) defined, plus one of the policies:
+//   KERNEL_REAL & KERNEL_INT      - native float / double (with the same sized integer)
+//   KERNEL_DD & KERNEL_FMA(a,b,c) - double-double (hi + lo), products split with fma
+// every policy iterates in the same operation order as its scalar reference kernel,
+// so the results are bit-identical to it
+
+
+//// template helpers ////
+#define KT_CAT2(a, b)   a ## _ ## b
+#define KT_CAT(a, b)    KT_CAT2(a, b)
+#define KT(x)           KT_CAT(KERNEL_NAME, x)
+
+
+//// numeric policy ////
+#ifdef KERNEL_DD
+
+#define KT_REAL         double
+#define KT_INT          int64_t
+// number of independent vectors iterated together (double-double has enough ILP by itself)
+#define KT_NVEC         1
+
+typedef KT_REAL KT(vd) __attribute__ ((vector_size (KERNEL_LANES*sizeof(KT_REAL))));
+typedef KT_INT  KT(vi) __attribute__ ((vector_size (KERNEL_LANES*sizeof(KT_INT))));
+typedef struct {
+  KT(vd) hi;
+  KT(vd) lo;
+} KT(v);
+
+__attribute__ ((target (KERNEL_TARGET), always_inline))
+static inline KT(v) KT(load)(const KT_REAL* hi, const KT_REAL* lo)
+{
+  KT(v) r;
+  memcpy(&r.hi, hi, sizeof(r.hi));
+  memcpy(&r.lo, lo, sizeof(r.lo));
+  return r;
+}
+
+__attribute__ ((target (KERNEL_TARGET), always_inline))
+static inline KT(v) KT(quick_two_sum)(KT(vd) a, KT(vd) b)
+{
+  KT(vd) s = a + b;
+  return (KT(v)){s, b - (s - a)};
+}
+
+__attribute__ ((target (KERNEL_TARGET), always_inline))
+static inline KT(v) KT(add)(KT(v) a, KT(v) b)
+{
+  KT(vd) s  = a.hi + b.hi;
+  KT(vd) bb = s - a.hi;
+  KT(vd) e  = (a.hi - (s - bb)) + (b.hi - bb);
+  KT(vd) t  = a.lo + b.lo;
+  KT(vd) tb = t - a.lo;
+  KT(vd) f  = (a.lo - (t - tb)) + (b.lo - tb);
+  KT(v) r = KT(quick_two_sum)(s, e + t);
+  return KT(quick_two_sum)(r.hi, r.lo + f);
+}
+
+__attribute__ ((target (KERNEL_TARGET), always_inline))
+static inline KT(v) KT(sub)(KT(v) a, KT(v) b)
+{
+  return KT(add)(a, (KT(v)){-b.hi, -b.lo});
+}
+
+__attribute__ ((target (KERNEL_TARGET), always_inline))
+static inline KT(v) KT(mul)(KT(v) a, KT(v) b)
+{
+  KT(vd) p = a.hi * b.hi;
+  KT(vd) e = (KT(vd))KERNEL_FMA(a.hi, b.hi, -p);
+  e = (KT(vd))KERNEL_FMA(a.hi, b.lo, e);
+  e = (KT(vd))KERNEL_FMA(a.lo, b.hi, e);
+  return KT(quick_two_sum)(p, e);
+}
+
+// 2*a*b
+__attribute__ ((target (KERNEL_TARGET), always_inline))
+static inline KT(v) KT(mul2)(KT(v) a, KT(v) b)
+{
+  KT(v) t = KT(mul)(a, b);
+  return (KT(v)){2.0*t.hi, 2.0*t.lo};
+}
+
+__attribute__ ((target (KERNEL_TARGET), always_inline))
+static inline KT(v) KT(sqr)(KT(v) a)
+{
+  KT(vd) p = a.hi * a.hi;
+  KT(vd) e = (KT(vd))KERNEL_FMA(a.hi, a.hi, -p);
+  e = (KT(vd))KERNEL_FMA(2.0*a.hi, a.lo, e);
+  return KT(quick_two_sum)(p, e);
+}
+
+// leading part, for the escape test
+__attribute__ ((target (KERNEL_TARGET), always_inline))
+static inline KT(vd) KT(hi)(KT(v) a)
+{
+  return a.hi;
+}
+
+// a - b rounded to the leading part, for the cycle detection
+__attribute__ ((target (KERNEL_TARGET), always_inline))
+static inline KT(vd) KT(diff)(KT(v) a, KT(v) b)
+{
+  return (a.hi - b.hi) + (a.lo - b.lo);
+}
+
+#else
+
+#define KT_REAL         KERNEL_REAL
+#define KT_INT          KERNEL_INT
+// number of independent vectors iterated together (to hide the multiply latency)
+#define KT_NVEC         2
+
+typedef KT_REAL KT(vd) __attribute__ ((vector_size (KERNEL_LANES*sizeof(KT_REAL))));
+typedef KT_INT  KT(vi) __attribute__ ((vector_size (KERNEL_LANES*sizeof(KT_INT))));
+typedef KT(vd) KT(v);
+
+__attribute__ ((target (KERNEL_TARGET), always_inline))
+static inline KT(v) KT(load)(const KT_REAL* hi, const KT_REAL* lo)
+{
+  KT(v) r;
+  memcpy(&r, hi, sizeof(r));
+  (void)lo;
+  return r;
+}
+
+#define KT_OP(name, expr) \
+  __attribute__ ((target (KERNEL_TARGET), always_inline)) \
+  static inline KT(v) KT(name)(KT(v) a, KT(v) b) { return expr; }
+KT_OP(add,  a + b)
+KT_OP(sub,  a - b)
+KT_OP(mul,  a * b)
+KT_OP(mul2, 2*a*b)
+#undef KT_OP
+
+__attribute__ ((target (KERNEL_TARGET), always_inline))
+static inline KT(v) KT(sqr)(KT(v) a)
+{
+  return a*a;
+}
+
+__attribute__ ((target (KERNEL_TARGET), always_inline))
+static inline KT(vd) KT(hi)(KT(v) a)
+{
+  return a;
+}
+
+__attribute__ ((target (KERNEL_TARGET), always_inline))
+static inline KT(vd) KT(diff)(KT(v) a, KT(v) b)
+{
+  return a - b;
+}
+
+#endif
+
+
+//// KT(block)() ////
+// iterates KT_NVEC*KERNEL_LANES pixels; escaped lanes keep computing, but their
+// active mask is cleared for good, so their iteration count is frozen exactly like
+// the scalar while loop would leave it; with period set, lanes whose Zn comes back
+// within period_eps of the value saved by Brent's algorithm are stopped as well
+__attribute__ ((target (KERNEL_TARGET), always_inline))
+static inline uint32_t KT(block)(const KT_REAL* man_x, const KT_REAL* man_x_lo, const KT_REAL* man_y, const KT_REAL* man_y_lo, uint32_t niter, const int period, double period_eps, uint32_t* iterations)
+{
+  const KT_REAL eps = (KT_REAL)period_eps;
+  KT(v) cx[KT_NVEC], cy[KT_NVEC];
+  KT(v) zn_x[KT_NVEC], zn_y[KT_NVEC], x2[KT_NVEC], y2[KT_NVEC];
+  KT(v) saved_x[KT_NVEC], saved_y[KT_NVEC];
+  KT(vi) niterations[KT_NVEC], active[KT_NVEC], periodic[KT_NVEC];
+  KT(vi) any = {0};
+  for (uint32_t v=0; v<KT_NVEC; v++) {
+    cx[v] = KT(load)(man_x+v*KERNEL_LANES, man_x_lo+v*KERNEL_LANES);
+    cy[v] = KT(load)(man_y+v*KERNEL_LANES, man_y_lo+v*KERNEL_LANES);
+    // initialize Zn to 0 + i0
+    memset(&zn_x[v], 0, sizeof(zn_x[v]));
+    memset(&zn_y[v], 0, sizeof(zn_y[v]));
+    memset(&x2[v], 0, sizeof(x2[v]));
+    memset(&y2[v], 0, sizeof(y2[v]));
+    memset(&saved_x[v], 0, sizeof(saved_x[v]));
+    memset(&saved_y[v], 0, sizeof(saved_y[v]));
+    // per-lane iteration counters & active masks
+    niterations[v] = (KT(vi)){0};
+    periodic[v]    = (KT(vi)){0};
+    active[v] = (KT(hi)(x2[v]) + KT(hi)(y2[v]) <= 4.0) & (niterations[v] < (KT_INT)niter-1);
+    any |= active[v];
+  }
+  // Brent's cycle detection window, common to all lanes as they iterate in lockstep
+  uint32_t period_cnt = 0;
+  uint32_t period_len = 1;
+  while (KERNEL_ANY(any)) {
+    any = (KT(vi)){0};
+    for (uint32_t v=0; v<KT_NVEC; v++) {
+      zn_y[v] = KT(add)(KT(mul2)(zn_x[v], zn_y[v]), cy[v]);
+      zn_x[v] = KT(add)(KT(sub)(x2[v], y2[v]), cx[v]);
+      x2[v]   = KT(sqr)(zn_x[v]);
+      y2[v]   = KT(sqr)(zn_y[v]);
+      niterations[v] -= active[v];
+      if (period) {
+        KT(vd) dx = KT(diff)(zn_x[v], saved_x[v]);
+        KT(vd) dy = KT(diff)(zn_y[v], saved_y[v]);
+        KT(vi) p  = active[v] & (dx <= eps) & (dx >= -eps) & (dy <= eps) & (dy >= -eps);
+        niterations[v] = (niterations[v] & ~p) | (((KT_INT)niter-1) & p);
+        periodic[v] |= p;
+        active[v] &= ~p;
+      }
+      active[v] &= (KT(hi)(x2[v]) + KT(hi)(y2[v]) <= 4.0) & (niterations[v] < (KT_INT)niter-1);
+      any |= active[v];
+    }
+    if (period && ++period_cnt == period_len) {
+      for (uint32_t v=0; v<KT_NVEC; v++) {
+        saved_x[v] = zn_x[v];
+        saved_y[v] = zn_y[v];
+      }
+      period_cnt = 0;
+      period_len <<= 1;
+    }
+  }
+  uint32_t nperiodic = 0;
+  for (uint32_t v=0; v<KT_NVEC; v++) {
+    for (uint32_t l=0; l<KERNEL_LANES; l++) {
+      iterations[v*KERNEL_LANES+l] = niterations[v][l];
+      nperiodic += periodic[v][l] & 1;
+    }
+  }
+  return nperiodic;
+}
+
+
+//// KERNEL_NAME() ////
+#ifdef KERNEL_DD
+__attribute__ ((target (KERNEL_TARGET)))
+static uint32_t KERNEL_NAME(const KT_REAL* man_x, const KT_REAL* man_x_lo, const KT_REAL* man_y, const KT_REAL* man_y_lo, uint32_t n, uint32_t niter, double period_eps, uint32_t* iterations)
+{
+#else
+__attribute__ ((target (KERNEL_TARGET)))
+static uint32_t KERNEL_NAME(const KT_REAL* man_x, const KT_REAL* man_y, uint32_t n, uint32_t niter, double period_eps, uint32_t* iterations)
+{
+  // native policy has no low parts
+  const KT_REAL* man_x_lo = man_x;
+  const KT_REAL* man_y_lo = man_y;
+#endif
+  uint32_t nperiodic = 0;
+  uint32_t i = 0;
+  for (; i+KT_NVEC*KERNEL_LANES<=n; i+=KT_NVEC*KERNEL_LANES) {
+    if (period_eps < 0.0) {
+      KT(block)(man_x+i, man_x_lo+i, man_y+i, man_y_lo+i, niter, 0, 0.0, iterations+i);
+    } else {
+      nperiodic += KT(block)(man_x+i, man_x_lo+i, man_y+i, man_y_lo+i, niter, 1, period_eps, iterations+i);
+    }
+  }
+  // leftover pixels
+#ifdef KERNEL_DD
+  if (i < n) nperiodic += KERNEL_SCALAR(man_x+i, man_x_lo+i, man_y+i, man_y_lo+i, n-i, niter, period_eps, iterations+i);
+#else
+  if (i < n) nperiodic += KERNEL_SCALAR(man_x+i, man_y+i, n-i, niter, period_eps, iterations+i);
+#endif
+  return nperiodic;
+}
+
+
+#undef KT_NVEC
+#undef KT_INT
+#undef KT_REAL
+#undef KT
+#undef KT_CAT
+#undef KT_CAT2
+#undef KERNEL_NAME
+#undef KERNEL_TARGET
+#undef KERNEL_LANES
+#undef KERNEL_ANY
+#undef KERNEL_SCALAR
+#undef KERNEL_REAL
+#undef KERNEL_INT
+#undef KERNEL_DD
+#undef KERNEL_FMA
+
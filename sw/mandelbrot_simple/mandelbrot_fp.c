@@ -8,6 +8,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include "fp.h"
+#include "kernel_fp.h"
+#include "sched.h"
+#include "mariani.h"
+#include "ppm.h"
+#include "reuse.h"
+#include "coords.h"
 
 
 //// defines ////
@@ -27,45 +34,272 @@
 #define MANDELBROT_CX   ((1.0+(-2.5))/2.0)
 // default Mandelbrot center y coordinate
 #define MANDELBROT_CY   ((1.0+(-1.0))/2.0)
+// number of pixels passed to the kernel at once
+#define KERNEL_CHUNK    256U
+// pixel step of the samples that estimate the cost of a batch view
+#define BATCH_STEP      8U
 
 
 //// types ////
-// rgb_t
-// represents a RGB color value
+// stats_t
+// per-worker render statistics
 typedef struct {
-  uint8_t r;
-  uint8_t g;
-  uint8_t b;
-} rgb_t;
-
-typedef int64_t FP;
+  mariani_stats_t ms;
+  uint64_t        interior;
+  uint64_t        periodic;
+} stats_t;
 
+// render_t
+// shared state of the tile renderer
+typedef struct {
+  const kernel_fp_t* kernel;
+  const FP*          man_xs_fp;
+  FP                 man_y0_fp;
+  FP                 man_ys_fp;
+  uint32_t           img_w;
+  uint32_t           img_h;
+  uint32_t           niter;
+  uint32_t           period;
+  uint32_t*          iterations;
+  uint32_t           mariani;
+  mariani_t          ms;
+  stats_t*           stats;
+  const uint8_t*     known;
+} render_t;
 
-//// FP ////
-#define MAX_MUL_WIDTH 54UL
-#define FP_S 1UL
-#define FP_I 4UL
-#define FP_F (MAX_MUL_WIDTH-FP_S-FP_I)
-#define DBL2FP(x) ((FP)((x)*(1UL<<FP_F)))
-#define FP2DBL(x) (double(x)/(1UL<<FP_F))
-#define FPMUL(x, y) ({__int128 v128 = (__int128)(x) * (__int128)(y); FP v64 = (FP)(v128>>FP_F); v64;})
+// batch_t
+// shared state of a batch render, each view is rendered whole by one worker, into the
+// worker's own buffers
+typedef struct {
+  const reuse_grid_t* frames;
+  uint32_t            nframes;
+  render_t*           renders;        // per worker
+  FP**                man_xs_fp;      // per worker
+  uint64_t*           cost;           // estimated, per view
+  uint32_t*           order;          // views, longest first
+  ppm_stats_t*        frame_stats;    // per view
+  const char*         filename;
+  const rgb_t*        palette;
+  uint32_t            failed;         // first view that couldn't be written + 1
+} batch_t;
 
 
 //// usage() ////
 void usage(char* progname)
 {
-  fprintf(stderr, "Usage: %s [-h] [-o mandelbrot.ppm] [-iw image_width] [-ih image_height] [-n niterations] [-cx x_coord] [-cy y_coord] [-z zoom]\n", progname);
+  fprintf(stderr, "Usage: %s [-h] [-o mandelbrot.ppm] [-iw image_width] [-ih image_height] [-n niterations] [-cx x_coord] [-cy y_coord] [-z zoom] [-k kernel] [-t nthreads] [-ms] [-p] [-f frames.txt] [-nr] [-batch]\n", progname);
   fprintf(stderr, "  -h               - show this help\n");
+  fprintf(stderr, "  -o file          - write output image to file (.png - png, .dzi - Deep Zoom pyramid of png tiles, otherwise binary ppm, default: %s)\n", FILENAME);
   fprintf(stderr, "  -iw image_width  - set output image width to image_width (default: %u)\n", IMG_WIDTH);
   fprintf(stderr, "  -ih image_height - set output image height to image_height (default: %u)\n", IMG_HEIGHT);
   fprintf(stderr, "  -n niterations   - set maximal iterations to niterations (default: %u)\n", NITERATIONS);
   fprintf(stderr, "  -cx x_coord      - set Mandelbrot center x coordinate to x_coord (default: %f)\n", MANDELBROT_CX);
   fprintf(stderr, "  -cy y_coord      - set Mandelbrot center y coordinate to y_coord (default: %f)\n", MANDELBROT_CY);
   fprintf(stderr, "  -z zoom          - set Mandelbrot zoom to zoom (default: %f)\n", MANDELBROT_ZOOM);
+  fprintf(stderr, "  -k kernel        - force kernel: scalar, avx2, avx512, avx512ifma (default: best supported by the cpu)\n");
+  fprintf(stderr, "  -t nthreads      - set number of worker threads to nthreads (default: number of cpus)\n");
+  fprintf(stderr, "  -ms              - use Mariani-Silver subdivision (fill rectangles with uniform border)\n");
+  fprintf(stderr, "  -p               - stop periodic orbits early (Brent cycle detection, exact FP compare)\n");
+  fprintf(stderr, "  -f frames.txt    - render the frames listed in frames.txt, one {x0, y0, xs, ys} FP entry per line\n");
+  fprintf(stderr, "                     (e.g. the coords[] table of fw/main.c), to mandelbrot_000.ppm, ... (-o sets the base name)\n");
+  fprintf(stderr, "  -nr              - don't reuse pixels of the previous frame that land on the new frame's grid (-f, not with -ms)\n");
+  fprintf(stderr, "  -batch           - render each frame whole on one worker, longest first (estimated from every %u-th pixel), so\n", BATCH_STEP*BATCH_STEP);
+  fprintf(stderr, "                     that no worker waits for the end of a frame (-f, no pixels are reused)\n");
   exit(EXIT_FAILURE);
 }
 
 
+//// read_frames() ////
+// reads the FP frame grids of a view table, {x0, y0, xs, ys} per frame (see coords_read(),
+// the coords[] table of fw/main.c can be used as is)
+static reuse_grid_t* read_frames(const char* filename, uint32_t* nframes)
+{
+  coords_t* coords = NULL;
+  if ((coords = coords_read(filename, nframes)) == NULL) return NULL;
+  reuse_grid_t* frames = NULL;
+  if ((frames = (reuse_grid_t*)malloc((*nframes ? *nframes : 1) * sizeof(reuse_grid_t))) != NULL) {
+    for (uint32_t i=0; i<*nframes; i++) {
+      frames[i].x0 = coords[i].x0;
+      frames[i].y0 = coords[i].y0;
+      frames[i].xs = coords[i].xs;
+      frames[i].ys = coords[i].ys;
+    }
+  }
+  free(coords);
+  return frames;
+}
+
+
+//// render_span() ////
+// calculates n pixels starting at (img_x, img_y), stepping by (dx, dy); points inside
+// the main cardioid or the period-2 bulb are filled in, the rest goes to the kernel
+static void render_span(void* arg, uint32_t worker, uint32_t img_x, uint32_t img_y, uint32_t dx, uint32_t dy, uint32_t n, uint32_t* out)
+{
+  const render_t* r = (const render_t*)arg;
+  FP span_x_fp[KERNEL_CHUNK];
+  FP span_y_fp[KERNEL_CHUNK];
+  uint32_t span_idx[KERNEL_CHUNK];
+  uint32_t span_iter[KERNEL_CHUNK];
+  for (uint32_t i=0; i<n; i+=KERNEL_CHUNK) {
+    uint32_t cn = n-i < KERNEL_CHUNK ? n-i : KERNEL_CHUNK;
+    uint32_t kn = 0;
+    for (uint32_t j=0; j<cn; j++) {
+      // convert image coordinates to Mandelbrot coordinates
+      FP man_x_fp = r->man_xs_fp[img_x+(i+j)*dx];
+      FP man_y_fp = r->man_y0_fp + (FP)(img_y+(i+j)*dy)*r->man_ys_fp;
+      if (kernel_fp_inside(man_x_fp, man_y_fp)) {
+        out[i+j] = r->niter-1;
+        r->stats[worker].interior++;
+      } else {
+        span_x_fp[kn] = man_x_fp;
+        span_y_fp[kn] = man_y_fp;
+        span_idx[kn++] = i+j;
+      }
+    }
+    r->stats[worker].periodic += r->kernel->fn(span_x_fp, span_y_fp, kn, r->niter, r->period, span_iter);
+    for (uint32_t k=0; k<kn; k++) out[span_idx[k]] = span_iter[k];
+  }
+}
+
+
+//// render_row() ////
+// calculates the n pixels of row img_y at columns img_xs[], results go to row[img_xs[i]]
+static void render_row(const render_t* r, uint32_t worker, const uint32_t* img_xs, uint32_t img_y, uint32_t n, uint32_t* row)
+{
+  FP span_x_fp[KERNEL_CHUNK];
+  FP span_y_fp[KERNEL_CHUNK];
+  uint32_t span_idx[KERNEL_CHUNK];
+  uint32_t span_iter[KERNEL_CHUNK];
+  FP man_y_fp = r->man_y0_fp + (FP)img_y*r->man_ys_fp;
+  for (uint32_t i=0; i<n; i+=KERNEL_CHUNK) {
+    uint32_t cn = n-i < KERNEL_CHUNK ? n-i : KERNEL_CHUNK;
+    uint32_t kn = 0;
+    for (uint32_t j=0; j<cn; j++) {
+      FP man_x_fp = r->man_xs_fp[img_xs[i+j]];
+      if (kernel_fp_inside(man_x_fp, man_y_fp)) {
+        row[img_xs[i+j]] = r->niter-1;
+        r->stats[worker].interior++;
+      } else {
+        span_x_fp[kn] = man_x_fp;
+        span_y_fp[kn] = man_y_fp;
+        span_idx[kn++] = img_xs[i+j];
+      }
+    }
+    r->stats[worker].periodic += r->kernel->fn(span_x_fp, span_y_fp, kn, r->niter, r->period, span_iter);
+    for (uint32_t k=0; k<kn; k++) row[span_idx[k]] = span_iter[k];
+  }
+}
+
+
+//// render_tile() ////
+// calculates the Mandelbrot set for one image tile
+static void render_tile(void* arg, uint32_t worker, uint32_t tile_x, uint32_t tile_y, uint32_t tile_w, uint32_t tile_h)
+{
+  const render_t* r = (const render_t*)arg;
+  if (r->mariani) {
+    mariani_rect(&r->ms, worker, tile_x, tile_y, tile_w, tile_h, &r->stats[worker].ms);
+    return;
+  }
+  // iterate over all tile rows
+  for (uint32_t img_y=tile_y; img_y<tile_y+tile_h; img_y++) {
+    if (r->known == NULL) {
+      render_span(arg, worker, tile_x, img_y, 1, 0, tile_w, r->iterations+img_y*r->img_w+tile_x);
+      continue;
+    }
+    // only the pixels not reused from the previous frame
+    uint32_t img_xs[KERNEL_CHUNK];
+    uint32_t n = 0;
+    const uint8_t* known = r->known+img_y*r->img_w;
+    for (uint32_t img_x=tile_x; img_x<tile_x+tile_w; img_x++) {
+      if (!known[img_x]) img_xs[n++] = img_x;
+      if (n == KERNEL_CHUNK || (n && img_x == tile_x+tile_w-1)) {
+        render_row(r, worker, img_xs, img_y, n, r->iterations+img_y*r->img_w);
+        n = 0;
+      }
+    }
+  }
+}
+
+
+//// frame_name() ////
+// makes the output file name of a frame: the base name, without the .ppm (or .png)
+// extension, & the frame number
+static void frame_name(const char* filename, uint32_t frame, char* name, size_t size)
+{
+  int base_len = (int)strlen(filename);
+  const char* ext = base_len >= 4 && !strcmp(filename+base_len-4, ".png") ? "png" : "ppm";
+  if (base_len >= 4 && (!strcmp(filename+base_len-4, ".ppm") || !strcmp(filename+base_len-4, ".png"))) base_len -= 4;
+  snprintf(name, size, "%.*s_%03u.%s", base_len, filename, frame, ext);
+}
+
+
+//// frame_setup() ////
+// points the renderer at the grid of frame g, man_xs_fp is its x coordinates array
+static void frame_setup(render_t* r, FP* man_xs_fp, const reuse_grid_t* g)
+{
+  for (uint32_t img_x=0; img_x<r->img_w; img_x++) {
+    man_xs_fp[img_x] = g->x0 + (FP)img_x*g->xs;
+  }
+  r->man_y0_fp   = g->y0;
+  r->man_ys_fp   = g->ys;
+  r->ms.origin_x = g->xs ? -FP2DBL(g->x0)/FP2DBL(g->xs) : 0.0;
+  r->ms.origin_y = g->ys ? -FP2DBL(g->y0)/FP2DBL(g->ys) : 0.0;
+}
+
+
+//// batch_cost() ////
+// estimates the cost of one view: the iterations of every BATCH_STEP-th pixel of every
+// BATCH_STEP-th row
+static void batch_cost(void* arg, uint32_t worker, uint32_t task)
+{
+  batch_t* b = (batch_t*)arg;
+  const render_t* r = &b->renders[worker];
+  const reuse_grid_t* g = &b->frames[task];
+  FP span_x_fp[KERNEL_CHUNK];
+  FP span_y_fp[KERNEL_CHUNK];
+  uint32_t span_iter[KERNEL_CHUNK];
+  uint64_t cost = 0;
+  uint32_t kn = 0;
+  for (uint32_t img_y=BATCH_STEP/2; img_y<r->img_h; img_y+=BATCH_STEP) {
+    for (uint32_t img_x=BATCH_STEP/2; img_x<r->img_w; img_x+=BATCH_STEP) {
+      FP man_x_fp = g->x0 + (FP)img_x*g->xs;
+      FP man_y_fp = g->y0 + (FP)img_y*g->ys;
+      // inside points are filled, they cost about as much as one iteration
+      if (kernel_fp_inside(man_x_fp, man_y_fp)) {
+        cost++;
+      } else {
+        span_x_fp[kn] = man_x_fp;
+        span_y_fp[kn++] = man_y_fp;
+      }
+      if (kn && (kn == KERNEL_CHUNK || (img_x+BATCH_STEP >= r->img_w && img_y+BATCH_STEP >= r->img_h))) {
+        r->kernel->fn(span_x_fp, span_y_fp, kn, r->niter, r->period, span_iter);
+        for (uint32_t k=0; k<kn; k++) cost += span_iter[k] + 1;
+        kn = 0;
+      }
+    }
+  }
+  b->cost[task] = cost;
+}
+
+
+//// batch_view() ////
+// renders one whole view on the calling worker & writes its image (colored on this
+// worker too)
+static void batch_view(void* arg, uint32_t worker, uint32_t task)
+{
+  batch_t* b = (batch_t*)arg;
+  render_t* r = &b->renders[worker];
+  uint32_t frame = b->order[task];
+  frame_setup(r, b->man_xs_fp[worker], &b->frames[frame]);
+  render_tile(r, worker, 0, 0, r->img_w, r->img_h);
+  char name[1024];
+  frame_name(b->filename, frame, name, sizeof(name));
+  if (ppm_write(NULL, name, r->iterations, r->img_w, r->img_h, b->palette, r->niter, &b->frame_stats[frame])) {
+    __atomic_store_n(&b->failed, frame+1, __ATOMIC_RELAXED);
+  }
+}
+
+
 //// main() ////
 int main(int argc, char*argv[])
 {
@@ -77,6 +311,13 @@ int main(int argc, char*argv[])
   double man_cx   = MANDELBROT_CX;
   double man_cy   = MANDELBROT_CY;
   double man_zoom = MANDELBROT_ZOOM;
+  char* kernel_name = NULL;
+  uint32_t nthreads = 0;
+  uint32_t mariani = 0;
+  uint32_t period = 0;
+  char* frames_filename = NULL;
+  uint32_t reuse = 1;
+  uint32_t batch = 0;
 
   // parse cmd args
   int curpos = 1;
@@ -104,6 +345,27 @@ int main(int argc, char*argv[])
     } else if (!strcmp(argv[curpos], "-z")) {\
       curpos++;
       man_zoom = strtod(argv[curpos++], NULL);
+    } else if (!strcmp(argv[curpos], "-k")) {\
+      curpos++;
+      kernel_name = argv[curpos++];
+    } else if (!strcmp(argv[curpos], "-t")) {\
+      curpos++;
+      nthreads = strtoul(argv[curpos++], NULL, 0);
+    } else if (!strcmp(argv[curpos], "-ms")) {\
+      curpos++;
+      mariani = 1;
+    } else if (!strcmp(argv[curpos], "-p")) {\
+      curpos++;
+      period = 1;
+    } else if (!strcmp(argv[curpos], "-f")) {\
+      curpos++;
+      frames_filename = argv[curpos++];
+    } else if (!strcmp(argv[curpos], "-nr")) {\
+      curpos++;
+      reuse = 0;
+    } else if (!strcmp(argv[curpos], "-batch")) {\
+      curpos++;
+      batch = 1;
     } else {
       usage(argv[0]);
     }
@@ -140,18 +402,30 @@ int main(int argc, char*argv[])
   }
   fclose(clut_fp);
 
+  // select escape time kernel
+  const kernel_fp_t* kernel = NULL;
+  if ((kernel = kernel_fp_select(kernel_name)) == NULL) {
+    fprintf(stderr, "Kernel %s unknown or not supported by this cpu, exiting.\n", kernel_name);
+    exit(EXIT_FAILURE);
+  }
+
   //// Mandelbrot with FP ////
-  // calculate Mandelbrot coordinates (TODO)
+  // calculate Mandelbrot coordinates
   double man_x0 = man_cx - (double)img_w/(double)img_h*man_zoom;
   double man_x1 = man_cx + (double)img_w/(double)img_h*man_zoom;
   double man_y0 = man_cy - 1.0*man_zoom;
   double man_y1 = man_cy + 1.0*man_zoom;
-  FP man_cx_fp = DBL2FP(man_cx);
-  FP man_x0_fp = DBL2FP(man_x0);
-  FP man_x1_fp = DBL2FP(man_x1);
-  FP man_cy_fp = DBL2FP(man_cy);
-  FP man_y0_fp = DBL2FP(man_y0);
-  FP man_y1_fp = DBL2FP(man_y1);
+
+  // frame grids: the view given by -cx, -cy & -z (as mandelbrot_calc_params calculates it), or the list from -f
+  reuse_grid_t view = {DBL2FP(man_x0), DBL2FP(man_y0), DBL2FP((man_x1-man_x0)/img_w), DBL2FP((man_y1-man_y0)/img_h)};
+  reuse_grid_t* frames = &view;
+  uint32_t nframes = 1;
+  if (frames_filename != NULL && ((frames = read_frames(frames_filename, &nframes)) == NULL || nframes == 0)) {
+    fprintf(stderr, "Can't read frames from %s, exiting.\n", frames_filename);
+    exit(EXIT_FAILURE);
+  }
+  batch = batch && frames_filename != NULL;
+  reuse = reuse && frames_filename != NULL && !mariani && !batch;
 
   // create image array
   uint32_t* iterations = NULL;
@@ -160,77 +434,182 @@ int main(int argc, char*argv[])
     exit(EXIT_FAILURE);
   }
 
-  // calculate the Mandelbrot set
-  // iterate over all image rows
-  #pragma omp parallel for ordered schedule(dynamic)
-  for (uint32_t img_y=0; img_y<img_h; img_y++) {
-    // convert y image coordinate to Mandelbrot coordinate
-    double man_y = (double)(img_y)/(double)img_h*(man_y1-man_y0) + man_y0;
-    FP man_y_fp = DBL2FP(man_y); // TODO
-    // iterate over all image columns
-    for (uint32_t img_x=0; img_x<img_w; img_x++) {
-      // convert x image coordinate to Mandelbrot coordinate
-      double man_x = (double)(img_x)/(double)img_w*(man_x1-man_x0) + man_x0;
-      FP man_x_fp = DBL2FP(man_x); // TODO
-      // initialize Zn to 0 + i0
-      FP zn_x_fp = 0L;
-      FP zn_y_fp = 0L;
-      // initialize niterations to 0
-      uint32_t niterations = 0;
-      // initialize temporary variables
-      FP x2_fp = 0L;
-      FP y2_fp = 0L;
-      while (x2_fp + y2_fp <= DBL2FP(4.0) && niterations < niter-1) {
-        zn_y_fp = FPMUL(zn_x_fp, zn_y_fp);
-        zn_y_fp <<= 1;
-        zn_y_fp += man_y_fp;
-        zn_x_fp = x2_fp - y2_fp + man_x_fp;
-        x2_fp = FPMUL(zn_x_fp, zn_x_fp);
-        y2_fp = FPMUL(zn_y_fp, zn_y_fp);
-        niterations++;
-      }
-      // save number of iterations to iterations array
-      iterations[img_y*img_w+img_x] = niterations;
-    }
+  // create the previous frame cache & the mask of reused pixels
+  reuse_t* cache = NULL;
+  uint8_t* known = NULL;
+  if (reuse && ((cache = reuse_create(img_w, img_h)) == NULL || (known = (uint8_t*)malloc(img_w*img_h)) == NULL)) {
+    fprintf(stderr, "Can't allocate frame cache, exiting.\n");
+    exit(EXIT_FAILURE);
   }
 
-  // open output image file
-  FILE* fp = NULL;
-  if ((fp  = fopen(filename, "wb")) == NULL) {
-    fprintf(stderr, "Can't open output file " FILENAME ", exiting.\n");
+  // x image coordinates in Mandelbrot coordinates (same for all rows)
+  FP* man_xs_fp = NULL;
+  if ((man_xs_fp = (FP*)malloc(img_w * sizeof(FP))) == NULL) {
+    fprintf(stderr, "Can't allocate coordinates array, exiting.\n");
     exit(EXIT_FAILURE);
   }
 
-  // write ppm image header
-  fprintf(fp, "P3\n%d %d\n255\n", img_w, img_h);
-
-  // convert number of iterations to a rgb value and write it to the output image file & collect statistics
-  uint32_t min_iterations = UINT32_MAX;
-  uint32_t max_iterations = 0;
-  uint64_t sum_iterations = 0;
-  for (uint32_t i=0; i<img_w*img_h; i++) {
-    uint32_t niterations = iterations[i];
-    fprintf(fp, "%d %d %d\n", palette[niterations].r, palette[niterations].g, palette[niterations].b);
-    min_iterations = niterations < min_iterations ? niterations : min_iterations;
-    max_iterations = niterations > max_iterations ? niterations : max_iterations;
-    sum_iterations += niterations;
-  }   
+  // calculate the Mandelbrot set, tile by tile on all workers
+  sched_t* sched = NULL;
+  if ((sched = sched_create(nthreads)) == NULL) {
+    fprintf(stderr, "Can't create worker threads, exiting.\n");
+    exit(EXIT_FAILURE);
+  }
+  stats_t* stats = NULL;
+  if ((stats = (stats_t*)calloc(sched_nthreads(sched), sizeof(stats_t))) == NULL) {
+    fprintf(stderr, "Can't allocate statistics array, exiting.\n");
+    exit(EXIT_FAILURE);
+  }
+  render_t render = {.kernel = kernel, .man_xs_fp = man_xs_fp, .img_w = img_w, .img_h = img_h, .niter = niter, .period = period,
+                     .iterations = iterations, .mariani = mariani};
+  render.ms.span       = render_span;
+  render.ms.arg        = &render;
+  render.ms.iterations = iterations;
+  render.ms.img_w      = img_w;
+  render.ms.max_iter   = niter-1;
+  render.stats         = stats;
+  ppm_stats_t img_stats = {UINT32_MAX, 0, 0};
+  uint64_t nreused = 0;
+  if (batch) {
+    // the frames are independent, so each worker renders whole frames into its own
+    // buffers (worker 0 into the ones above), which are kept for the whole batch
+    uint32_t nworkers = sched_nthreads(sched);
+    batch_t b = {frames, nframes, NULL, NULL, NULL, NULL, NULL, filename, palette, 0};
+    b.renders        = (render_t*)calloc(nworkers, sizeof(render_t));
+    b.man_xs_fp      = (FP**)calloc(nworkers, sizeof(FP*));
+    b.cost           = (uint64_t*)malloc(nframes * sizeof(uint64_t));
+    b.order          = (uint32_t*)malloc(nframes * sizeof(uint32_t));
+    b.frame_stats    = (ppm_stats_t*)malloc(nframes * sizeof(ppm_stats_t));
+    if (b.renders == NULL || b.man_xs_fp == NULL || b.cost == NULL || b.order == NULL || b.frame_stats == NULL) {
+      fprintf(stderr, "Can't allocate batch arrays, exiting.\n");
+      exit(EXIT_FAILURE);
+    }
+    for (uint32_t i=0; i<nworkers; i++) {
+      render_t* r = &b.renders[i];
+      *r = render;
+      b.man_xs_fp[i] = i ? (FP*)malloc(img_w * sizeof(FP)) : man_xs_fp;
+      r->iterations  = i ? (uint32_t*)malloc(img_w*img_h * sizeof(uint32_t)) : iterations;
+      if (b.man_xs_fp[i] == NULL || r->iterations == NULL) {
+        fprintf(stderr, "Can't allocate batch buffers, exiting.\n");
+        exit(EXIT_FAILURE);
+      }
+      r->man_xs_fp     = b.man_xs_fp[i];
+      r->ms.arg        = r;
+      r->ms.iterations = r->iterations;
+    }
+    // estimate the frames on all workers & render them longest first, so that the short
+    // ones fill in at the end
+    sched_run(sched, nframes, batch_cost, &b);
+    for (uint32_t i=0; i<nframes; i++) {
+      uint32_t j = i;
+      for (; j>0 && b.cost[b.order[j-1]] < b.cost[i]; j--) b.order[j] = b.order[j-1];
+      b.order[j] = i;
+    }
+    sched_run(sched, nframes, batch_view, &b);
+    if (b.failed) {
+      char name[1024];
+      frame_name(filename, b.failed-1, name, sizeof(name));
+      fprintf(stderr, "Can't write output file %s, exiting.\n", name);
+      exit(EXIT_FAILURE);
+    }
+    uint64_t total_cost = 0;
+    for (uint32_t frame=0; frame<nframes; frame++) total_cost += b.cost[frame];
+    for (uint32_t frame=0; frame<nframes; frame++) {
+      img_stats.min = b.frame_stats[frame].min < img_stats.min ? b.frame_stats[frame].min : img_stats.min;
+      img_stats.max = b.frame_stats[frame].max > img_stats.max ? b.frame_stats[frame].max : img_stats.max;
+      img_stats.sum += b.frame_stats[frame].sum;
+      printf("frame %3u:          %lu iterations, %.2f%% of the estimated cost\n", frame, b.frame_stats[frame].sum, 100.0*(double)b.cost[frame]/(double)(total_cost ? total_cost : 1));
+    }
+    for (uint32_t i=1; i<nworkers; i++) {
+      free(b.man_xs_fp[i]);
+      free(b.renders[i].iterations);
+    }
+    free(b.renders);
+    free(b.man_xs_fp);
+    free(b.cost);
+    free(b.order);
+    free(b.frame_stats);
+  }
+  for (uint32_t frame=0; frame<nframes && !batch; frame++) {
+    const reuse_grid_t* g = &frames[frame];
+    frame_setup(&render, man_xs_fp, g);
+    // pixels of the previous frame that land on this frame's grid
+    uint64_t frame_reused = 0;
+    if (cache != NULL) {
+      frame_reused = reuse_fill(cache, g, iterations, known);
+      render.known = known;
+    }
+    sched_tiles(sched, img_w, img_h, render_tile, &render);
+    if (cache != NULL) reuse_store(cache, g, iterations);
+    nreused += frame_reused;
 
-  // close output file
-  fclose(fp);
+    // convert number of iterations to a rgb value, write the output image file & collect statistics
+    char frame_filename[1024];
+    if (frames_filename != NULL) {
+      frame_name(filename, frame, frame_filename, sizeof(frame_filename));
+    } else {
+      snprintf(frame_filename, sizeof(frame_filename), "%s", filename);
+    }
+    ppm_stats_t frame_stats;
+    if (ppm_write(sched, frame_filename, iterations, img_w, img_h, palette, niter, &frame_stats)) {
+      fprintf(stderr, "Can't write output file %s, exiting.\n", frame_filename);
+      exit(EXIT_FAILURE);
+    }
+    img_stats.min = frame_stats.min < img_stats.min ? frame_stats.min : img_stats.min;
+    img_stats.max = frame_stats.max > img_stats.max ? frame_stats.max : img_stats.max;
+    img_stats.sum += frame_stats.sum;
+    if (frames_filename != NULL) {
+      printf("frame %3u:          %lu iterations, %.2f%% pixels reused\n", frame, frame_stats.sum, 100.0*(double)frame_reused/(double)(img_w*img_h));
+    }
+  }
+  stats_t total = {{0, 0}, 0, 0};
+  for (uint32_t i=0; i<sched_nthreads(sched); i++) {
+    total.ms.computed += stats[i].ms.computed;
+    total.ms.filled   += stats[i].ms.filled;
+    total.interior    += stats[i].interior;
+    total.periodic    += stats[i].periodic;
+  }
+  free(stats);
+  free(man_xs_fp);
+  free(known);
+  reuse_destroy(cache);
+  if (frames != &view) free(frames);
+  uint32_t min_iterations = img_stats.min;
+  uint32_t max_iterations = img_stats.max;
+  uint64_t sum_iterations = img_stats.sum;
+  uint64_t npixels = (uint64_t)img_w*img_h*nframes;
 
   // deallocate array
   free(iterations);
 
   // output stats
-  printf("Mandelbrot set calculated with %d points & %d max iterations.\n", img_w*img_h, niter);
-  printf("X coords: % 2.8e  -  % 2.8e  -  % 2.8e\n", man_x0, man_cx, man_x1);
-  printf("Y coords: % 2.8e  -  % 2.8e  -  % 2.8e\n", man_y0, man_cy, man_y1);
-  printf("Zoom:     % 2.8e\n", man_zoom);
+  if (frames_filename != NULL) {
+    printf("Mandelbrot set calculated for %u frames with %lu points & %d max iterations.\n", nframes, npixels, niter);
+  } else {
+    printf("Mandelbrot set calculated with %lu points & %d max iterations.\n", npixels, niter);
+    printf("X coords: % 2.8e  -  % 2.8e  -  % 2.8e\n", man_x0, man_cx, man_x1);
+    printf("Y coords: % 2.8e  -  % 2.8e  -  % 2.8e\n", man_y0, man_cy, man_y1);
+    printf("Zoom:     % 2.8e\n", man_zoom);
+  }
+  printf("kernel:             %s (%u lanes, %u threads)\n", kernel->name, kernel->lanes, sched_nthreads(sched));
   printf("minimal iterations: %u\n", min_iterations);
   printf("maximal iterations: %u\n", max_iterations);
   printf("all iterations:     %lu\n", sum_iterations);
-  printf("average iter/pixel: %f\n", (double)sum_iterations/(double)(img_w*img_h));
+  printf("average iter/pixel: %f\n", (double)sum_iterations/(double)npixels);
+  printf("interior pixels:    %lu (%.2f%%, not iterated)\n", total.interior, 100.0*(double)total.interior/(double)npixels);
+  if (period) {
+    printf("periodic pixels:    %lu (stopped early)\n", total.periodic);
+  }
+  if (mariani) {
+    printf("computed pixels:    %lu\n", total.ms.computed);
+    printf("filled pixels:      %lu (%.2f%%)\n", total.ms.filled, 100.0*(double)total.ms.filled/(double)npixels);
+  }
+  if (reuse) {
+    printf("reused pixels:      %lu (%.2f%%, from the previous frame)\n", nreused, 100.0*(double)nreused/(double)npixels);
+  }
+
+  // stop worker threads
+  sched_destroy(sched);
 
   // exit
   exit(EXIT_SUCCESS);
@@ -8,6 +8,23 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "kernel_dbl.h"
+#include "kernel_flt.h"
+#include "kernel_dd.h"
+#include "prec.h"
+#include "sched.h"
+#include "mariani.h"
+#include "ppm.h"
+#include "mbi.h"
+#include "perturb.h"
+#include "expmap.h"
+#include "ssaa.h"
+#include "dist.h"
+#include "writer.h"
+#include "prof.h"
 
 
 //// defines ////
@@ -27,36 +44,553 @@
 #define MANDELBROT_CX   ((1.0+(-2.5))/2.0)
 // default Mandelbrot center y coordinate
 #define MANDELBROT_CY   ((1.0+(-1.0))/2.0)
+// number of pixels passed to the kernel at once
+#define KERNEL_CHUNK    256U
+// default zoom of the first video frame
+#define VIDEO_ZOOM0     2.0
+// default video frame rate
+#define VIDEO_FPS       30U
+// pixel step of the first progressive level, each next level halves it
+#define PROG_STEP       8U
+// color difference to a neighbour that makes a pixel an edge for supersampling
+#define AA_THRESHOLD    12U
+// default address the worker daemon listens on
+#define SERVE_ADDRESS   "127.0.0.1"
+// statistics a distributed render worker returns with each chunk (DIST_COUNTS of them)
+#define DIST_COUNT_INTERIOR 0U
+#define DIST_COUNT_PERIODIC 1U
+#define DIST_COUNT_COMPUTED 2U
+#define DIST_COUNT_FILLED   3U
+#define DIST_COUNT_REBASED  4U
+#define DIST_COUNT_SKIPPED  5U
+#define DIST_COUNT_MIRRORED 6U
 
 
 //// types ////
-// rgb_t
-// represents a RGB color value
+// stats_t
+// per-worker render statistics
 typedef struct {
-  uint8_t r;
-  uint8_t g;
-  uint8_t b;
-} rgb_t;
+  mariani_stats_t ms;
+  uint64_t        interior;
+  uint64_t        periodic;
+  perturb_stats_t pt;
+  ssaa_stats_t    aa;
+} stats_t;
+
+// render_t
+// shared state of the tile renderer
+typedef struct {
+  prec_t              prec;
+  const kernel_dbl_t* kernel;
+  const kernel_flt_t* kernel_flt;
+  const double*       man_xs;
+  double              man_y0;
+  double              man_y1;
+  uint32_t            img_w;
+  uint32_t            img_h;
+  uint32_t            niter;
+  double              period_eps;
+  uint32_t*           iterations;
+  uint32_t            band_y;
+  uint32_t            mariani;
+  mariani_t           ms;
+  stats_t*            stats;
+  const perturb_t*    perturb;
+  double              dc_x0;
+  double              dc_y0;
+  double              dc_w;
+  double              dc_h;
+  const kernel_dd_t*  kernel_dd;
+  double              cx_hi;
+  double              cx_lo;
+  double              cy_hi;
+  double              cy_lo;
+  double              man_cx;
+  double              man_cy;
+  const uint32_t*     mirror;
+  uint32_t*           row_counts; // interior & periodic pixels of each image row, for the mirrored copies
+  writer_t*           writer;
+} render_t;
+
+// prog_t
+// shared state of one progressive refinement level
+typedef struct {
+  const render_t* r;
+  uint32_t        step;       // pixel step of the level
+  uint32_t        first;      // first level, no samples to reuse
+  double          deadline;   // in now() seconds, 0.0 - none
+  uint32_t        late;       // set when a row was skipped because of the deadline
+} prog_t;
+
+// worker_t
+// shared state of the chunks of a distributed render worker
+typedef struct {
+  render_t*       r;
+  sched_t*        s;
+  double          origin_y;   // Mariani-Silver origin of the whole image
+} worker_t;
+
+// out_t
+// outputs of one band, written by the writer thread
+typedef struct {
+  ppm_t*          ppm;
+  mbi_t*          mbi;
+  uint32_t*       iterations; // band iterations
+  const render_t* r;
+  uint32_t        band_y;
+  uint64_t        nmirrored;
+  stats_t         mirrored;   // interior & periodic pixels of the copied rows
+  const char*     failed;     // file that couldn't be written
+  const char*     filename;
+  const char*     mbi_filename;
+  prof_t*         prof;       // profile, the writer's workers are its threads prof_base ..
+  uint32_t        prof_base;
+  uint32_t        prof_open;  // counters of this band's writer workers are open
+} out_t;
 
 
 //// usage() ////
 void usage(char* progname)
 {
-  fprintf(stderr, "Usage: %s [-h] [-o mandelbrot.ppm] [-iw image_width] [-ih image_height] [-n niterations] [-cx x_coord] [-cy y_coord] [-z zoom]\n", progname);
+  fprintf(stderr, "Usage: %s [-h] [-o mandelbrot.ppm] [-iw image_width] [-ih image_height] [-n niterations] [-cx x_coord] [-cy y_coord] [-z zoom] [-k kernel] [-t nthreads] [-ms] [-p tolerance] [-prec policy] [-pt] [-dd] [-max-memory size] [-mbi mandelbrot.mbi] [-video nframes] [-z0 zoom] [-fps fps] [-progressive] [-deadline-ms ms] [-aa samples] [-nm] [-snap] [-workers list] [-serve port] [-bind address] [-profile]\n", progname);
   fprintf(stderr, "  -h               - show this help\n");
+  fprintf(stderr, "  -o file          - write output image to file (.png - png, .dzi - Deep Zoom pyramid of png tiles, otherwise binary ppm, default: %s)\n", FILENAME);
   fprintf(stderr, "  -iw image_width  - set output image width to image_width (default: %u)\n", IMG_WIDTH);
   fprintf(stderr, "  -ih image_height - set output image height to image_height (default: %u)\n", IMG_HEIGHT);
   fprintf(stderr, "  -n niterations   - set maximal iterations to niterations (default: %u)\n", NITERATIONS);
   fprintf(stderr, "  -cx x_coord      - set Mandelbrot center x coordinate to x_coord (default: %f)\n", MANDELBROT_CX);
   fprintf(stderr, "  -cy y_coord      - set Mandelbrot center y coordinate to y_coord (default: %f)\n", MANDELBROT_CY);
   fprintf(stderr, "  -z zoom          - set Mandelbrot zoom to zoom (default: %f)\n", MANDELBROT_ZOOM);
+  fprintf(stderr, "  -k kernel        - force kernel: scalar, sse2, avx2, avx512 (dd: no sse2, default: best supported by the cpu)\n");
+  fprintf(stderr, "  -t nthreads      - set number of worker threads to nthreads (default: number of cpus)\n");
+  fprintf(stderr, "  -ms              - use Mariani-Silver subdivision (fill rectangles with uniform border)\n");
+  fprintf(stderr, "  -p tolerance     - stop orbits that come back within tolerance early (Brent cycle detection, 0 - exact)\n");
+  fprintf(stderr, "  -prec policy     - set numeric policy: auto, float, double, dd, perturb (default: auto - cheapest precise enough for the view)\n");
+  fprintf(stderr, "  -pt              - use perturbation theory for deep zooms, same as -prec perturb (-cx, -cy are used in full precision)\n");
+  fprintf(stderr, "  -dd              - use double-double kernels, same as -prec dd (-cx, -cy are used in full precision)\n");
+  fprintf(stderr, "  -mbi file.mbi    - also save the iteration counts & view to file.mbi (recolor with mbi_recolor)\n");
+  fprintf(stderr, "  -max-memory size - render in bands of rows to keep memory use under size bytes (k, M, G suffix, default: whole image)\n");
+  fprintf(stderr, "  -video nframes   - write a nframes zoom video from -z0 to -z to stdout (YUV4MPEG2), resampled from one exponential map\n");
+  fprintf(stderr, "  -z0 zoom         - set zoom of the first video frame to zoom (default: %f)\n", VIDEO_ZOOM0);
+  fprintf(stderr, "  -fps fps         - set video frame rate to fps (default: %u)\n", VIDEO_FPS);
+  fprintf(stderr, "  -progressive     - render every %uth pixel first, then refine by halving the step down to every pixel\n", PROG_STEP);
+  fprintf(stderr, "  -deadline-ms ms  - progressive, stop refining after ms milliseconds & keep the finest complete level\n");
+  fprintf(stderr, "  -aa samples      - supersample pixels on color edges with samples jittered samples (4, 9, 16 .. 256)\n");
+  fprintf(stderr, "  -nm              - calculate rows that mirror other rows about the real axis (default: copy them)\n");
+  fprintf(stderr, "  -snap            - move -cy by less than half a pixel (& rows by rounding errors), so that the rows mirror about the real axis\n");
+  fprintf(stderr, "  -workers list    - render on the workers in list (host:port,host:port..), each started with -serve\n");
+  fprintf(stderr, "  -serve port      - run as a worker daemon on port, with a worker process for each coordinator\n");
+  fprintf(stderr, "  -bind address    - listen for coordinators on address only (0.0.0.0 - all, default: %s)\n", SERVE_ADDRESS);
+  fprintf(stderr, "  -profile         - print the time & hardware counters (cycles, instructions, branch & cache misses) of each phase & thread\n");
   exit(EXIT_FAILURE);
 }
 
 
+//// now() ////
+// returns monotonic time in seconds
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec*1e-9;
+}
+
+
+//// parse_size() ////
+// parses a size in bytes with an optional k, M or G suffix
+static uint64_t parse_size(const char* s)
+{
+  char* end = NULL;
+  double size = strtod(s, &end);
+  if      (*end == 'k' || *end == 'K') size *= 1024.0;
+  else if (*end == 'm' || *end == 'M') size *= 1024.0*1024.0;
+  else if (*end == 'g' || *end == 'G') size *= 1024.0*1024.0*1024.0;
+  return size > 0.0 ? (uint64_t)size : 0;
+}
+
+
+//// worker options ////
+// view options the coordinator forwards to the workers & the bounds of their values, the
+// workers don't take anything else
+typedef struct {
+  const char* name;
+  uint32_t    has_arg;        // 0 - flag, 1 - number in min .. max, 2 - precision policy
+  double      min;
+  double      max;
+} worker_opt_t;
+
+static const worker_opt_t worker_opts[] = {
+  {"-iw",   1, 1.0,  65536.0},
+  {"-ih",   1, 1.0,  65536.0},
+  {"-n",    1, 2.0,  1048576.0},
+  {"-cx",   1, -4.0, 4.0},
+  {"-cy",   1, -4.0, 4.0},
+  {"-z",    1, 0.0,  16.0},
+  {"-p",    1, 0.0,  1.0},
+  {"-prec", 2, 0.0,  0.0},
+  {"-pt",   0, 0.0,  0.0},
+  {"-dd",   0, 0.0,  0.0},
+  {"-ms",   0, 0.0,  0.0},
+  {"-nm",   0, 0.0,  0.0},
+  {"-snap", 0, 0.0,  0.0},
+};
+
+
+//// worker_opt() ////
+// returns the worker option named name, NULL if it isn't one
+static const worker_opt_t* worker_opt(const char* name)
+{
+  for (uint32_t i=0; i<sizeof(worker_opts)/sizeof(worker_opts[0]); i++) {
+    if (!strcmp(worker_opts[i].name, name)) return &worker_opts[i];
+  }
+  return NULL;
+}
+
+
+//// worker_args() ////
+// checks the view arguments a coordinator sent to a worker, returns 0 if they are all
+// worker options with values in bounds (-z above 0)
+static int worker_args(char* const* args, uint32_t nargs)
+{
+  for (uint32_t i=0; i<nargs; i++) {
+    const worker_opt_t* o = worker_opt(args[i]);
+    if (o == NULL || (o->has_arg && i+1 >= nargs)) return -1;
+    if (o->has_arg == 1) {
+      char* end = NULL;
+      double v = strtod(args[++i], &end);
+      if (end == args[i] || *end != '\0' || !(v >= o->min && v <= o->max) || (!strcmp(o->name, "-z") && v <= 0.0)) return -1;
+    } else if (o->has_arg == 2) {
+      prec_t prec;
+      if (prec_parse(args[++i], &prec)) return -1;
+    }
+  }
+  return 0;
+}
+
+
+//// render_abs() ////
+// calculates n (at most KERNEL_CHUNK) points (man_x[i], man_y[i]); points inside
+// the main cardioid or the period-2 bulb are filled in, the rest goes to the kernel
+static void render_abs(const render_t* r, uint32_t worker, const double* man_x, const double* man_y, uint32_t n, uint32_t* out)
+{
+  double span_x[KERNEL_CHUNK];
+  double span_y[KERNEL_CHUNK];
+  float span_x_flt[KERNEL_CHUNK];
+  float span_y_flt[KERNEL_CHUNK];
+  uint32_t span_idx[KERNEL_CHUNK];
+  uint32_t span_iter[KERNEL_CHUNK];
+  uint32_t kn = 0;
+  for (uint32_t j=0; j<n; j++) {
+    if (kernel_dbl_inside(man_x[j], man_y[j])) {
+      out[j] = r->niter-1;
+      r->stats[worker].interior++;
+    } else {
+      span_x[kn] = man_x[j];
+      span_y[kn] = man_y[j];
+      span_idx[kn++] = j;
+    }
+  }
+  if (r->prec == PREC_FLOAT) {
+    for (uint32_t k=0; k<kn; k++) {
+      span_x_flt[k] = (float)span_x[k];
+      span_y_flt[k] = (float)span_y[k];
+    }
+    r->stats[worker].periodic += r->kernel_flt->fn(span_x_flt, span_y_flt, kn, r->niter, r->period_eps, span_iter);
+  } else {
+    r->stats[worker].periodic += r->kernel->fn(span_x, span_y, kn, r->niter, r->period_eps, span_iter);
+  }
+  for (uint32_t k=0; k<kn; k++) out[span_idx[k]] = span_iter[k];
+}
+
+
+//// render_points() ////
+// calculates n (at most KERNEL_CHUNK) points at offsets (dc_x[i], dc_y[i]) from the
+// view center, with the full precision center for perturbation & double-double
+static void render_points(void* arg, uint32_t worker, const double* dc_x, const double* dc_y, uint32_t n, uint32_t* out)
+{
+  const render_t* r = (const render_t*)arg;
+  double span_x[KERNEL_CHUNK];
+  double span_y[KERNEL_CHUNK];
+  double span_x_lo[KERNEL_CHUNK];
+  double span_y_lo[KERNEL_CHUNK];
+  if (r->prec == PREC_PERTURB) {
+    // deep zoom, offsets from the reference orbit at the view center
+    perturb_iterate(r->perturb, dc_x, dc_y, n, out, &r->stats[worker].pt);
+    return;
+  }
+  if (r->prec == PREC_DD) {
+    // double-double, points are the center plus their offset
+    for (uint32_t j=0; j<n; j++) {
+      kernel_dd_add_dbl(r->cx_hi, r->cx_lo, dc_x[j], &span_x[j], &span_x_lo[j]);
+      kernel_dd_add_dbl(r->cy_hi, r->cy_lo, dc_y[j], &span_y[j], &span_y_lo[j]);
+    }
+    r->stats[worker].periodic += r->kernel_dd->fn(span_x, span_x_lo, span_y, span_y_lo, n, r->niter, r->period_eps, out);
+    return;
+  }
+  for (uint32_t j=0; j<n; j++) {
+    span_x[j] = r->man_cx + dc_x[j];
+    span_y[j] = r->man_cy + dc_y[j];
+  }
+  render_abs(r, worker, span_x, span_y, n, out);
+}
+
+
+//// render_span() ////
+// calculates n pixels starting at (img_x, img_y), stepping by (dx, dy);
+// img_y is relative to the band being rendered
+static void render_span(void* arg, uint32_t worker, uint32_t img_x, uint32_t img_y, uint32_t dx, uint32_t dy, uint32_t n, uint32_t* out)
+{
+  const render_t* r = (const render_t*)arg;
+  img_y += r->band_y;
+  double span_x[KERNEL_CHUNK];
+  double span_y[KERNEL_CHUNK];
+  for (uint32_t i=0; i<n; i+=KERNEL_CHUNK) {
+    uint32_t cn = n-i < KERNEL_CHUNK ? n-i : KERNEL_CHUNK;
+    if (r->prec == PREC_PERTURB || r->prec == PREC_DD) {
+      // deep zoom, pixels are offsets from the image center
+      for (uint32_t j=0; j<cn; j++) {
+        span_x[j] = (double)(img_x+(i+j)*dx)/(double)r->img_w*r->dc_w + r->dc_x0;
+        span_y[j] = (double)(img_y+(i+j)*dy)/(double)r->img_h*r->dc_h + r->dc_y0;
+      }
+      render_points(arg, worker, span_x, span_y, cn, out+i);
+      continue;
+    }
+    for (uint32_t j=0; j<cn; j++) {
+      // convert image coordinates to Mandelbrot coordinates
+      span_y[j] = (double)(img_y+(i+j)*dy)/(double)r->img_h*(r->man_y1-r->man_y0) + r->man_y0;
+      span_x[j] = r->man_xs[img_x+(i+j)*dx];
+    }
+    render_abs(r, worker, span_x, span_y, cn, out+i);
+  }
+}
+
+
+//// render_subpixels() ////
+// calculates n (at most KERNEL_CHUNK) points at fractional image coordinates
+static void render_subpixels(void* arg, uint32_t worker, const double* img_x, const double* img_y, uint32_t n, uint32_t* out)
+{
+  const render_t* r = (const render_t*)arg;
+  double dc_x[KERNEL_CHUNK];
+  double dc_y[KERNEL_CHUNK];
+  for (uint32_t j=0; j<n; j++) {
+    dc_x[j] = img_x[j]/(double)r->img_w*r->dc_w + r->dc_x0;
+    dc_y[j] = img_y[j]/(double)r->img_h*r->dc_h + r->dc_y0;
+  }
+  render_points(arg, worker, dc_x, dc_y, n, out);
+}
+
+
+//// render_tile() ////
+// calculates the Mandelbrot set for one image tile
+static void render_tile(void* arg, uint32_t worker, uint32_t tile_x, uint32_t tile_y, uint32_t tile_w, uint32_t tile_h)
+{
+  const render_t* r = (const render_t*)arg;
+  if (r->mariani) {
+    mariani_rect(&r->ms, worker, tile_x, tile_y, tile_w, tile_h, &r->stats[worker].ms);
+  } else {
+    // iterate over all tile rows, but the mirrors of rows of the same band
+    stats_t* stats = &r->stats[worker];
+    for (uint32_t img_y=tile_y; img_y<tile_y+tile_h; img_y++) {
+      if (r->mirror != NULL && r->mirror[r->band_y+img_y] != r->band_y+img_y && r->mirror[r->band_y+img_y] >= r->band_y) continue;
+      uint64_t interior = stats->interior;
+      uint64_t periodic = stats->periodic;
+      render_span(arg, worker, tile_x, img_y, 1, 0, tile_w, r->iterations+img_y*r->img_w+tile_x);
+      // the tiles of a row are on different workers
+      if (r->row_counts != NULL) {
+        __atomic_fetch_add(&r->row_counts[2*(r->band_y+img_y)],   (uint32_t)(stats->interior-interior), __ATOMIC_RELAXED);
+        __atomic_fetch_add(&r->row_counts[2*(r->band_y+img_y)+1], (uint32_t)(stats->periodic-periodic), __ATOMIC_RELAXED);
+      }
+    }
+  }
+  // the writer thread writes out the rows once all their tiles are finished
+  if (r->writer != NULL) writer_push(r->writer, tile_x, tile_y, tile_w, tile_h);
+}
+
+
+//// mirror_rows() ////
+// finds the rows at the negated coordinate of an earlier row, the kernels are symmetric
+// about the real axis, so they only need to be copied; row_y[] is the increasing
+// coordinate of each row, with tol = 0 they must match exactly (bitwise), otherwise
+// within tol (the copies are then rows at the exactly negated coordinate); mirror[y] is
+// set to the row to copy row y from (or y itself), returns the number of mirrored rows
+static uint32_t mirror_rows(const double* row_y, uint32_t img_h, double tol, uint32_t* mirror)
+{
+  uint32_t nmirrored = 0;
+  for (uint32_t img_y=0; img_y<img_h; img_y++) mirror[img_y] = img_y;
+  for (uint32_t img_y=0; img_y<img_h && row_y[img_y] < 0.0; img_y++) {
+    // binary search for the negated coordinate among the later rows
+    uint32_t lo = img_y+1;
+    uint32_t hi = img_h;
+    while (lo < hi) {
+      uint32_t mid = lo + (hi-lo)/2;
+      if (row_y[mid] < -row_y[img_y]) lo = mid+1; else hi = mid;
+    }
+    if (lo > img_y+1 && (lo == img_h || row_y[lo] + row_y[img_y] > -(row_y[lo-1] + row_y[img_y]))) lo--;
+    if (lo < img_h && lo > img_y && fabs(row_y[lo] + row_y[img_y]) <= tol && mirror[lo] == lo) {
+      mirror[lo] = img_y;
+      nmirrored++;
+    }
+  }
+  return nmirrored;
+}
+
+
+//// copy_mirrored() ////
+// copies the rows row_y .. row_y+nrows-1 of the band at band_y that mirror an earlier row
+// of the same band (render_tile() skips them) & adds the interior & periodic pixels of
+// the rows they are copied from to stats, returns the number of copied rows
+static uint32_t copy_mirrored(const render_t* r, uint32_t band_y, uint32_t row_y, uint32_t nrows, uint32_t* iterations, stats_t* stats)
+{
+  uint32_t ncopied = 0;
+  for (uint32_t img_y=band_y+row_y; img_y<band_y+row_y+nrows && r->mirror != NULL; img_y++) {
+    uint32_t src_y = r->mirror[img_y];
+    if (src_y == img_y || src_y < band_y) continue;
+    memcpy(iterations+(uint64_t)(img_y-band_y)*r->img_w, iterations+(uint64_t)(src_y-band_y)*r->img_w, r->img_w*sizeof(uint32_t));
+    stats->interior += r->row_counts[2*src_y];
+    stats->periodic += r->row_counts[2*src_y+1];
+    ncopied++;
+  }
+  return ncopied;
+}
+
+
+//// prof_worker() ////
+// opens the profile counters of the calling worker
+static void prof_worker(void* arg, uint32_t worker, uint32_t task)
+{
+  prof_thread((prof_t*)arg, worker);
+}
+
+
+//// prof_writer() ////
+// opens the profile counters of the calling writer worker, they count towards "output"
+static void prof_writer(void* arg, uint32_t worker, uint32_t task)
+{
+  const out_t* o = (const out_t*)arg;
+  prof_thread(o->prof, o->prof_base+worker);
+}
+
+
+//// write_rows() ////
+// writes complete band rows on the writer thread: copies the mirrored ones (their
+// source rows are earlier, so they are complete too), colors them on the writer's
+// workers & appends them to the outputs, png & pyramid ones deflated on the same workers
+static int write_rows(void* arg, sched_t* s, uint32_t row_y, uint32_t nrows)
+{
+  out_t* o = (out_t*)arg;
+  if (o->prof != NULL && s != NULL && !o->prof_open) {
+    sched_each(s, prof_writer, o);
+    o->prof_open = 1;
+  }
+  o->nmirrored += copy_mirrored(o->r, o->band_y, row_y, nrows, o->iterations, &o->mirrored);
+  const uint32_t* rows = o->iterations + (uint64_t)row_y*o->r->img_w;
+  if (ppm_write_rows(o->ppm, s, rows, nrows)) {
+    o->failed = o->filename;
+    return -1;
+  }
+  if (o->mbi != NULL && mbi_write_rows(o->mbi, rows, nrows)) {
+    o->failed = o->mbi_filename;
+    return -1;
+  }
+  return 0;
+}
+
+
+//// stats_sum() ////
+// sums the statistics of n workers
+static stats_t stats_sum(const stats_t* stats, uint32_t n)
+{
+  stats_t total = {{0, 0}, 0, 0, {0, 0}, {0, 0}};
+  for (uint32_t i=0; i<n; i++) {
+    total.ms.computed += stats[i].ms.computed;
+    total.ms.filled   += stats[i].ms.filled;
+    total.interior    += stats[i].interior;
+    total.periodic    += stats[i].periodic;
+    total.pt.rebased  += stats[i].pt.rebased;
+    total.pt.skipped  += stats[i].pt.skipped;
+    total.aa.pixels   += stats[i].aa.pixels;
+    total.aa.samples  += stats[i].aa.samples;
+  }
+  return total;
+}
+
+
+//// render_rows() ////
+// calculates rows row_y .. row_y+nrows-1 into iterations on all workers, one chunk
+// of a distributed render; the chunk's statistics go to counts (DIST_COUNT_* entries)
+static void render_rows(void* arg, uint32_t row_y, uint32_t nrows, uint32_t* iterations, uint64_t* counts)
+{
+  const worker_t* wk = (const worker_t*)arg;
+  render_t* r = wk->r;
+  stats_t before = stats_sum(r->stats, sched_nthreads(wk->s));
+  r->band_y        = row_y;
+  r->iterations    = iterations;
+  r->ms.iterations = iterations;
+  r->ms.origin_y   = wk->origin_y - (double)row_y;
+  sched_tiles(wk->s, r->img_w, nrows, render_tile, r);
+  counts[DIST_COUNT_MIRRORED] = copy_mirrored(r, row_y, 0, nrows, iterations, &r->stats[0]);
+  stats_t after = stats_sum(r->stats, sched_nthreads(wk->s));
+  counts[DIST_COUNT_INTERIOR] = after.interior    - before.interior;
+  counts[DIST_COUNT_PERIODIC] = after.periodic    - before.periodic;
+  counts[DIST_COUNT_COMPUTED] = after.ms.computed - before.ms.computed;
+  counts[DIST_COUNT_FILLED]   = after.ms.filled   - before.ms.filled;
+  counts[DIST_COUNT_REBASED]  = after.pt.rebased  - before.pt.rebased;
+  counts[DIST_COUNT_SKIPPED]  = after.pt.skipped  - before.pt.skipped;
+}
+
+
+//// prog_row() ////
+// calculates the pixels of one row that are new in the progressive level: every
+// step-th pixel of the rows the previous level skipped, the pixels between the
+// previous level's samples on the other rows
+static void prog_row(void* arg, uint32_t worker, uint32_t task)
+{
+  prog_t* p = (prog_t*)arg;
+  const render_t* r = p->r;
+  uint32_t img_y = task*p->step;
+  if (p->deadline > 0.0 && !p->first && now() > p->deadline) {
+    __atomic_store_n(&p->late, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  uint32_t x0 = 0;
+  uint32_t dx = p->step;
+  if (!p->first && img_y % (2*p->step) == 0) {
+    x0 = p->step;
+    dx = 2*p->step;
+  }
+  uint32_t* row = r->iterations + (uint64_t)img_y*r->img_w;
+  uint32_t buf[KERNEL_CHUNK];
+  for (uint32_t img_x=x0; img_x<r->img_w; img_x+=KERNEL_CHUNK*dx) {
+    uint32_t n = (r->img_w-img_x+dx-1)/dx;
+    if (n > KERNEL_CHUNK) n = KERNEL_CHUNK;
+    render_span((void*)r, worker, img_x, img_y, dx, 0, n, buf);
+    for (uint32_t i=0; i<n; i++) row[img_x+i*dx] = buf[i];
+  }
+}
+
+
+//// prog_fill() ////
+// fills one row with the nearest calculated sample above-left of each pixel
+static void prog_fill(void* arg, uint32_t worker, uint32_t task)
+{
+  const prog_t* p = (const prog_t*)arg;
+  const render_t* r = p->r;
+  uint32_t mask = ~(p->step-1);
+  uint32_t* row = r->iterations + (uint64_t)task*r->img_w;
+  const uint32_t* src = r->iterations + (uint64_t)(task & mask)*r->img_w;
+  for (uint32_t img_x=0; img_x<r->img_w; img_x++) {
+    // the samples themselves are left alone, other rows read them
+    if (src == row && (img_x & ~mask) == 0) continue;
+    row[img_x] = src[img_x & mask];
+  }
+}
+
+
 //// main() ////
 int main(int argc, char*argv[])
 {
+  double start = now();
+
   // default values
   char* filename  = FILENAME;
   uint32_t img_w  = IMG_WIDTH;
@@ -65,6 +599,28 @@ int main(int argc, char*argv[])
   double man_cx   = MANDELBROT_CX;
   double man_cy   = MANDELBROT_CY;
   double man_zoom = MANDELBROT_ZOOM;
+  char* kernel_name = NULL;
+  uint32_t nthreads = 0;
+  uint32_t mariani = 0;
+  double period_eps = -1.0;
+  prec_t prec = PREC_AUTO;
+  char* man_cx_str = NULL;
+  char* man_cy_str = NULL;
+  uint64_t max_memory = 0;
+  char* mbi_filename = NULL;
+  uint32_t video_frames = 0;
+  double video_zoom0 = VIDEO_ZOOM0;
+  uint32_t video_fps = VIDEO_FPS;
+  uint32_t progressive = 0;
+  double deadline_ms = 0.0;
+  uint32_t aa_samples = 0;
+  uint32_t mirror_on = 1;
+  uint32_t snap = 0;
+  char* workers = NULL;
+  uint32_t serve_port = 0;
+  char* serve_address = SERVE_ADDRESS;
+  int worker_fd = dist_worker_fd();
+  uint32_t profile = 0;
 
   // parse cmd args
   int curpos = 1;
@@ -85,25 +641,165 @@ int main(int argc, char*argv[])
       niter = strtoul(argv[curpos++], NULL, 0);
     } else if (!strcmp(argv[curpos], "-cx")) {\
       curpos++;
+      man_cx_str = argv[curpos];
       man_cx = strtod(argv[curpos++], NULL);
     } else if (!strcmp(argv[curpos], "-cy")) {\
       curpos++;
+      man_cy_str = argv[curpos];
       man_cy = strtod(argv[curpos++], NULL);
     } else if (!strcmp(argv[curpos], "-z")) {\
       curpos++;
       man_zoom = strtod(argv[curpos++], NULL);
+    } else if (!strcmp(argv[curpos], "-k")) {\
+      curpos++;
+      kernel_name = argv[curpos++];
+    } else if (!strcmp(argv[curpos], "-t")) {\
+      curpos++;
+      nthreads = strtoul(argv[curpos++], NULL, 0);
+    } else if (!strcmp(argv[curpos], "-ms")) {\
+      curpos++;
+      mariani = 1;
+    } else if (!strcmp(argv[curpos], "-p")) {\
+      curpos++;
+      period_eps = strtod(argv[curpos++], NULL);
+    } else if (!strcmp(argv[curpos], "-pt")) {\
+      curpos++;
+      prec = PREC_PERTURB;
+    } else if (!strcmp(argv[curpos], "-dd")) {\
+      curpos++;
+      prec = PREC_DD;
+    } else if (!strcmp(argv[curpos], "-prec")) {\
+      curpos++;
+      if (prec_parse(argv[curpos++], &prec)) usage(argv[0]);
+    } else if (!strcmp(argv[curpos], "-max-memory")) {\
+      curpos++;
+      max_memory = parse_size(argv[curpos++]);
+    } else if (!strcmp(argv[curpos], "-mbi")) {\
+      curpos++;
+      mbi_filename = argv[curpos++];
+    } else if (!strcmp(argv[curpos], "-video")) {\
+      curpos++;
+      video_frames = strtoul(argv[curpos++], NULL, 0);
+    } else if (!strcmp(argv[curpos], "-z0")) {\
+      curpos++;
+      video_zoom0 = strtod(argv[curpos++], NULL);
+    } else if (!strcmp(argv[curpos], "-fps")) {\
+      curpos++;
+      video_fps = strtoul(argv[curpos++], NULL, 0);
+    } else if (!strcmp(argv[curpos], "-progressive")) {\
+      curpos++;
+      progressive = 1;
+    } else if (!strcmp(argv[curpos], "-deadline-ms")) {\
+      curpos++;
+      progressive = 1;
+      deadline_ms = strtod(argv[curpos++], NULL);
+    } else if (!strcmp(argv[curpos], "-aa")) {\
+      curpos++;
+      aa_samples = strtoul(argv[curpos++], NULL, 0);
+      uint32_t grid = (uint32_t)(sqrt((double)aa_samples) + 0.5);
+      if (aa_samples < 4 || aa_samples > 256 || grid*grid != aa_samples) usage(argv[0]);
+    } else if (!strcmp(argv[curpos], "-nm")) {\
+      curpos++;
+      mirror_on = 0;
+    } else if (!strcmp(argv[curpos], "-snap")) {\
+      curpos++;
+      snap = 1;
+    } else if (!strcmp(argv[curpos], "-workers")) {\
+      curpos++;
+      workers = argv[curpos++];
+    } else if (!strcmp(argv[curpos], "-serve")) {\
+      curpos++;
+      serve_port = strtoul(argv[curpos++], NULL, 0);
+    } else if (!strcmp(argv[curpos], "-bind")) {\
+      curpos++;
+      serve_address = argv[curpos++];
+    } else if (!strcmp(argv[curpos], "-profile") || !strcmp(argv[curpos], "--profile")) {\
+      curpos++;
+      profile = 1;
     } else {
       usage(argv[0]);
     }
   }
 
+  // worker daemon, each coordinator connection runs this executable with the coordinator's view
+  if (serve_port) {
+    dist_daemon(serve_address, serve_port, argv[0], nthreads, worker_args);
+    fprintf(stderr, "Can't serve on %s port %u, exiting.\n", serve_address, serve_port);
+    exit(EXIT_FAILURE);
+  }
+  if (workers && (video_frames || progressive || aa_samples)) {
+    fprintf(stderr, "Distributed rendering can't be combined with -video, progressive rendering or -aa, exiting.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (progressive && (mariani || max_memory)) {
+    fprintf(stderr, "Progressive rendering can't be combined with -ms or -max-memory, exiting.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (aa_samples && (progressive || max_memory)) {
+    fprintf(stderr, "Supersampling can't be combined with progressive rendering or -max-memory, exiting.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // move the view by less than half a pixel, so that y = 0 is on a row or halfway between two
+  if (snap) {
+    double pixel = 2.0*man_zoom/(double)img_h;
+    double row0 = (man_zoom - man_cy)/pixel;
+    if (row0 > 0.0 && row0 < (double)img_h) {
+      man_cy = man_zoom - round(2.0*row0)/2.0*pixel;
+      man_cy_str = NULL;
+    }
+  }
+
+  // select numeric policy & escape time kernel
+  uint32_t prec_auto = prec == PREC_AUTO;
+  if (prec_auto) prec = prec_select(man_cx, man_cy, man_zoom, img_w, img_h, niter);
+  const kernel_dbl_t* kernel = NULL;
+  const kernel_flt_t* kernel_flt = NULL;
+  const kernel_dd_t* kernel_dd = NULL;
+  const char* kernel_desc = NULL;
+  uint32_t kernel_lanes = 1;
+  if (prec == PREC_FLOAT && (kernel_flt = kernel_flt_select(kernel_name)) != NULL) {
+    kernel_desc  = kernel_flt->name;
+    kernel_lanes = kernel_flt->lanes;
+  } else if (prec == PREC_DOUBLE && (kernel = kernel_dbl_select(kernel_name)) != NULL) {
+    kernel_desc  = kernel->name;
+    kernel_lanes = kernel->lanes;
+  } else if (prec == PREC_DD && (kernel_dd = kernel_dd_select(kernel_name)) != NULL) {
+    kernel_desc  = kernel_dd->name;
+    kernel_lanes = kernel_dd->lanes;
+  } else if (prec == PREC_PERTURB) {
+    kernel_desc  = "perturbation";
+  } else {
+    fprintf(stderr, "Kernel %s unknown or not supported by this cpu, exiting.\n", kernel_name);
+    exit(EXIT_FAILURE);
+  }
+
   // calculate Mandelbrot coordinates
   double man_x0 = man_cx - (double)img_w/(double)img_h*man_zoom;
   double man_x1 = man_cx + (double)img_w/(double)img_h*man_zoom;
   double man_y0 = man_cy - 1.0*man_zoom;
   double man_y1 = man_cy + 1.0*man_zoom;
 
+  // workers that calculate the Mandelbrot set, tile by tile
+  sched_t* sched = NULL;
+  if ((sched = sched_create(nthreads)) == NULL) {
+    fprintf(stderr, "Can't create worker threads, exiting.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // per-thread counters of the phases, opened on each worker
+  prof_t* prof = NULL;
+  if (profile) {
+    // the render workers, then the workers of the output writer (the same number)
+    if ((prof = prof_create(2*sched_nthreads(sched))) == NULL) {
+      fprintf(stderr, "Can't allocate profile, exiting.\n");
+      exit(EXIT_FAILURE);
+    }
+    sched_each(sched, prof_worker, prof);
+  }
+
   // create a palette of colors
+  prof_phase(prof, "palette");
   rgb_t* palette = NULL;
   if ((palette = (rgb_t*)malloc(niter * sizeof(rgb_t))) == NULL) {
     fprintf(stderr, "Can't allocate palette array, exiting.\n");
@@ -123,80 +819,385 @@ int main(int argc, char*argv[])
     #endif
   }
 
-  // create image array
+  prof_phase(prof, "setup");
+
+  // band height, so that the band iterations & the mapped output rows (or their
+  // buffer) & the iteration field buffer fit into the memory budget, whole image without the budget
+  uint32_t band_h = img_h;
+  if (max_memory) {
+    uint64_t fixed = (uint64_t)img_w*sizeof(double) + (uint64_t)niter*sizeof(rgb_t);
+    uint64_t row   = (uint64_t)img_w*(sizeof(uint32_t) + 3 + (mbi_filename ? mbi_count_bytes(niter) : 0));
+    if (max_memory < fixed + row) {
+      fprintf(stderr, "Memory budget too small for one row of %u pixels, exiting.\n", img_w);
+      exit(EXIT_FAILURE);
+    }
+    uint64_t rows = (max_memory - fixed) / row;
+    // keep bands a multiple of the minimal tile edge, so that tiles stay full
+    if (rows > 16) rows &= ~(uint64_t)15;
+    band_h = rows < img_h ? (uint32_t)rows : img_h;
+  }
+  // workers calculate into the chunk buffers of dist_serve()
+  if (worker_fd >= 0) band_h = 1;
+
+  // create band image array
   uint32_t* iterations = NULL;
-  if ((iterations = (uint32_t*)malloc(img_w*img_h * sizeof(uint32_t))) == NULL) {
+  if ((iterations = (uint32_t*)malloc((size_t)img_w*band_h * sizeof(uint32_t))) == NULL) {
     fprintf(stderr, "Can't allocate iterations array, exiting.\n");
     exit(EXIT_FAILURE);
   }
 
-  // calculate the Mandelbrot set
-  // iterate over all image rows
-  #pragma omp parallel for ordered schedule(dynamic)
-  for (uint32_t img_y=0; img_y<img_h; img_y++) {
-    // convert y image coordinate to Mandelbrot coordinate
-    double man_y = (double)(img_y)/(double)img_h*(man_y1-man_y0) + man_y0;
-    // iterate over all image columns
-    for (uint32_t img_x=0; img_x<img_w; img_x++) {
-      // convert x image coordinate to Mandelbrot coordinate
-      double man_x = (double)(img_x)/(double)img_w*(man_x1-man_x0) + man_x0;
-      // initialize Zn to 0 + i0
-      double zn_x = 0.0;
-      double zn_y = 0.0;
-      // initialize niterations to 0
-      uint32_t niterations = 0;
-      // initialize temporary variables
-      double x2 = 0.0;
-      double y2 = 0.0;
-      while (x2 + y2 <= 4.0 && niterations < niter-1) {
-        zn_y = 2*zn_x*zn_y + man_y;
-        zn_x = x2 - y2 + man_x;
-        x2   = zn_x*zn_x;
-        y2   = zn_y*zn_y;
-        niterations++;
+  // convert x image coordinates to Mandelbrot coordinates (same for all rows)
+  double* man_xs = NULL;
+  if ((man_xs = (double*)malloc(img_w * sizeof(double))) == NULL) {
+    fprintf(stderr, "Can't allocate coordinates array, exiting.\n");
+    exit(EXIT_FAILURE);
+  }
+  for (uint32_t img_x=0; img_x<img_w; img_x++) {
+    man_xs[img_x] = (double)(img_x)/(double)img_w*(man_x1-man_x0) + man_x0;
+  }
+
+  // calculate the Mandelbrot set, tile by tile on all workers
+  stats_t* stats = NULL;
+  if ((stats = (stats_t*)calloc(sched_nthreads(sched), sizeof(stats_t))) == NULL) {
+    fprintf(stderr, "Can't allocate statistics array, exiting.\n");
+    exit(EXIT_FAILURE);
+  }
+  render_t render = {.prec = prec, .kernel = kernel, .kernel_flt = kernel_flt, .man_xs = man_xs, .man_y0 = man_y0, .man_y1 = man_y1,
+                     .img_w = img_w, .img_h = img_h, .niter = niter, .period_eps = period_eps, .iterations = iterations, .mariani = mariani};
+  render.ms.span       = render_span;
+  render.ms.arg        = &render;
+  render.ms.iterations = iterations;
+  render.ms.img_w      = img_w;
+  render.ms.max_iter   = niter-1;
+  render.ms.origin_x   = (0.0-man_x0)/(man_x1-man_x0)*(double)img_w;
+  render.ms.origin_y   = (0.0-man_y0)/(man_y1-man_y0)*(double)img_h;
+  render.stats         = stats;
+  render.dc_x0         = -(double)img_w/(double)img_h*man_zoom;
+  render.dc_y0         = -1.0*man_zoom;
+  render.dc_w          = 2.0*(double)img_w/(double)img_h*man_zoom;
+  render.dc_h          = 2.0*man_zoom;
+  render.man_cx        = man_cx;
+  render.man_cy        = man_cy;
+  if (prec == PREC_DD) {
+    // double-double center
+    render.kernel_dd = kernel_dd;
+    render.cx_hi = man_cx;
+    render.cy_hi = man_cy;
+    if ((man_cx_str && kernel_dd_parse(man_cx_str, &render.cx_hi, &render.cx_lo)) || (man_cy_str && kernel_dd_parse(man_cy_str, &render.cy_hi, &render.cy_lo))) {
+      fprintf(stderr, "Can't parse center coordinates, exiting.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  perturb_t* pt = NULL;
+  if (prec == PREC_PERTURB && workers == NULL) {
+    // reference orbit at the image center, precise to the pixel spacing
+    char cx_buf[32], cy_buf[32];
+    snprintf(cx_buf, sizeof(cx_buf), "%.17g", man_cx);
+    snprintf(cy_buf, sizeof(cy_buf), "%.17g", man_cy);
+    double pixel = render.dc_h/(double)img_h;
+    double dc_max = hypot(render.dc_w, render.dc_h)/2.0;
+    if (video_frames) dc_max *= video_zoom0/man_zoom;
+    if ((pt = perturb_create(man_cx_str ? man_cx_str : cx_buf, man_cy_str ? man_cy_str : cy_buf, pixel, dc_max, niter)) == NULL) {
+      fprintf(stderr, "Can't calculate reference orbit, exiting.\n");
+      exit(EXIT_FAILURE);
+    }
+    render.perturb = pt;
+  }
+  if (video_frames) {
+    // zoom video, the exponential map is rendered once & all frames are resampled from it
+    if (isatty(STDOUT_FILENO)) {
+      fprintf(stderr, "Won't write the video to a terminal, redirect stdout, exiting.\n");
+      exit(EXIT_FAILURE);
+    }
+    expmap_t* em = NULL;
+    if ((em = expmap_create(img_w, img_h, video_zoom0, man_zoom)) == NULL) {
+      fprintf(stderr, "Can't allocate exponential map, exiting.\n");
+      exit(EXIT_FAILURE);
+    }
+    prof_phase(prof, "render");
+    expmap_render(em, sched, render_points, &render);
+    prof_phase(prof, "output");
+    if (expmap_write_y4m(em, sched, stdout, video_frames, video_fps, palette)) {
+      fprintf(stderr, "Can't write video to stdout, exiting.\n");
+      exit(EXIT_FAILURE);
+    }
+    // output stats (stdout is the video)
+    uint32_t n_angle, n_radius;
+    expmap_size(em, &n_angle, &n_radius);
+    fprintf(stderr, "Mandelbrot zoom video with %u frames of %u x %u & %d max iterations.\n", video_frames, img_w, img_h, niter);
+    fprintf(stderr, "Zoom:     % 2.8e  -  % 2.8e\n", video_zoom0, man_zoom);
+    fprintf(stderr, "precision:          %s%s (%u bits needed)\n", prec_name(prec), prec_auto ? " (auto)" : "", prec_bits(man_cx, man_cy, man_zoom, img_w, img_h, niter));
+    fprintf(stderr, "kernel:             %s (%u lanes, %u threads)\n", kernel_desc, kernel_lanes, sched_nthreads(sched));
+    fprintf(stderr, "exponential map:    %u angles x %u radii (%lu points, %.1f frames)\n", n_angle, n_radius, (uint64_t)n_angle*n_radius, (double)n_angle*n_radius/(double)(img_w*img_h));
+    prof_phase(prof, NULL);
+    prof_print(prof, stderr);
+    prof_destroy(prof);
+    expmap_destroy(em);
+    free(stats);
+    free(man_xs);
+    free(iterations);
+    free(palette);
+    perturb_destroy(pt);
+    sched_destroy(sched);
+    exit(EXIT_SUCCESS);
+  }
+  // rows that mirror earlier rows about the real axis, the float, double & double-double
+  // (with the center on the axis) kernels give the same counts for them, the perturbation
+  // reference orbit isn't symmetric in general; Mariani-Silver & progressive rendering
+  // calculate the rows their own way
+  uint32_t* mirror = NULL;
+  if (mirror_on && !mariani && !progressive && workers == NULL && (prec == PREC_FLOAT || prec == PREC_DOUBLE || (prec == PREC_DD && render.cy_hi == 0.0 && render.cy_lo == 0.0))) {
+    double* row_y = NULL;
+    if ((row_y = (double*)malloc(img_h * sizeof(double))) == NULL || (mirror = (uint32_t*)malloc(img_h * sizeof(uint32_t))) == NULL ||
+        (render.row_counts = (uint32_t*)calloc(2*(size_t)img_h, sizeof(uint32_t))) == NULL) {
+      fprintf(stderr, "Can't allocate mirror array, exiting.\n");
+      exit(EXIT_FAILURE);
+    }
+    // the same row coordinates as render_span()
+    for (uint32_t img_y=0; img_y<img_h; img_y++) {
+      row_y[img_y] = prec == PREC_DD ? (double)img_y/(double)img_h*render.dc_h + render.dc_y0 : (double)img_y/(double)img_h*(man_y1-man_y0) + man_y0;
+    }
+    // with -snap, rows within a thousandth of a pixel of the mirror are moved onto it
+    if (mirror_rows(row_y, img_h, snap ? 1e-3*2.0*man_zoom/(double)img_h : 0.0, mirror) == 0) {
+      free(mirror);
+      free(render.row_counts);
+      mirror = NULL;
+      render.row_counts = NULL;
+    }
+    free(row_y);
+    render.mirror = mirror;
+  }
+  if (worker_fd >= 0) {
+    // distributed render worker, calculates the chunks the coordinator asks for until it's done
+    worker_t wk = {&render, sched, render.ms.origin_y};
+    int ret = dist_serve(worker_fd, img_w, img_h, sched_nthreads(sched), render_rows, &wk);
+    prof_destroy(prof);
+    free(stats);
+    free(man_xs);
+    free(mirror);
+    free(render.row_counts);
+    free(iterations);
+    free(palette);
+    perturb_destroy(pt);
+    sched_destroy(sched);
+    exit(ret ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
+  dist_t* dist = NULL;
+  if (workers != NULL) {
+    // distributed render coordinator, the workers get the view arguments (the output,
+    // memory budget, cpu & video ones stay here)
+    char** args = NULL;
+    uint32_t nargs = 0;
+    if ((args = (char**)malloc(argc * sizeof(char*))) == NULL) {
+      fprintf(stderr, "Can't allocate arguments array, exiting.\n");
+      exit(EXIT_FAILURE);
+    }
+    for (int i=1; i<argc; i++) {
+      const worker_opt_t* o = worker_opt(argv[i]);
+      if (o == NULL) {
+        // all the options that stay here but the flags have a value
+        if (strcmp(argv[i], "-progressive") && strcmp(argv[i], "-profile") && strcmp(argv[i], "--profile")) i++;
+        continue;
       }
-      // save number of iterations to iterations array
-      iterations[img_y*img_w+img_x] = niterations;
+      args[nargs++] = argv[i];
+      if (o->has_arg && i+1 < argc) args[nargs++] = argv[++i];
     }
+    if (worker_args(args, nargs)) {
+      fprintf(stderr, "View out of the bounds the workers accept, exiting.\n");
+      exit(EXIT_FAILURE);
+    }
+    if ((dist = dist_connect(workers, args, nargs, img_w, img_h)) == NULL) {
+      fprintf(stderr, "Can't connect to any worker, exiting.\n");
+      exit(EXIT_FAILURE);
+    }
+    free(args);
   }
-
-  // open output image file
-  FILE* fp = NULL;
-  if ((fp  = fopen(filename, "wb")) == NULL) {
-    fprintf(stderr, "Can't open output file " FILENAME ", exiting.\n");
+  uint64_t nmirrored = 0;
+  uint64_t dist_counts[DIST_COUNTS] = {0};
+  stats_t mirrored = {{0, 0}, 0, 0, {0, 0}, {0, 0}};
+  ppm_t* ppm = NULL;
+  if ((ppm = ppm_open(sched, filename, img_w, img_h, palette, niter)) == NULL) {
+    fprintf(stderr, "Can't open output file %s, exiting.\n", filename);
     exit(EXIT_FAILURE);
   }
-
-  // write ppm image header
-  fprintf(fp, "P3\n%d %d\n255\n", img_w, img_h);
-
-  // convert number of iterations to a rgb value and write it to the output image file & collect statistics
-  uint32_t min_iterations = UINT32_MAX;
-  uint32_t max_iterations = 0;
-  uint64_t sum_iterations = 0;
-  for (uint32_t i=0; i<img_w*img_h; i++) {
-    uint32_t niterations = iterations[i];
-    fprintf(fp, "%d %d %d\n", palette[niterations].r, palette[niterations].g, palette[niterations].b);
-    min_iterations = niterations < min_iterations ? niterations : min_iterations;
-    max_iterations = niterations > max_iterations ? niterations : max_iterations;
-    sum_iterations += niterations;
-  }   
-
-  // close output file
-  fclose(fp);
+  mbi_t* mbi = NULL;
+  if (mbi_filename != NULL) {
+    char cx_buf[32], cy_buf[32];
+    snprintf(cx_buf, sizeof(cx_buf), "%.17g", man_cx);
+    snprintf(cy_buf, sizeof(cy_buf), "%.17g", man_cy);
+    mbi_header_t mbi_hdr;
+    mbi_header(&mbi_hdr, img_w, img_h, niter, man_cx_str ? man_cx_str : cx_buf, man_cy_str ? man_cy_str : cy_buf, man_zoom, prec_name(prec));
+    if ((mbi = mbi_create(mbi_filename, &mbi_hdr)) == NULL) {
+      fprintf(stderr, "Can't open output file %s, exiting.\n", mbi_filename);
+      exit(EXIT_FAILURE);
+    }
+  }
+  prof_phase(prof, "render");
+  // the writer's workers color & write out the rows while the bands are rendered, their
+  // counts go to the output phase
+  for (uint32_t i=0; prof != NULL && i<sched_nthreads(sched); i++) prof_thread_phase(prof, sched_nthreads(sched)+i, "output");
+  double origin_y = render.ms.origin_y;
+  uint32_t prog_step = 0;
+  uint32_t prog_late = 0;
+  double prog_ms = 0.0;
+  uint64_t overlapped_rows = 0;
+  for (uint32_t band_y=0; band_y<img_h; band_y+=band_h) {
+    // render the band, convert number of iterations to a rgb value, append it to the output image file & collect statistics
+    uint32_t h = img_h-band_y < band_h ? img_h-band_y : band_h;
+    uint32_t written = 0;
+    render.band_y      = band_y;
+    render.ms.origin_y = origin_y - (double)band_y;
+    if (progressive) {
+      // coarse to fine, each level only calculates the pixels the previous ones don't have,
+      // the first level always completes, so there is something to show
+      prog_t prog = {&render, PROG_STEP, 1, deadline_ms > 0.0 ? start + deadline_ms*1e-3 : 0.0, 0};
+      for (uint32_t step=PROG_STEP; step>0 && !prog.late; step>>=1) {
+        prog.step  = step;
+        prog.first = step == PROG_STEP;
+        sched_run(sched, (h+step-1)/step, prog_row, &prog);
+        if (!prog.late) prog_step = step;
+      }
+      prog_late = prog.late;
+      prog_ms = (now() - start)*1e3;
+      // fill the pixels between the samples of the finest complete level
+      prog.step = prog_step;
+      if (prog_step > 1) sched_run(sched, h, prog_fill, &prog);
+    } else if (dist != NULL) {
+      // on the workers, they copy the mirrored rows of their chunks themselves
+      if (dist_rows(dist, band_y, h, iterations, dist_counts)) {
+        fprintf(stderr, "All workers died, exiting.\n");
+        exit(EXIT_FAILURE);
+      }
+    } else if (aa_samples) {
+      sched_tiles(sched, img_w, h, render_tile, &render);
+      nmirrored += copy_mirrored(&render, band_y, 0, h, iterations, &mirrored);
+    } else {
+      // finished tiles go to the writer thread, which hands the complete rows to its own
+      // workers to color & write out while the rest of the band is calculated
+      out_t out = {ppm, mbi, iterations, &render, band_y, 0, {{0, 0}, 0, 0, {0, 0}, {0, 0}}, NULL, filename, mbi_filename, prof, sched_nthreads(sched), 0};
+      if ((render.writer = writer_create(img_w, h, sched_nthreads(sched), write_rows, &out)) == NULL) {
+        fprintf(stderr, "Can't create writer thread, exiting.\n");
+        exit(EXIT_FAILURE);
+      }
+      sched_tiles(sched, img_w, h, render_tile, &render);
+      uint32_t overlapped = 0;
+      if (writer_finish(render.writer, &overlapped)) {
+        fprintf(stderr, "Can't write output file %s, exiting.\n", out.failed ? out.failed : filename);
+        exit(EXIT_FAILURE);
+      }
+      render.writer = NULL;
+      nmirrored += out.nmirrored;
+      mirrored.interior += out.mirrored.interior;
+      mirrored.periodic += out.mirrored.periodic;
+      overlapped_rows += overlapped;
+      written = 1;
+    }
+    if (aa_samples) {
+      // supersample the edges of the colored image before it's written out
+      ssaa_t aa = {render_subpixels, &render, iterations, img_w, img_h, palette, aa_samples, AA_THRESHOLD, NULL};
+      ssaa_stats_t* aa_stats = NULL;
+      if ((aa_stats = (ssaa_stats_t*)calloc(sched_nthreads(sched), sizeof(ssaa_stats_t))) == NULL) {
+        fprintf(stderr, "Can't allocate statistics array, exiting.\n");
+        exit(EXIT_FAILURE);
+      }
+      if (ppm_color_rows(ppm, sched, iterations, h, &aa.rgb)) {
+        fprintf(stderr, "Can't write output file %s, exiting.\n", filename);
+        exit(EXIT_FAILURE);
+      }
+      if (ssaa_image(&aa, sched, aa_stats)) {
+        fprintf(stderr, "Can't allocate supersampling buffers, exiting.\n");
+        exit(EXIT_FAILURE);
+      }
+      for (uint32_t i=0; i<sched_nthreads(sched); i++) stats[i].aa = aa_stats[i];
+      free(aa_stats);
+    }
+    if (!written && (aa_samples ? ppm_put_rows(ppm, sched, h) : ppm_write_rows(ppm, sched, iterations, h))) {
+      fprintf(stderr, "Can't write output file %s, exiting.\n", filename);
+      exit(EXIT_FAILURE);
+    }
+    if (!written && mbi != NULL && mbi_write_rows(mbi, iterations, h)) {
+      fprintf(stderr, "Can't write output file %s, exiting.\n", mbi_filename);
+      exit(EXIT_FAILURE);
+    }
+  }
+  prof_phase(prof, "output");
+  if (mbi != NULL && mbi_close(mbi)) {
+    fprintf(stderr, "Can't write output file %s, exiting.\n", mbi_filename);
+    exit(EXIT_FAILURE);
+  }
+  ppm_stats_t img_stats;
+  if (ppm_close(ppm, &img_stats)) {
+    fprintf(stderr, "Can't write output file %s, exiting.\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  uint32_t min_iterations = img_stats.min;
+  uint32_t max_iterations = img_stats.max;
+  uint64_t sum_iterations = img_stats.sum;
+  // the copied mirrored rows have the interior & periodic pixels of their sources
+  stats_t total = stats_sum(stats, sched_nthreads(sched));
+  total.interior += mirrored.interior;
+  total.periodic += mirrored.periodic;
+  // the workers' statistics of a distributed render
+  total.interior    += dist_counts[DIST_COUNT_INTERIOR];
+  total.periodic    += dist_counts[DIST_COUNT_PERIODIC];
+  total.ms.computed += dist_counts[DIST_COUNT_COMPUTED];
+  total.ms.filled   += dist_counts[DIST_COUNT_FILLED];
+  total.pt.rebased  += dist_counts[DIST_COUNT_REBASED];
+  total.pt.skipped  += dist_counts[DIST_COUNT_SKIPPED];
+  nmirrored         += dist_counts[DIST_COUNT_MIRRORED];
+  free(stats);
+  free(man_xs);
+  free(mirror);
+  free(render.row_counts);
 
   // deallocate array
   free(iterations);
 
   // output stats
-  printf("Mandelbrot set calculated with %d points & %d max iterations.\n", img_w*img_h, niter);
+  printf("Mandelbrot set calculated with %lu points & %d max iterations.\n", (uint64_t)img_w*img_h, niter);
   printf("X coords: % 2.8e  -  % 2.8e  -  % 2.8e\n", man_x0, man_cx, man_x1);
   printf("Y coords: % 2.8e  -  % 2.8e  -  % 2.8e\n", man_y0, man_cy, man_y1);
   printf("Zoom:     % 2.8e\n", man_zoom);
+  printf("precision:          %s%s (%u bits needed)\n", prec_name(prec), prec_auto ? " (auto)" : "", prec_bits(man_cx, man_cy, man_zoom, img_w, img_h, niter));
+  printf("kernel:             %s (%u lanes, %u threads)\n", kernel_desc, kernel_lanes, sched_nthreads(sched));
+  if (pt != NULL) {
+    printf("reference orbit:    %u iterations, %u bits, %u BLA levels\n", perturb_ref_len(pt), perturb_bits(pt), perturb_bla_levels(pt));
+    printf("rebased orbits:     %lu\n", total.pt.rebased);
+    printf("BLA skipped iter:   %lu (%.2f%%)\n", total.pt.skipped, 100.0*(double)total.pt.skipped/(double)(sum_iterations ? sum_iterations : 1));
+  }
   printf("minimal iterations: %u\n", min_iterations);
   printf("maximal iterations: %u\n", max_iterations);
   printf("all iterations:     %lu\n", sum_iterations);
   printf("average iter/pixel: %f\n", (double)sum_iterations/(double)(img_w*img_h));
+  printf("interior pixels:    %lu (%.2f%%, not iterated)\n", total.interior, 100.0*(double)total.interior/(double)(img_w*img_h));
+  if (period_eps >= 0.0) {
+    printf("periodic pixels:    %lu (stopped early)\n", total.periodic);
+  }
+  if (band_h < img_h) {
+    printf("bands:              %u x %u rows\n", (img_h+band_h-1)/band_h, band_h);
+  }
+  if (progressive) {
+    printf("progressive:        step %u of %u (1 - every pixel) reached in %.1f ms%s\n", prog_step, PROG_STEP, prog_ms, prog_late ? ", deadline hit" : "");
+  }
+  if (dist != NULL) {
+    dist_stats_t ds;
+    dist_stats(dist, &ds);
+    printf("workers:            %u of %u alive, %u chunks (%u reissued, %u duplicated)\n", ds.alive, ds.workers, ds.chunks, ds.reissued, ds.duplicated);
+  }
+  if (overlapped_rows) {
+    printf("overlapped rows:    %lu (%.2f%%, written while rendering)\n", overlapped_rows, 100.0*(double)overlapped_rows/(double)img_h);
+  }
+  if (nmirrored) {
+    printf("mirrored rows:      %lu (%.2f%%, copied)\n", nmirrored, 100.0*(double)nmirrored/(double)img_h);
+  }
+  if (aa_samples) {
+    printf("edge pixels:        %lu (%.2f%%, %u samples)\n", total.aa.pixels, 100.0*(double)total.aa.pixels/(double)(img_w*img_h), aa_samples);
+    printf("extra samples:      %lu (%.2f per pixel)\n", total.aa.samples, (double)total.aa.samples/(double)(img_w*img_h));
+  }
+  if (mariani) {
+    printf("computed pixels:    %lu\n", total.ms.computed);
+    printf("filled pixels:      %lu (%.2f%%)\n", total.ms.filled, 100.0*(double)total.ms.filled/(double)(img_w*img_h));
+  }
 
   // dump clut
   FILE* clut_fp = NULL;
@@ -209,6 +1210,16 @@ int main(int argc, char*argv[])
   }
   fclose(clut_fp);
 
+  // print the profile of the phases
+  prof_phase(prof, NULL);
+  prof_print(prof, stdout);
+  prof_destroy(prof);
+
+  // stop worker threads & disconnect from the workers
+  dist_close(dist);
+  perturb_destroy(pt);
+  sched_destroy(sched);
+
   // exit
   exit(EXIT_SUCCESS);
 }
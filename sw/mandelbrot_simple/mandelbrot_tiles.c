@@ -0,0 +1,506 @@
+// mandelbrot_tiles.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// local XYZ tile server, renders Mandelbrot tiles for web map viewers on demand
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "kernel_dbl.h"
+#include "kernel_flt.h"
+#include "kernel_dd.h"
+#include "prec.h"
+#include "sched.h"
+#include "ppm.h"
+#include "tilecache.h"
+
+
+//// defines ////
+// default port, the server only listens on localhost
+#define PORT            8080U
+// default number of tiles kept in memory
+#define CACHE_TILES     256U
+// default tile cache directory
+#define CACHE_DIR       "tile_cache"
+// tile width & height in pixels
+#define TILE_SIZE       256U
+// default maximum number of iterations
+#define NITERATIONS     256U
+// maximal maximum number of iterations of a request
+#define MAX_NITERATIONS (1U<<20)
+// Mandelbrot coordinates of the level 0 tile (4 x 4, the set in the middle)
+#define LEVEL0_X0       (-2.5)
+#define LEVEL0_Y0       (-2.0)
+#define LEVEL0_SIZE     4.0
+// deepest level, tile coordinates must stay exact in a double
+#define MAX_LEVEL       50U
+// how often a waiting request checks if the client is still there
+#define WAIT_MS         50U
+// maximal length of a request head
+#define REQUEST_MAX     4096U
+
+
+//// types ////
+// server_t
+// shared state of the connection threads & the render thread
+typedef struct {
+  tilecache_t*        cache;
+  const kernel_dbl_t* kernel;
+  const kernel_flt_t* kernel_flt;
+  const kernel_dd_t*  kernel_dd;
+  uint32_t            nthreads;
+} server_t;
+
+// conn_t
+// connection thread arguments
+typedef struct {
+  server_t* srv;
+  int       fd;
+} conn_t;
+
+// tile_render_t
+// shared state of the row tasks of one tile
+typedef struct {
+  const server_t* srv;
+  const tile_t*   t;
+  prec_t          prec;
+  uint32_t        niter;
+  double          x0_hi;      // double-double top left corner
+  double          x0_lo;
+  double          y0_hi;
+  double          y0_lo;
+  double          pixel;
+  uint32_t*       iterations;
+  uint32_t        skipped;    // set when a row was skipped, because the tile was cancelled
+} tile_render_t;
+
+
+//// globals ////
+// set by SIGINT & SIGTERM
+static volatile sig_atomic_t quit = 0;
+
+
+//// usage() ////
+void usage(char* progname)
+{
+  fprintf(stderr, "Usage: %s [-h] [-port port] [-cache-tiles ntiles] [-cache-dir dir] [-k kernel] [-t nthreads]\n", progname);
+  fprintf(stderr, "  -h               - show this help\n");
+  fprintf(stderr, "  -port port       - serve tiles on http://127.0.0.1:port/tiles/level/x/y?n=niterations (default: %u)\n", PORT);
+  fprintf(stderr, "  -cache-tiles n   - keep up to n tiles in memory (default: %u)\n", CACHE_TILES);
+  fprintf(stderr, "  -cache-dir dir   - keep rendered tiles in dir, \"\" - no disk cache (default: %s)\n", CACHE_DIR);
+  fprintf(stderr, "  -k kernel        - force kernel: scalar, sse2, avx2, avx512 (dd: no sse2, default: best supported by the cpu)\n");
+  fprintf(stderr, "  -t nthreads      - set number of render threads to nthreads (default: number of cpus)\n");
+  exit(EXIT_FAILURE);
+}
+
+
+//// on_signal() ////
+// stops the server
+static void on_signal(int sig)
+{
+  quit = 1;
+}
+
+
+//// render_row() ////
+// calculates one tile row, unless nobody waits for the tile anymore
+static void render_row(void* arg, uint32_t worker, uint32_t task)
+{
+  tile_render_t* r = (tile_render_t*)arg;
+  double man_x[TILE_SIZE], man_x_lo[TILE_SIZE];
+  double man_y[TILE_SIZE], man_y_lo[TILE_SIZE];
+  float man_x_flt[TILE_SIZE];
+  float man_y_flt[TILE_SIZE];
+  uint32_t idx[TILE_SIZE];
+  uint32_t iter[TILE_SIZE];
+  uint32_t* out = r->iterations + task*TILE_SIZE;
+  if (tilecache_cancelled(r->t)) {
+    __atomic_store_n(&r->skipped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  // pixel offsets are exact multiples of a power of 2, added to the corner in double-double
+  for (uint32_t i=0; i<TILE_SIZE; i++) {
+    kernel_dd_add_dbl(r->x0_hi, r->x0_lo, (double)i*r->pixel, &man_x[i], &man_x_lo[i]);
+    kernel_dd_add_dbl(r->y0_hi, r->y0_lo, (double)task*r->pixel, &man_y[i], &man_y_lo[i]);
+  }
+  if (r->prec == PREC_DD) {
+    r->srv->kernel_dd->fn(man_x, man_x_lo, man_y, man_y_lo, TILE_SIZE, r->niter, -1.0, out);
+    return;
+  }
+  // points inside the main cardioid or the period-2 bulb are filled in, the rest goes to the kernel
+  uint32_t kn = 0;
+  for (uint32_t i=0; i<TILE_SIZE; i++) {
+    if (kernel_dbl_inside(man_x[i], man_y[i])) {
+      out[i] = r->niter-1;
+    } else {
+      man_x[kn] = man_x[i];
+      man_y[kn] = man_y[i];
+      idx[kn++] = i;
+    }
+  }
+  if (r->prec == PREC_FLOAT) {
+    for (uint32_t k=0; k<kn; k++) {
+      man_x_flt[k] = (float)man_x[k];
+      man_y_flt[k] = (float)man_y[k];
+    }
+    r->srv->kernel_flt->fn(man_x_flt, man_y_flt, kn, r->niter, -1.0, iter);
+  } else {
+    r->srv->kernel->fn(man_x, man_y, kn, r->niter, -1.0, iter);
+  }
+  for (uint32_t k=0; k<kn; k++) out[idx[k]] = iter[k];
+}
+
+
+//// tile_prec() ////
+// returns the cheapest policy precise enough for the tile, PREC_PERTURB if it's too deep
+static prec_t tile_prec(const tile_key_t* key)
+{
+  double size = LEVEL0_SIZE/(double)(1ULL << key->level);
+  double cx = LEVEL0_X0 + ((double)key->x + 0.5)*size;
+  double cy = LEVEL0_Y0 + ((double)key->y + 0.5)*size;
+  return prec_select(cx, cy, size/2.0, TILE_SIZE, TILE_SIZE, key->niter);
+}
+
+
+//// render_main() ////
+// render thread, renders the newest queued tile until the server stops
+static void* render_main(void* arg)
+{
+  server_t* srv = (server_t*)arg;
+  char head[64];
+  int head_len = snprintf(head, sizeof(head), "P6\n%u %u\n255\n", TILE_SIZE, TILE_SIZE);
+  uint32_t npixels = TILE_SIZE*TILE_SIZE;
+  uint32_t* iterations = NULL;
+  rgb_t* palette = NULL;
+  uint32_t palette_niter = 0;
+  sched_t* sched = NULL;
+  // the render thread is worker 0 of its own pool
+  if ((sched = sched_create(srv->nthreads)) == NULL || (iterations = (uint32_t*)malloc(npixels*sizeof(uint32_t))) == NULL) {
+    fprintf(stderr, "Can't create render threads, exiting.\n");
+    exit(EXIT_FAILURE);
+  }
+  tile_key_t key;
+  tile_t* tile = NULL;
+  while ((tile = tilecache_next(srv->cache, &key)) != NULL) {
+    // palette of the requested number of iterations, as in mandelbrot_simple
+    if (palette_niter != key.niter) {
+      free(palette);
+      if ((palette = (rgb_t*)malloc(key.niter*sizeof(rgb_t))) == NULL) {
+        fprintf(stderr, "Can't allocate palette array, exiting.\n");
+        exit(EXIT_FAILURE);
+      }
+      for (uint32_t i=0; i<key.niter; i++) {
+        double t = (double)i/NITERATIONS;
+        palette[i].r = (9.0*(1-t)*t*t*t*255.0);
+        palette[i].g = (15.0*(1-t)*(1-t)*t*t*255.0);
+        palette[i].b = (8.5*(1-t)*(1-t)*(1-t)*t*255.0);
+      }
+      palette_niter = key.niter;
+    }
+    // tile corner, the tile offset is exact in double (x < 2^MAX_LEVEL)
+    double size = LEVEL0_SIZE/(double)(1ULL << key.level);
+    tile_render_t r = {.srv = srv, .t = tile, .prec = tile_prec(&key), .niter = key.niter};
+    kernel_dd_add_dbl(LEVEL0_X0, 0.0, (double)key.x*size, &r.x0_hi, &r.x0_lo);
+    kernel_dd_add_dbl(LEVEL0_Y0, 0.0, (double)key.y*size, &r.y0_hi, &r.y0_lo);
+    r.pixel      = size/(double)TILE_SIZE;
+    r.iterations = iterations;
+    sched_run(sched, TILE_SIZE, render_row, &r);
+    // color it, cancelled tiles are handed back without data
+    uint8_t* data = NULL;
+    if (!r.skipped && (data = (uint8_t*)malloc(head_len + 3*npixels)) != NULL) {
+      memcpy(data, head, head_len);
+      uint8_t* rgb = data + head_len;
+      for (uint32_t i=0; i<npixels; i++) {
+        rgb[3*i+0] = palette[iterations[i]].r;
+        rgb[3*i+1] = palette[iterations[i]].g;
+        rgb[3*i+2] = palette[iterations[i]].b;
+      }
+    }
+    tilecache_done(srv->cache, tile, data, data ? head_len + 3*npixels : 0);
+  }
+  sched_destroy(sched);
+  free(iterations);
+  free(palette);
+  return NULL;
+}
+
+
+//// send_all() ////
+// sends the whole buffer, returns 0 on success
+static int send_all(int fd, const void* buf, size_t len)
+{
+  const uint8_t* p = (const uint8_t*)buf;
+  while (len) {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    p   += n;
+    len -= n;
+  }
+  return 0;
+}
+
+
+//// send_text() ////
+// sends a plain text response
+static void send_text(int fd, const char* status, const char* text)
+{
+  char head[256];
+  int n = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: text/plain\r\nContent-Length: %u\r\nConnection: close\r\n\r\n", status, (uint32_t)strlen(text));
+  if (send_all(fd, head, n) == 0) send_all(fd, text, strlen(text));
+}
+
+
+//// client_gone() ////
+// checks if the client closed the connection (or reset it)
+static int client_gone(int fd)
+{
+  struct pollfd pfd = {fd, POLLIN, 0};
+  char c;
+  if (poll(&pfd, 1, 0) <= 0) return 0;
+  if (pfd.revents & (POLLERR | POLLHUP)) return 1;
+  // readable: either the end of the stream or more (ignored) data
+  ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  return n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+}
+
+
+//// serve_tile() ////
+// serves one tile, waits for it as long as the client is there
+static void serve_tile(server_t* srv, int fd, const tile_key_t* key)
+{
+  tile_t* t = NULL;
+  if ((t = tilecache_get(srv->cache, key)) == NULL) {
+    send_text(fd, "503 Service Unavailable", "Out of memory.\n");
+    return;
+  }
+  const uint8_t* data = NULL;
+  uint32_t len = 0;
+  int ret = 0;
+  while ((ret = tilecache_wait(srv->cache, t, WAIT_MS, &data, &len)) == 0 && !client_gone(fd));
+  if (ret == 1) {
+    char head[256];
+    int n = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Type: image/x-portable-pixmap\r\nContent-Length: %u\r\nCache-Control: max-age=86400\r\nConnection: close\r\n\r\n", len);
+    if (send_all(fd, head, n) == 0) send_all(fd, data, len);
+  } else if (ret < 0) {
+    send_text(fd, "503 Service Unavailable", "Shutting down.\n");
+  }
+  // the tile is cancelled if the client went away & nobody else waits for it
+  tilecache_release(srv->cache, t);
+}
+
+
+//// serve_stats() ////
+// serves the cache statistics
+static void serve_stats(server_t* srv, int fd)
+{
+  tilecache_stats_t st;
+  char text[1024];
+  tilecache_stats(srv->cache, &st);
+  snprintf(text, sizeof(text),
+    "memory hits:        %lu\n"
+    "disk hits:          %lu\n"
+    "coalesced:          %lu\n"
+    "rendered:           %lu\n"
+    "cancelled:          %lu\n"
+    "evicted:            %lu\n"
+    "tiles in memory:    %u\n"
+    "queued tiles:       %u\n",
+    st.mem_hits, st.disk_hits, st.coalesced, st.rendered, st.cancelled, st.evicted, st.tiles, st.queued);
+  send_text(fd, "200 OK", text);
+}
+
+
+//// parse_tile() ////
+// parses the level/x/y of a tile path into key, returns the rest of the path or NULL
+static const char* parse_tile(const char* path, tile_key_t* key)
+{
+  int pos = 0;
+  char* end = NULL;
+  if (sscanf(path, "/tiles/%u/%n", &key->level, &pos) != 1 || pos == 0 || !isdigit((unsigned char)path[pos])) return NULL;
+  key->x = strtoull(path+pos, &end, 10);
+  if (*end != '/' || !isdigit((unsigned char)end[1])) return NULL;
+  key->y = strtoull(end+1, &end, 10);
+  return end;
+}
+
+
+//// conn_main() ////
+// connection thread, serves one request
+static void* conn_main(void* arg)
+{
+  conn_t* conn = (conn_t*)arg;
+  server_t* srv = conn->srv;
+  int fd = conn->fd;
+  free(conn);
+  // read the request head
+  char req[REQUEST_MAX];
+  uint32_t len = 0;
+  while (len < REQUEST_MAX-1) {
+    ssize_t n = recv(fd, req+len, REQUEST_MAX-1-len, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    len += n;
+    req[len] = '\0';
+    if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+  }
+  req[len] = '\0';
+  // GET /tiles/level/x/y?n=niterations
+  char path[1024];
+  tile_key_t key = {0, 0, 0, NITERATIONS};
+  const char* q = NULL;
+  if (sscanf(req, "GET %1023s HTTP/", path) != 1) {
+    send_text(fd, "400 Bad Request", "Bad request.\n");
+  } else if (!strcmp(path, "/stats")) {
+    serve_stats(srv, fd);
+  } else if ((q = parse_tile(path, &key)) == NULL) {
+    send_text(fd, "404 Not Found", "Not found, tiles are at /tiles/level/x/y?n=niterations.\n");
+  } else {
+    if (!strncmp(q, ".ppm", 4)) q += 4;
+    if (!strncmp(q, "?n=", 3)) key.niter = strtoul(q+3, NULL, 10);
+    if (key.level > MAX_LEVEL || key.x >= (1ULL << key.level) || key.y >= (1ULL << key.level) || key.niter < 2 || key.niter > MAX_NITERATIONS) {
+      send_text(fd, "400 Bad Request", "Tile or number of iterations out of range.\n");
+    } else if (tile_prec(&key) == PREC_PERTURB) {
+      send_text(fd, "400 Bad Request", "Tile too deep for the double-double kernels.\n");
+    } else {
+      serve_tile(srv, fd, &key);
+    }
+  }
+  close(fd);
+  return NULL;
+}
+
+
+//// main() ////
+int main(int argc, char*argv[])
+{
+  // default values
+  uint32_t port = PORT;
+  uint32_t cache_tiles = CACHE_TILES;
+  char* cache_dir = CACHE_DIR;
+  char* kernel_name = NULL;
+  uint32_t nthreads = 0;
+
+  // parse cmd args
+  int curpos = 1;
+  while (curpos < argc) {
+    if        (!strcmp(argv[curpos], "-h")) {
+      usage(argv[0]);
+    } else if (!strcmp(argv[curpos], "-port")) {\
+      curpos++;
+      port = strtoul(argv[curpos++], NULL, 0);
+    } else if (!strcmp(argv[curpos], "-cache-tiles")) {\
+      curpos++;
+      cache_tiles = strtoul(argv[curpos++], NULL, 0);
+    } else if (!strcmp(argv[curpos], "-cache-dir")) {\
+      curpos++;
+      cache_dir = argv[curpos++];
+    } else if (!strcmp(argv[curpos], "-k")) {\
+      curpos++;
+      kernel_name = argv[curpos++];
+    } else if (!strcmp(argv[curpos], "-t")) {\
+      curpos++;
+      nthreads = strtoul(argv[curpos++], NULL, 0);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (port == 0 || port > 65535) usage(argv[0]);
+
+  // select escape time kernels, the precision is picked per tile
+  server_t srv = {NULL, kernel_dbl_select(kernel_name), kernel_flt_select(kernel_name), kernel_dd_select(kernel_name), nthreads};
+  if (srv.kernel == NULL || srv.kernel_flt == NULL || srv.kernel_dd == NULL) {
+    fprintf(stderr, "Kernel %s unknown or not supported by this cpu, exiting.\n", kernel_name);
+    exit(EXIT_FAILURE);
+  }
+
+  // create tile cache
+  if ((srv.cache = tilecache_create(cache_tiles, *cache_dir ? cache_dir : NULL)) == NULL) {
+    fprintf(stderr, "Can't create tile cache %s, exiting.\n", cache_dir);
+    exit(EXIT_FAILURE);
+  }
+
+  // listen on localhost only
+  int lfd = -1;
+  int one = 1;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if ((lfd = socket(AF_INET, SOCK_STREAM, 0)) < 0 || setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+      bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) || listen(lfd, 64)) {
+    fprintf(stderr, "Can't listen on port %u, exiting.\n", port);
+    exit(EXIT_FAILURE);
+  }
+
+  // clients going away are handled where they are written to, SIGINT & SIGTERM stop the server
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = SIG_IGN;
+  sigaction(SIGPIPE, &sa, NULL);
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  // start render thread
+  pthread_t render_thread;
+  if (pthread_create(&render_thread, NULL, render_main, &srv)) {
+    fprintf(stderr, "Can't create render thread, exiting.\n");
+    exit(EXIT_FAILURE);
+  }
+  printf("Serving tiles on http://127.0.0.1:%u/tiles/{z}/{x}/{y}?n=%u\n", port, NITERATIONS);
+  fflush(stdout);
+
+  // serve each connection on its own thread
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  while (!quit) {
+    int fd = accept(lfd, NULL, NULL);
+    if (fd < 0) continue;
+    conn_t* conn = NULL;
+    pthread_t thread;
+    if ((conn = (conn_t*)malloc(sizeof(conn_t))) == NULL) {
+      close(fd);
+      continue;
+    }
+    conn->srv = &srv;
+    conn->fd  = fd;
+    if (pthread_create(&thread, &attr, conn_main, conn)) {
+      free(conn);
+      close(fd);
+    }
+  }
+  pthread_attr_destroy(&attr);
+  close(lfd);
+
+  // stop render thread, waiting requests get an error
+  tilecache_shutdown(srv.cache);
+  pthread_join(render_thread, NULL);
+
+  // print stats
+  tilecache_stats_t st;
+  tilecache_stats(srv.cache, &st);
+  printf("memory hits:        %lu\n", st.mem_hits);
+  printf("disk hits:          %lu\n", st.disk_hits);
+  printf("coalesced:          %lu\n", st.coalesced);
+  printf("rendered:           %lu\n", st.rendered);
+  printf("cancelled:          %lu\n", st.cancelled);
+  printf("evicted:            %lu\n", st.evicted);
+
+  // exit, connection threads may still hold tiles, so the cache isn't freed
+  exit(EXIT_SUCCESS);
+}
+
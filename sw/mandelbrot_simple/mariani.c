@@ -0,0 +1,139 @@
+// mariani.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// Mariani-Silver rectangle subdivision
+// the border of a rectangle is traced first; if the whole border has the same
+// iteration count, the escape time bands (and the set itself) being simply
+// connected means the inside has the same count, so it's filled, otherwise the
+// rectangle is split in half and both halves are processed the same way
+// NOTE: the border is only sampled at pixel centers, so an escaping filament thinner
+// than a pixel can cross it unnoticed; a rectangle is therefore only filled when the
+// rings just inside the border (MARIANI_RINGS in all) have the same count too, and
+// small rectangles are never filled, which makes -ms match brute
+// force on the views of interesting_points.sh (see ms_check.sh), but it's still not
+// a proof for arbitrary views
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "mariani.h"
+
+
+//// defines ////
+// rectangles with a smaller edge are calculated pixel by pixel
+#define MARIANI_MIN_EDGE  6U
+// number of pixels calculated at once when tracing a column
+#define MARIANI_CHUNK     256U
+// number of uniform rings (the border & the rings inside it) needed to fill a rectangle
+#define MARIANI_RINGS     3U
+
+
+//// mariani_row() ////
+// calculates w pixels of row y, starting at x
+static void mariani_row(const mariani_t* m, uint32_t worker, uint32_t x, uint32_t y, uint32_t w, mariani_stats_t* stats)
+{
+  if (w == 0) return;
+  m->span(m->arg, worker, x, y, 1, 0, w, m->iterations+(uint64_t)y*m->img_w+x);
+  stats->computed += w;
+}
+
+
+//// mariani_col() ////
+// calculates h pixels of column x, starting at y
+static void mariani_col(const mariani_t* m, uint32_t worker, uint32_t x, uint32_t y, uint32_t h, mariani_stats_t* stats)
+{
+  uint32_t buf[MARIANI_CHUNK];
+  for (uint32_t i=0; i<h; i+=MARIANI_CHUNK) {
+    uint32_t n = h-i < MARIANI_CHUNK ? h-i : MARIANI_CHUNK;
+    m->span(m->arg, worker, x, y+i, 0, 1, n, buf);
+    for (uint32_t j=0; j<n; j++) m->iterations[(uint64_t)(y+i+j)*m->img_w+x] = buf[j];
+  }
+  stats->computed += h;
+}
+
+
+//// mariani_uniform() ////
+// checks if the border of the rectangle has a single iteration count
+static int mariani_uniform(const mariani_t* m, uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+  const uint32_t* top    = m->iterations + (uint64_t)y*m->img_w;
+  const uint32_t* bottom = m->iterations + (uint64_t)(y+h-1)*m->img_w;
+  uint32_t v = top[x];
+  for (uint32_t i=x; i<x+w; i++) {
+    if (top[i] != v || bottom[i] != v) return 0;
+  }
+  for (uint32_t j=y+1; j<y+h-1; j++) {
+    const uint32_t* row = m->iterations + (uint64_t)j*m->img_w;
+    if (row[x] != v || row[x+w-1] != v) return 0;
+  }
+  // a border around c = 0 with an escape count may be a loop around the whole set
+  if (v != m->max_iter && m->origin_x > x && m->origin_x < x+w-1 && m->origin_y > y && m->origin_y < y+h-1) return 0;
+  return 1;
+}
+
+
+//// mariani_split() ////
+// processes a rectangle with an already calculated border
+static void mariani_split(const mariani_t* m, uint32_t worker, uint32_t x, uint32_t y, uint32_t w, uint32_t h, mariani_stats_t* stats)
+{
+  if (w <= 2 || h <= 2) return;
+  // small rectangle - calculate the inside, a uniform border this close to
+  // a boundary of the set is too often crossed by an escaping pixel
+  if (w <= MARIANI_MIN_EDGE || h <= MARIANI_MIN_EDGE) {
+    for (uint32_t j=y+1; j<y+h-1; j++) mariani_row(m, worker, x+1, j, w-2, stats);
+    return;
+  }
+  // uniform border - trace the rings just inside it as well, an escaping filament that
+  // slips between the pixels of one ring nearly always shows up on the next one; the
+  // inside is only filled when MARIANI_RINGS rings all have the same count
+  uint32_t v = m->iterations[(uint64_t)y*m->img_w+x];
+  for (uint32_t ring=1; mariani_uniform(m, x, y, w, h) && m->iterations[(uint64_t)y*m->img_w+x] == v; ring++) {
+    if (ring == MARIANI_RINGS) {
+      for (uint32_t j=y+1; j<y+h-1; j++) {
+        uint32_t* row = m->iterations + (uint64_t)j*m->img_w;
+        for (uint32_t i=x+1; i<x+w-1; i++) row[i] = v;
+      }
+      stats->filled += (uint64_t)(w-2)*(h-2);
+      return;
+    }
+    if (w <= 4 || h <= 4) {
+      for (uint32_t j=y+1; j<y+h-1; j++) mariani_row(m, worker, x+1, j, w-2, stats);
+      return;
+    }
+    mariani_row(m, worker, x+1, y+1, w-2, stats);
+    mariani_row(m, worker, x+1, y+h-2, w-2, stats);
+    mariani_col(m, worker, x+1, y+2, h-4, stats);
+    mariani_col(m, worker, x+w-2, y+2, h-4, stats);
+    x++; y++; w-=2; h-=2;
+  }
+  // split along the longer edge
+  if (w >= h) {
+    uint32_t mx = x + w/2;
+    mariani_col(m, worker, mx, y+1, h-2, stats);
+    mariani_split(m, worker, x,  y, mx-x+1, h, stats);
+    mariani_split(m, worker, mx, y, x+w-mx, h, stats);
+  } else {
+    uint32_t my = y + h/2;
+    mariani_row(m, worker, x+1, my, w-2, stats);
+    mariani_split(m, worker, x, y,  w, my-y+1, stats);
+    mariani_split(m, worker, x, my, w, y+h-my, stats);
+  }
+}
+
+
+//// mariani_rect() ////
+void mariani_rect(const mariani_t* m, uint32_t worker, uint32_t x, uint32_t y, uint32_t w, uint32_t h, mariani_stats_t* stats)
+{
+  // trace the border
+  mariani_row(m, worker, x, y, w, stats);
+  if (h > 1) mariani_row(m, worker, x, y+h-1, w, stats);
+  if (h > 2) {
+    mariani_col(m, worker, x, y+1, h-2, stats);
+    if (w > 1) mariani_col(m, worker, x+w-1, y+1, h-2, stats);
+  }
+  // process the inside
+  mariani_split(m, worker, x, y, w, h, stats);
+}
+
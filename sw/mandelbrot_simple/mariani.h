@@ -0,0 +1,47 @@
+// mariani.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// Mariani-Silver rectangle subdivision
+
+
+#ifndef __MARIANI_H__
+#define __MARIANI_H__
+
+
+//// includes ////
+#include <stdint.h>
+
+
+//// types ////
+// mariani_span_fn
+// calculates number of iterations for n pixels starting at (img_x, img_y) & stepping
+// by (dx, dy) on the given worker, results are written to out[0] .. out[n-1]
+typedef void (*mariani_span_fn)(void* arg, uint32_t worker, uint32_t img_x, uint32_t img_y, uint32_t dx, uint32_t dy, uint32_t n, uint32_t* out);
+
+// mariani_t
+// subdivision parameters
+typedef struct {
+  mariani_span_fn span;       // pixel calculation function
+  void*           arg;        // argument of span
+  uint32_t*       iterations; // image iterations array
+  uint32_t        img_w;      // image width (iterations array stride)
+  uint32_t        max_iter;   // iteration count of points inside the set
+  double          origin_x;   // position of c = 0 in image coordinates; a rectangle
+  double          origin_y;   //   around it may enclose the whole set, so it's only
+                              //   filled with the count of points inside the set
+} mariani_t;
+
+// mariani_stats_t
+// subdivision statistics
+typedef struct {
+  uint64_t computed;          // number of pixels iterated
+  uint64_t filled;            // number of pixels filled from the rectangle border
+} mariani_stats_t;
+
+
+//// functions ////
+// calculates a rectangle of the image with Mariani-Silver subdivision
+void mariani_rect(const mariani_t* m, uint32_t worker, uint32_t x, uint32_t y, uint32_t w, uint32_t h, mariani_stats_t* stats);
+
+
+#endif // __MARIANI_H__
+
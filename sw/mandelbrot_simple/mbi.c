@@ -0,0 +1,178 @@
+// mbi.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// iteration field files (.mbi): view parameters & raw iteration counts, for recoloring without recalculation
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mbi.h"
+
+
+//// types ////
+// mbi_s
+// iteration field file open for writing
+struct mbi_s {
+  int          fd;
+  mbi_header_t h;
+  uint32_t     row;         // next row to write
+  int          ok;          // no write error so far
+};
+
+
+//// mbi_count_bytes() ////
+uint32_t mbi_count_bytes(uint32_t niter)
+{
+  if (niter <= 0x100U)   return 1;
+  if (niter <= 0x10000U) return 2;
+  return 4;
+}
+
+
+//// mbi_header() ////
+void mbi_header(mbi_header_t* h, uint32_t img_w, uint32_t img_h, uint32_t niter, const char* cx, const char* cy, double zoom, const char* prec)
+{
+  memset(h, 0, sizeof(mbi_header_t));
+  memcpy(h->magic, MBI_MAGIC, 4);
+  h->hdr_size    = MBI_HDR_SIZE;
+  h->img_w       = img_w;
+  h->img_h       = img_h;
+  h->niter       = niter;
+  h->count_bytes = mbi_count_bytes(niter);
+  h->zoom        = zoom;
+  snprintf(h->cx, sizeof(h->cx), "%s", cx);
+  snprintf(h->cy, sizeof(h->cy), "%s", cy);
+  snprintf(h->prec, sizeof(h->prec), "%s", prec);
+}
+
+
+//// mbi_out() ////
+// writes len bytes at offset off
+static int mbi_out(int fd, const void* data, uint64_t len, uint64_t off)
+{
+  for (uint64_t done=0; done<len; ) {
+    ssize_t n = pwrite(fd, (const uint8_t*)data+done, len-done, (off_t)(off+done));
+    if (n <= 0) return -1;
+    done += (uint64_t)n;
+  }
+  return 0;
+}
+
+
+//// mbi_create() ////
+mbi_t* mbi_create(const char* filename, const mbi_header_t* h)
+{
+  mbi_t* m = NULL;
+  if ((m = (mbi_t*)calloc(1, sizeof(mbi_t))) == NULL) return NULL;
+  if ((m->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+    free(m);
+    return NULL;
+  }
+  m->h  = *h;
+  m->ok = 1;
+  if (mbi_out(m->fd, h, sizeof(mbi_header_t), 0)) {
+    close(m->fd);
+    free(m);
+    return NULL;
+  }
+  return m;
+}
+
+
+//// mbi_write_rows() ////
+int mbi_write_rows(mbi_t* m, const uint32_t* iterations, uint32_t nrows)
+{
+  if (nrows > m->h.img_h - m->row) return -1;
+  uint64_t n = (uint64_t)m->h.img_w*nrows;
+  uint64_t off = m->h.hdr_size + (uint64_t)m->h.count_bytes*m->h.img_w*m->row;
+  m->row += nrows;
+  if (m->h.count_bytes == 4) {
+    if (mbi_out(m->fd, iterations, 4*n, off)) m->ok = 0;
+    return m->ok ? 0 : -1;
+  }
+  // narrow the counts
+  void* buf = NULL;
+  if ((buf = malloc(m->h.count_bytes*n)) == NULL) {
+    m->ok = 0;
+    return -1;
+  }
+  if (m->h.count_bytes == 1) {
+    for (uint64_t i=0; i<n; i++) ((uint8_t*)buf)[i] = (uint8_t)iterations[i];
+  } else {
+    for (uint64_t i=0; i<n; i++) ((uint16_t*)buf)[i] = (uint16_t)iterations[i];
+  }
+  if (mbi_out(m->fd, buf, m->h.count_bytes*n, off)) m->ok = 0;
+  free(buf);
+  return m->ok ? 0 : -1;
+}
+
+
+//// mbi_close() ////
+int mbi_close(mbi_t* m)
+{
+  int ret = m->ok && m->row == m->h.img_h ? 0 : -1;
+  if (close(m->fd)) ret = -1;
+  free(m);
+  return ret;
+}
+
+
+//// mbi_map() ////
+const uint8_t* mbi_map(const char* filename, mbi_header_t* h, size_t* size)
+{
+  int fd = -1;
+  if ((fd = open(filename, O_RDONLY)) < 0) return NULL;
+  struct stat st;
+  if (fstat(fd, &st) || (size_t)st.st_size < sizeof(mbi_header_t)) {
+    close(fd);
+    return NULL;
+  }
+  uint8_t* map = (uint8_t*)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return NULL;
+  // check the header & that the file holds all the counts
+  memcpy(h, map, sizeof(mbi_header_t));
+  uint64_t need = h->hdr_size + (uint64_t)h->count_bytes*h->img_w*h->img_h;
+  if (memcmp(h->magic, MBI_MAGIC, 4) || h->hdr_size < sizeof(mbi_header_t) || h->niter == 0 ||
+      (h->count_bytes != 1 && h->count_bytes != 2 && h->count_bytes != 4) || (uint64_t)st.st_size < need) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+  h->cx[sizeof(h->cx)-1] = 0;
+  h->cy[sizeof(h->cy)-1] = 0;
+  h->prec[sizeof(h->prec)-1] = 0;
+  *size = st.st_size;
+  return map;
+}
+
+
+//// mbi_unmap() ////
+void mbi_unmap(const uint8_t* map, size_t size)
+{
+  munmap((void*)map, size);
+}
+
+
+//// mbi_unpack() ////
+void mbi_unpack(const mbi_header_t* h, const uint8_t* map, uint64_t first, uint64_t n, uint32_t* iterations)
+{
+  // counts past niter-1 (damaged files) are clamped, so they can index a palette of niter colors
+  const uint8_t* counts = map + h->hdr_size + (uint64_t)h->count_bytes*first;
+  uint32_t last = h->niter-1;
+  if (h->count_bytes == 1) {
+    for (uint64_t i=0; i<n; i++) iterations[i] = counts[i] < last ? counts[i] : last;
+  } else if (h->count_bytes == 2) {
+    const uint16_t* c = (const uint16_t*)counts;
+    for (uint64_t i=0; i<n; i++) iterations[i] = c[i] < last ? c[i] : last;
+  } else {
+    const uint32_t* c = (const uint32_t*)counts;
+    for (uint64_t i=0; i<n; i++) iterations[i] = c[i] < last ? c[i] : last;
+  }
+}
+
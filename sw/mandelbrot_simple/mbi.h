@@ -0,0 +1,72 @@
+// mbi.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// iteration field files (.mbi): view parameters & raw iteration counts, for recoloring without recalculation
+
+
+#ifndef __MBI_H__
+#define __MBI_H__
+
+
+//// includes ////
+#include <stddef.h>
+#include <stdint.h>
+
+
+//// defines ////
+// file magic
+#define MBI_MAGIC       "MBI1"
+// header size, the iteration counts follow it row by row
+#define MBI_HDR_SIZE    256U
+
+
+//// types ////
+// mbi_header_t
+// file header, stored as is (little-endian)
+typedef struct {
+  char     magic[4];          // MBI_MAGIC
+  uint32_t hdr_size;          // header size (MBI_HDR_SIZE)
+  uint32_t img_w;             // image width
+  uint32_t img_h;             // image height
+  uint32_t niter;             // maximum number of iterations
+  uint32_t count_bytes;       // bytes per iteration count (1, 2 or 4)
+  double   zoom;              // Mandelbrot zoom
+  char     cx[64];            // Mandelbrot center x coordinate, as given (full precision)
+  char     cy[64];            // Mandelbrot center y coordinate, as given (full precision)
+  char     prec[16];          // numeric policy the counts were calculated with
+  uint8_t  reserved[MBI_HDR_SIZE-4-5*4-8-64-64-16];
+} mbi_header_t;
+
+// mbi_t
+// opaque iteration field file open for writing, filled top to bottom a band of rows at a time
+typedef struct mbi_s mbi_t;
+
+
+//// functions ////
+// returns the smallest count size (in bytes) that holds counts up to niter-1
+uint32_t mbi_count_bytes(uint32_t niter);
+
+// fills in the header for a view
+void mbi_header(mbi_header_t* h, uint32_t img_w, uint32_t img_h, uint32_t niter, const char* cx, const char* cy, double zoom, const char* prec);
+
+// creates the iteration field file, returns NULL on error
+mbi_t* mbi_create(const char* filename, const mbi_header_t* h);
+
+// appends nrows rows of iterations, returns 0 on success
+int mbi_write_rows(mbi_t* m, const uint32_t* iterations, uint32_t nrows);
+
+// closes the file, returns 0 if all rows were written
+int mbi_close(mbi_t* m);
+
+// maps an iteration field file for reading & checks its header, returns the start of
+// the mapping (the counts are at hdr_size) or NULL on error
+const uint8_t* mbi_map(const char* filename, mbi_header_t* h, size_t* size);
+
+// unmaps a file mapped with mbi_map()
+void mbi_unmap(const uint8_t* map, size_t size);
+
+// converts n counts starting at pixel first to 32-bit iterations (at most niter-1)
+void mbi_unpack(const mbi_header_t* h, const uint8_t* map, uint64_t first, uint64_t n, uint32_t* iterations);
+
+
+#endif // __MBI_H__
+
@@ -0,0 +1,191 @@
+// mbi_recolor.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// colors an iteration field file (.mbi) with a palette or a clut, without recalculating the Mandelbrot set
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "sched.h"
+#include "ppm.h"
+#include "mbi.h"
+
+
+//// defines ////
+// use grayscale palette
+//#define PALETTE_GREYSCALE
+// default input filename
+#define INFILENAME      "mandelbrot.mbi"
+// default output filename
+#define OUTFILENAME     "mandelbrot.ppm"
+// palette length the default palette is stretched over
+#define NITERATIONS     256U
+// number of pixels colored at once
+#define BAND_PIXELS     (1U<<20)
+
+
+//// usage() ////
+void usage(char* progname)
+{
+  fprintf(stderr, "Usage: %s [-h] [-i input.mbi] [-o output.ppm] [-c clut.hex] [-t nthreads]\n", progname);
+  fprintf(stderr, "  -h               - show this help\n");
+  fprintf(stderr, "  -i input.mbi     - read iteration field from input.mbi (default: %s)\n", INFILENAME);
+  fprintf(stderr, "  -o output.ppm    - write output image to output.ppm (.png - png, .dzi - Deep Zoom pyramid of png tiles, otherwise binary ppm, default: %s)\n", OUTFILENAME);
+  fprintf(stderr, "  -c clut.hex      - color with clut.hex (one rrggbb color per line, repeated over the iterations, default: mandelbrot_simple palette)\n");
+  fprintf(stderr, "  -t nthreads      - set number of worker threads to nthreads (default: number of cpus)\n");
+  exit(EXIT_FAILURE);
+}
+
+
+//// now() ////
+// returns monotonic time in seconds
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec*1e-9;
+}
+
+
+//// main() ////
+int main(int argc, char*argv[])
+{
+  // default values
+  char* infilename  = INFILENAME;
+  char* outfilename = OUTFILENAME;
+  char* clutname    = NULL;
+  uint32_t nthreads = 0;
+
+  // parse cmd args
+  int curpos = 1;
+  while (curpos < argc) {
+    if        (!strcmp(argv[curpos], "-h")) {
+      usage(argv[0]);
+    } else if (!strcmp(argv[curpos], "-i")) {\
+      curpos++;
+      infilename = argv[curpos++];
+    } else if (!strcmp(argv[curpos], "-o")) {\
+      curpos++;
+      outfilename = argv[curpos++];
+    } else if (!strcmp(argv[curpos], "-c")) {\
+      curpos++;
+      clutname = argv[curpos++];
+    } else if (!strcmp(argv[curpos], "-t")) {\
+      curpos++;
+      nthreads = strtoul(argv[curpos++], NULL, 0);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  double t0 = now();
+
+  // map the iteration field
+  mbi_header_t h;
+  size_t map_size = 0;
+  const uint8_t* map = NULL;
+  if ((map = mbi_map(infilename, &h, &map_size)) == NULL) {
+    fprintf(stderr, "Can't read iteration field file %s, exiting.\n", infilename);
+    exit(EXIT_FAILURE);
+  }
+  uint32_t img_w = h.img_w;
+  uint32_t img_h = h.img_h;
+  uint32_t niter = h.niter;
+
+  // create a palette of colors
+  rgb_t* palette = NULL;
+  if ((palette = (rgb_t*)malloc(niter * sizeof(rgb_t))) == NULL) {
+    fprintf(stderr, "Can't allocate palette array, exiting.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (clutname != NULL) {
+    // clut colors, repeated over the iterations
+    FILE* clut_fp = NULL;
+    if ((clut_fp = fopen(clutname, "rb")) == NULL) {
+      fprintf(stderr, "Can't open clut file %s, exiting.\n", clutname);
+      exit(EXIT_FAILURE);
+    }
+    rgb_t clut[NITERATIONS];
+    uint32_t nclut = 0;
+    unsigned int rgb;
+    while (nclut < NITERATIONS && fscanf(clut_fp, "%6x", &rgb) == 1) {
+      clut[nclut].r = (rgb >> 16) & 0xff;
+      clut[nclut].g = (rgb >>  8) & 0xff;
+      clut[nclut].b = (rgb >>  0) & 0xff;
+      nclut++;
+    }
+    fclose(clut_fp);
+    if (nclut == 0) {
+      fprintf(stderr, "Can't read colors from clut file %s, exiting.\n", clutname);
+      exit(EXIT_FAILURE);
+    }
+    for (uint32_t i=0; i<niter; i++) palette[i] = clut[i % nclut];
+  } else {
+    for (uint32_t i=0; i<niter; i++) {
+      #ifdef PALETTE_GREYSCALE
+      palette[i].r = 255 - (double)i/NITERATIONS * 255.0;
+      palette[i].g = 255 - (double)i/NITERATIONS * 255.0;
+      palette[i].b = 255 - (double)i/NITERATIONS * 255.0;
+      #else
+      double t = (double)i/NITERATIONS;
+      palette[i].r = (9.0*(1-t)*t*t*t*255.0);
+      palette[i].g = (15.0*(1-t)*(1-t)*t*t*255.0);
+      palette[i].b = (8.5*(1-t)*(1-t)*(1-t)*t*255.0);
+      #endif
+    }
+  }
+
+  // color the iteration field a band of rows at a time
+  sched_t* sched = NULL;
+  if ((sched = sched_create(nthreads)) == NULL) {
+    fprintf(stderr, "Can't create worker threads, exiting.\n");
+    exit(EXIT_FAILURE);
+  }
+  uint32_t band_h = img_w ? BAND_PIXELS / img_w : img_h;
+  band_h = band_h < 1 ? 1 : band_h > img_h ? img_h : band_h;
+  uint32_t* iterations = NULL;
+  if ((iterations = (uint32_t*)malloc((size_t)img_w*band_h * sizeof(uint32_t))) == NULL) {
+    fprintf(stderr, "Can't allocate iterations array, exiting.\n");
+    exit(EXIT_FAILURE);
+  }
+  ppm_t* ppm = NULL;
+  if ((ppm = ppm_open(sched, outfilename, img_w, img_h, palette, niter)) == NULL) {
+    fprintf(stderr, "Can't open output file %s, exiting.\n", outfilename);
+    exit(EXIT_FAILURE);
+  }
+  for (uint32_t band_y=0; band_y<img_h; band_y+=band_h) {
+    uint32_t rows = img_h-band_y < band_h ? img_h-band_y : band_h;
+    mbi_unpack(&h, map, (uint64_t)band_y*img_w, (uint64_t)rows*img_w, iterations);
+    if (ppm_write_rows(ppm, sched, iterations, rows)) {
+      fprintf(stderr, "Can't write output file %s, exiting.\n", outfilename);
+      exit(EXIT_FAILURE);
+    }
+  }
+  ppm_stats_t img_stats;
+  if (ppm_close(ppm, &img_stats)) {
+    fprintf(stderr, "Can't write output file %s, exiting.\n", outfilename);
+    exit(EXIT_FAILURE);
+  }
+  double t1 = now();
+
+  // output stats
+  printf("Iteration field of %lu points & %u max iterations recolored in %.3f s.\n", (uint64_t)img_w*img_h, niter, t1-t0);
+  printf("center:             %s, %s\n", h.cx, h.cy);
+  printf("zoom:               %e\n", h.zoom);
+  printf("precision:          %s\n", h.prec);
+  printf("minimal iterations: %u\n", img_stats.min);
+  printf("maximal iterations: %u\n", img_stats.max);
+  printf("all iterations:     %lu\n", img_stats.sum);
+
+  // deallocate
+  free(iterations);
+  free(palette);
+  mbi_unmap(map, map_size);
+  sched_destroy(sched);
+
+  // exit
+  exit(EXIT_SUCCESS);
+}
+
@@ -0,0 +1,212 @@
+// mpfix.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// multi-limb fixed-point numbers for deep zoom reference orbits
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "mpfix.h"
+
+
+//// defines ////
+// largest decimal exponent mpfix_from_str() takes, far beyond any number of limbs
+#define MPFIX_MAX_EXP   100000L
+
+
+//// mpfix_neg() ////
+// r = -a (in place allowed)
+static void mpfix_neg(mpfix_t* r, const mpfix_t* a)
+{
+  uint64_t carry = 1;
+  r->n = a->n;
+  for (uint32_t i=0; i<a->n; i++) {
+    carry += (uint32_t)~a->limb[i];
+    r->limb[i] = (uint32_t)carry;
+    carry >>= 32;
+  }
+}
+
+
+//// mpfix_is_neg() ////
+static int mpfix_is_neg(const mpfix_t* a)
+{
+  return (a->limb[a->n-1] >> 31) != 0;
+}
+
+
+//// mpfix_limbs() ////
+uint32_t mpfix_limbs(uint32_t frac_bits)
+{
+  uint32_t n = 1 + (frac_bits + 31) / 32;
+  return n > MPFIX_MAX_LIMBS ? MPFIX_MAX_LIMBS : n;
+}
+
+
+//// mpfix_from_dbl() ////
+void mpfix_from_dbl(mpfix_t* r, uint32_t n, double d)
+{
+  int neg = d < 0.0;
+  double m = fabs(d);
+  memset(r, 0, sizeof(mpfix_t));
+  r->n = n;
+  // integer limb, then 32 fractional bits at a time (exact, as doubles have 53 bits)
+  for (uint32_t i=n; i-->0 && m != 0.0; ) {
+    double l = floor(m);
+    r->limb[i] = (uint32_t)l;
+    m = (m - l) * 4294967296.0;
+  }
+  if (neg) mpfix_neg(r, r);
+}
+
+
+//// mpfix_div_small() ////
+// magnitude a = a / d, d < 2^32
+static void mpfix_div_small(mpfix_t* a, uint32_t d)
+{
+  uint64_t rem = 0;
+  for (uint32_t i=a->n; i-->0; ) {
+    uint64_t cur = (rem << 32) | a->limb[i];
+    a->limb[i] = (uint32_t)(cur / d);
+    rem = cur % d;
+  }
+}
+
+
+//// mpfix_from_str() ////
+int mpfix_from_str(mpfix_t* r, uint32_t n, const char* s)
+{
+  // split into sign, digits, position of the decimal point & exponent
+  char digits[1024];
+  int ndigits = 0;
+  int point = -1;
+  int neg = 0;
+  memset(r, 0, sizeof(mpfix_t));
+  r->n = n;
+  while (*s == ' ') s++;
+  if (*s == '-' || *s == '+') neg = (*s++ == '-');
+  for (; *s; s++) {
+    if (*s >= '0' && *s <= '9') {
+      if (ndigits < (int)sizeof(digits)) digits[ndigits++] = *s - '0';
+    } else if (*s == '.' && point < 0) {
+      point = ndigits;
+    } else {
+      break;
+    }
+  }
+  if (ndigits == 0) return -1;
+  if (point < 0) point = ndigits;
+  if (*s == 'e' || *s == 'E') {
+    char* end = NULL;
+    long e = strtol(s+1, &end, 10);
+    if (end == s+1 || *end || e > MPFIX_MAX_EXP || e < -MPFIX_MAX_EXP) return -1;
+    point += (int)e;
+  } else if (*s) {
+    return -1;
+  }
+  // integer part
+  uint64_t ipart = 0;
+  for (int i=0; i<point && i<ndigits; i++) {
+    ipart = ipart*10 + digits[i];
+    if (ipart > 0x7fffffffULL) return -1;
+  }
+  for (int i=ndigits; i<point; i++) {
+    ipart *= 10;
+    if (ipart > 0x7fffffffULL) return -1;
+  }
+  // fractional part, from the last digit up: f = (d + f) / 10; digits more than
+  // 32*n*log10(2)+1 below the point can't change the limbs
+  int nfrac = (int)(32.0*n*0.30102999566) + 1;
+  int last = ndigits-1 < point+nfrac-1 ? ndigits-1 : point+nfrac-1;
+  for (int i=last; i>=point; i--) {
+    r->limb[n-1] = i >= 0 ? digits[i] : 0;
+    mpfix_div_small(r, 10);
+  }
+  r->limb[n-1] = (uint32_t)ipart;
+  if (neg) mpfix_neg(r, r);
+  return 0;
+}
+
+
+//// mpfix_to_dbl() ////
+double mpfix_to_dbl(const mpfix_t* a)
+{
+  mpfix_t m;
+  int neg = mpfix_is_neg(a);
+  if (neg) mpfix_neg(&m, a); else m = *a;
+  // start at the most significant non-zero limb, three limbs are enough for 53 bits
+  uint32_t top = m.n;
+  while (top > 0 && m.limb[top-1] == 0) top--;
+  if (top == 0) return 0.0;
+  double d = 0.0;
+  double scale = ldexp(1.0, 32*((int)top-(int)m.n));
+  for (uint32_t i=top; i-->0 && i+3>=top; ) {
+    d += (double)m.limb[i] * scale;
+    scale *= 1.0/4294967296.0;
+  }
+  return neg ? -d : d;
+}
+
+
+//// mpfix_add() ////
+void mpfix_add(mpfix_t* r, const mpfix_t* a, const mpfix_t* b)
+{
+  uint64_t carry = 0;
+  r->n = a->n;
+  for (uint32_t i=0; i<a->n; i++) {
+    carry += (uint64_t)a->limb[i] + b->limb[i];
+    r->limb[i] = (uint32_t)carry;
+    carry >>= 32;
+  }
+}
+
+
+//// mpfix_sub() ////
+void mpfix_sub(mpfix_t* r, const mpfix_t* a, const mpfix_t* b)
+{
+  uint64_t carry = 1;
+  r->n = a->n;
+  for (uint32_t i=0; i<a->n; i++) {
+    carry += (uint64_t)a->limb[i] + (uint32_t)~b->limb[i];
+    r->limb[i] = (uint32_t)carry;
+    carry >>= 32;
+  }
+}
+
+
+//// mpfix_mul() ////
+void mpfix_mul(mpfix_t* r, const mpfix_t* a, const mpfix_t* b)
+{
+  uint32_t n = a->n;
+  mpfix_t ma, mb;
+  int neg_a = mpfix_is_neg(a);
+  int neg_b = mpfix_is_neg(b);
+  if (neg_a) mpfix_neg(&ma, a); else ma = *a;
+  if (neg_b) mpfix_neg(&mb, b); else mb = *b;
+  // schoolbook multiply of the magnitudes, keep limbs n-1 .. 2n-2 of the product
+  uint32_t p[2*MPFIX_MAX_LIMBS];
+  memset(p, 0, 2*n*sizeof(uint32_t));
+  for (uint32_t i=0; i<n; i++) {
+    uint64_t carry = 0;
+    for (uint32_t j=0; j<n; j++) {
+      carry += (uint64_t)ma.limb[i] * mb.limb[j] + p[i+j];
+      p[i+j] = (uint32_t)carry;
+      carry >>= 32;
+    }
+    p[i+n] = (uint32_t)carry;
+  }
+  r->n = n;
+  memcpy(r->limb, p+n-1, n*sizeof(uint32_t));
+  if (neg_a != neg_b) mpfix_neg(r, r);
+}
+
+
+//// mpfix_mul2() ////
+void mpfix_mul2(mpfix_t* r, const mpfix_t* a)
+{
+  mpfix_add(r, a, a);
+}
+
@@ -0,0 +1,57 @@
+// mpfix.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// multi-limb fixed-point numbers for deep zoom reference orbits
+
+
+#ifndef __MPFIX_H__
+#define __MPFIX_H__
+
+
+//// includes ////
+#include <stdint.h>
+
+
+//// defines ////
+// maximal number of 32-bit limbs (one integer limb, the rest is fraction)
+#define MPFIX_MAX_LIMBS 40U
+
+
+//// types ////
+// mpfix_t
+// two's complement fixed-point number, limb[0] is the least significant limb,
+// limb[n-1] is the (signed) integer part, so the value is limb * 2^(-32*(n-1))
+typedef struct {
+  uint32_t n;
+  uint32_t limb[MPFIX_MAX_LIMBS];
+} mpfix_t;
+
+
+//// functions ////
+// returns the number of limbs needed for frac_bits fractional bits
+uint32_t mpfix_limbs(uint32_t frac_bits);
+
+// sets r with n limbs to double d
+void mpfix_from_dbl(mpfix_t* r, uint32_t n, double d);
+
+// sets r with n limbs to a decimal number string ([+-]digits[.digits][e[+-]digits]),
+// returns 0 on success, -1 on a malformed string
+int mpfix_from_str(mpfix_t* r, uint32_t n, const char* s);
+
+// returns a rounded to double
+double mpfix_to_dbl(const mpfix_t* a);
+
+// r = a + b
+void mpfix_add(mpfix_t* r, const mpfix_t* a, const mpfix_t* b);
+
+// r = a - b
+void mpfix_sub(mpfix_t* r, const mpfix_t* a, const mpfix_t* b);
+
+// r = a * b (truncated towards zero)
+void mpfix_mul(mpfix_t* r, const mpfix_t* a, const mpfix_t* b);
+
+// r = a * 2
+void mpfix_mul2(mpfix_t* r, const mpfix_t* a);
+
+
+#endif // __MPFIX_H__
+
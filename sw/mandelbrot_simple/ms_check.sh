@@ -0,0 +1,28 @@
+#!/bin/bash
+# ms_check.sh
+# 2021, Rok Krajnc <rok.krajnc@gmail.com>
+# checks that -ms (Mariani-Silver) renders the views of interesting_points.sh exactly like brute force
+# usage: ./ms_check.sh [mandelbrot_simple|mandelbrot_fp] [extra options, e.g. -iw 1024 -ih 512]
+# NOTE: the deep zoom (-pt) views are skipped, they take far too long without -ms
+
+prog=${1:-mandelbrot_simple}
+shift
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+fail=0
+
+while read -r line; do
+  args=${line#./mandelbrot_simple }
+  [[ $args == *-pt* ]] && continue
+  ./$prog $args "$@" -ms -o "$tmp/ms.ppm" > "$tmp/ms.txt" || exit 1
+  ./$prog $args "$@"     -o "$tmp/bf.ppm" > /dev/null      || exit 1
+  filled=$(grep 'filled pixels' "$tmp/ms.txt" | tr -s ' ')
+  if cmp -s "$tmp/ms.ppm" "$tmp/bf.ppm"; then
+    echo "ok    $args $* ($filled)"
+  else
+    echo "DIFF  $args $* ($(cmp -l "$tmp/ms.ppm" "$tmp/bf.ppm" | wc -l) bytes)"
+    fail=1
+  fi
+done < <(grep '^\./mandelbrot_simple' interesting_points.sh)
+
+exit $fail
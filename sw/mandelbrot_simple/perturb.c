@@ -0,0 +1,259 @@
+// perturb.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// perturbation theory deep zoom with rebasing & bilinear approximation (BLA)
+//
+// One reference orbit Zn is calculated with mpfix at the image center, the pixels
+// iterate only the (double) difference to it:
+//   zn = Zn + dzn, dz(n+1) = 2*Zn*dzn + dzn^2 + dc
+// Glitches (dzn losing all precision against Zn) are avoided by rebasing: whenever
+// |Zn + dzn| < |dzn|, or the reference orbit ends, the pixel continues with dz = zn
+// from the start of the reference orbit (Zhuoran's method).
+// For small dzn, the step is (almost) linear: dz(n+1) ~ An*dzn + Bn*dc; BLA merges
+// consecutive steps into a binary tree of (A, B, validity radius) blocks, so whole
+// runs of 2^k iterations are done with a single complex multiply-add.
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "mpfix.h"
+#include "perturb.h"
+
+
+//// defines ////
+// additional fractional bits of the reference orbit beyond the pixel spacing
+#define PERTURB_GUARD_BITS  64U
+// BLA precision: the dropped dzn^2 term must stay below eps*|An*dzn|
+#define PERTURB_BLA_EPS     (1.0/(1ULL<<53))
+// maximal number of BLA levels (blocks of up to 2^(levels-1) iterations)
+#define PERTURB_BLA_LEVELS  32U
+
+
+//// types ////
+// perturb_bla_t
+// linear approximation of l iterations: dz(m+l) = A*dz(m) + B*dc, valid for |dz(m)| < r
+typedef struct {
+  double a_x, a_y;
+  double b_x, b_y;
+  double r;
+} perturb_bla_t;
+
+// perturb_s
+// reference orbit & BLA table
+struct perturb_s {
+  uint32_t       niter;
+  uint32_t       bits;
+  uint32_t       len;
+  double*        ref_x;
+  double*        ref_y;
+  uint32_t       levels;
+  perturb_bla_t* bla[PERTURB_BLA_LEVELS];
+  uint32_t       bla_len[PERTURB_BLA_LEVELS];
+};
+
+
+//// perturb_reference() ////
+// iterates the reference orbit in high precision, until it escapes or niter is reached
+static uint32_t perturb_reference(perturb_t* p, const mpfix_t* cx, const mpfix_t* cy, uint32_t niter)
+{
+  uint32_t n = cx->n;
+  mpfix_t zn_x, zn_y, x2, y2, t;
+  mpfix_from_dbl(&zn_x, n, 0.0);
+  mpfix_from_dbl(&zn_y, n, 0.0);
+  mpfix_from_dbl(&x2, n, 0.0);
+  mpfix_from_dbl(&y2, n, 0.0);
+  uint32_t len = 0;
+  p->ref_x[len] = 0.0;
+  p->ref_y[len] = 0.0;
+  len++;
+  while (len < niter) {
+    // zn_y = 2*zn_x*zn_y + cy, zn_x = x2 - y2 + cx
+    mpfix_mul(&t, &zn_x, &zn_y);
+    mpfix_mul2(&t, &t);
+    mpfix_add(&zn_y, &t, cy);
+    mpfix_sub(&t, &x2, &y2);
+    mpfix_add(&zn_x, &t, cx);
+    mpfix_mul(&x2, &zn_x, &zn_x);
+    mpfix_mul(&y2, &zn_y, &zn_y);
+    double zx = mpfix_to_dbl(&zn_x);
+    double zy = mpfix_to_dbl(&zn_y);
+    p->ref_x[len] = zx;
+    p->ref_y[len] = zy;
+    len++;
+    if (zx*zx + zy*zy > 4.0) break;
+  }
+  return len;
+}
+
+
+//// perturb_bla_build() ////
+// level 0 holds single steps m -> m+1, level k merges pairs of level k-1 blocks
+static int perturb_bla_build(perturb_t* p, double dc_max)
+{
+  uint32_t steps = p->len-1;
+  p->levels = 0;
+  for (uint32_t k=0; k<PERTURB_BLA_LEVELS && (steps>>k) > 0; k++) {
+    uint32_t cnt = steps>>k;
+    if ((p->bla[k] = (perturb_bla_t*)malloc(cnt * sizeof(perturb_bla_t))) == NULL) return -1;
+    p->bla_len[k] = cnt;
+    p->levels = k+1;
+    for (uint32_t j=0; j<cnt; j++) {
+      perturb_bla_t* b = &p->bla[k][j];
+      if (k == 0) {
+        b->a_x = 2.0*p->ref_x[j];
+        b->a_y = 2.0*p->ref_y[j];
+        b->b_x = 1.0;
+        b->b_y = 0.0;
+        b->r   = PERTURB_BLA_EPS*hypot(b->a_x, b->a_y);
+        continue;
+      }
+      // x first, then y: A = Ay*Ax, B = Ay*Bx + By, r = min(rx, (ry - |Bx|*dc_max) / |Ax|)
+      const perturb_bla_t* x = &p->bla[k-1][2*j];
+      const perturb_bla_t* y = &p->bla[k-1][2*j+1];
+      b->a_x = y->a_x*x->a_x - y->a_y*x->a_y;
+      b->a_y = y->a_x*x->a_y + y->a_y*x->a_x;
+      b->b_x = y->a_x*x->b_x - y->a_y*x->b_y + y->b_x;
+      b->b_y = y->a_x*x->b_y + y->a_y*x->b_x + y->b_y;
+      double ax = hypot(x->a_x, x->a_y);
+      double ry = ax > 0.0 ? (y->r - hypot(x->b_x, x->b_y)*dc_max) / ax : 0.0;
+      b->r = ry < 0.0 ? 0.0 : (ry < x->r ? ry : x->r);
+    }
+  }
+  return 0;
+}
+
+
+//// perturb_create() ////
+perturb_t* perturb_create(const char* cx, const char* cy, double pixel, double dc_max, uint32_t niter)
+{
+  perturb_t* p = NULL;
+  if ((p = (perturb_t*)calloc(1, sizeof(perturb_t))) == NULL) return NULL;
+  p->niter = niter;
+  // precision from the pixel spacing
+  int pixel_exp = 0;
+  frexp(pixel, &pixel_exp);
+  p->bits = (pixel_exp < 0 ? (uint32_t)-pixel_exp : 0) + PERTURB_GUARD_BITS;
+  uint32_t nlimbs = mpfix_limbs(p->bits);
+  p->bits = 32*(nlimbs-1);
+  mpfix_t c_x, c_y;
+  if (mpfix_from_str(&c_x, nlimbs, cx) || mpfix_from_str(&c_y, nlimbs, cy)) {
+    free(p);
+    return NULL;
+  }
+  p->ref_x = (double*)malloc((niter > 1 ? niter : 1) * sizeof(double));
+  p->ref_y = (double*)malloc((niter > 1 ? niter : 1) * sizeof(double));
+  if (p->ref_x == NULL || p->ref_y == NULL) {
+    perturb_destroy(p);
+    return NULL;
+  }
+  p->len = perturb_reference(p, &c_x, &c_y, niter);
+  if (perturb_bla_build(p, dc_max)) {
+    perturb_destroy(p);
+    return NULL;
+  }
+  return p;
+}
+
+
+//// perturb_destroy() ////
+void perturb_destroy(perturb_t* p)
+{
+  if (p == NULL) return;
+  for (uint32_t k=0; k<p->levels; k++) free(p->bla[k]);
+  free(p->ref_x);
+  free(p->ref_y);
+  free(p);
+}
+
+
+//// perturb_ref_len() ////
+uint32_t perturb_ref_len(const perturb_t* p)
+{
+  return p->len;
+}
+
+
+//// perturb_bits() ////
+uint32_t perturb_bits(const perturb_t* p)
+{
+  return p->bits;
+}
+
+
+//// perturb_bla_levels() ////
+uint32_t perturb_bla_levels(const perturb_t* p)
+{
+  return p->levels;
+}
+
+
+//// perturb_pixel() ////
+static uint32_t perturb_pixel(const perturb_t* p, double dc_x, double dc_y, perturb_stats_t* stats)
+{
+  double dz_x = 0.0;
+  double dz_y = 0.0;
+  uint32_t m = 0;
+  uint32_t niterations = 0;
+  uint32_t limit = p->niter-1;
+  while (niterations < limit) {
+    // largest valid BLA block starting at m (blocks are aligned to their length)
+    const perturb_bla_t* b = NULL;
+    uint32_t len = 1;
+    if (m > 0 && (m & 1) == 0) {
+      double dz2 = dz_x*dz_x + dz_y*dz_y;
+      uint32_t k = (uint32_t)__builtin_ctz(m);
+      if (k >= p->levels) k = p->levels-1;
+      for (; k>0; k--) {
+        uint32_t j = m>>k;
+        if (j >= p->bla_len[k] || niterations + (1U<<k) > limit) continue;
+        const perturb_bla_t* c = &p->bla[k][j];
+        if (dz2 < c->r*c->r) {
+          b = c;
+          len = 1U<<k;
+          break;
+        }
+      }
+    }
+    double t_x, t_y;
+    if (b != NULL) {
+      t_x = b->a_x*dz_x - b->a_y*dz_y + b->b_x*dc_x - b->b_y*dc_y;
+      t_y = b->a_x*dz_y + b->a_y*dz_x + b->b_x*dc_y + b->b_y*dc_x;
+      stats->skipped += len-1;
+    } else {
+      // dz = 2*Zm*dz + dz^2 + dc
+      double zx = p->ref_x[m];
+      double zy = p->ref_y[m];
+      t_x = 2.0*(zx*dz_x - zy*dz_y) + dz_x*dz_x - dz_y*dz_y + dc_x;
+      t_y = 2.0*(zx*dz_y + zy*dz_x) + 2.0*dz_x*dz_y + dc_y;
+    }
+    dz_x = t_x;
+    dz_y = t_y;
+    m += len;
+    niterations += len;
+    double z_x = p->ref_x[m] + dz_x;
+    double z_y = p->ref_y[m] + dz_y;
+    double z2 = z_x*z_x + z_y*z_y;
+    if (z2 > 4.0) break;
+    // rebase when the pixel gets closer to 0 than to the reference, or the reference ends
+    if (z2 < dz_x*dz_x + dz_y*dz_y || m == p->len-1) {
+      dz_x = z_x;
+      dz_y = z_y;
+      m = 0;
+      stats->rebased++;
+    }
+  }
+  return niterations;
+}
+
+
+//// perturb_iterate() ////
+void perturb_iterate(const perturb_t* p, const double* dc_x, const double* dc_y, uint32_t n, uint32_t* iterations, perturb_stats_t* stats)
+{
+  for (uint32_t i=0; i<n; i++) {
+    iterations[i] = perturb_pixel(p, dc_x[i], dc_y[i], stats);
+  }
+}
+
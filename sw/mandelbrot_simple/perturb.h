@@ -0,0 +1,50 @@
+// perturb.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// perturbation theory deep zoom with rebasing & bilinear approximation (BLA)
+
+
+#ifndef __PERTURB_H__
+#define __PERTURB_H__
+
+
+//// includes ////
+#include <stdint.h>
+
+
+//// types ////
+// perturb_t
+// opaque reference orbit & BLA table, read-only once created (shared by all workers)
+typedef struct perturb_s perturb_t;
+
+// perturb_stats_t
+// per-worker perturbation statistics
+typedef struct {
+  uint64_t rebased;           // number of times a pixel orbit was rebased to the reference start
+  uint64_t skipped;           // number of iterations skipped with BLA
+} perturb_stats_t;
+
+
+//// functions ////
+// calculates the reference orbit at (cx, cy), given as decimal strings, with enough
+// precision for the pixel spacing, & builds the BLA table for pixel offsets up to dc_max;
+// returns NULL if the coordinates can't be parsed or on allocation failure
+perturb_t* perturb_create(const char* cx, const char* cy, double pixel, double dc_max, uint32_t niter);
+
+// frees the reference orbit
+void perturb_destroy(perturb_t* p);
+
+// returns the length of the reference orbit
+uint32_t perturb_ref_len(const perturb_t* p);
+
+// returns the number of fractional bits the reference orbit was calculated with
+uint32_t perturb_bits(const perturb_t* p);
+
+// returns the number of BLA table levels
+uint32_t perturb_bla_levels(const perturb_t* p);
+
+// calculates number of iterations for n points at offsets (dc_x[i], dc_y[i]) from the reference
+void perturb_iterate(const perturb_t* p, const double* dc_x, const double* dc_y, uint32_t n, uint32_t* iterations, perturb_stats_t* stats);
+
+
+#endif // __PERTURB_H__
+
@@ -0,0 +1,366 @@
+// png.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// RGB png image writer, groups of rows are filtered & deflated on all workers (pigz style)
+// NOTE: every group is a raw deflate stream with the 32 kB before it as the preset
+// dictionary, ended with a sync flush (the last one with a final block), so the groups
+// join into one zlib stream; the adler-32 checksums of the groups are combined in order
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <zlib.h>
+#include "png.h"
+
+
+//// defines ////
+// filtered bytes per group, one group is deflated per worker at a time
+#define PNG_GROUP_BYTES (256U*1024U)
+// deflate window, carried over from group to group
+#define PNG_WINDOW      32768U
+// deflate level (as pigz)
+#define PNG_LEVEL       6
+// widest image, so the filter sums of a row fit in 32 bits
+#define PNG_MAX_WIDTH   (1U<<23)
+
+
+//// types ////
+// png_group_t
+// one group of rows & its deflated stream
+typedef struct {
+  uint32_t row;               // first row, relative to the pending rows
+  uint32_t nrows;
+  uint8_t* out;
+  uint64_t out_len;
+  uint32_t adler;
+  uint32_t crc;               // of the IDAT chunk
+  int      ok;
+} png_group_t;
+
+// png_job_t
+// groups of one flush, filtered & then deflated a group per task
+typedef struct {
+  png_t*       p;
+  png_group_t* groups;
+  uint32_t     ngroups;
+  uint8_t*     scratch;       // a row per worker
+  int          last;          // the groups end the image
+} png_job_t;
+
+// png_s
+// image file open for writing
+struct png_s {
+  FILE*    fp;
+  uint32_t img_w;
+  uint32_t img_h;
+  uint32_t row;               // rows deflated so far
+  uint64_t line;              // filtered row length (filter byte & rgb)
+  uint8_t* pending;           // rgb rows waiting to be deflated, preceded by the row above them
+  uint32_t npending;
+  uint32_t max_pending;
+  uint8_t* filtered;          // filtered pending rows
+  uint8_t* dict;              // last PNG_WINDOW filtered bytes before the pending rows
+  uint32_t dict_len;
+  uint32_t adler;             // of all filtered bytes so far
+  int      ok;
+};
+
+
+//// png_u32() ////
+// stores a big-endian 32-bit word
+static void png_u32(uint8_t* b, uint32_t v)
+{
+  b[0] = v >> 24;
+  b[1] = v >> 16;
+  b[2] = v >> 8;
+  b[3] = v;
+}
+
+
+//// png_chunk() ////
+// writes a chunk with its length & crc, returns 0 on success
+static int png_chunk(FILE* fp, const char* type, const uint8_t* data, uint64_t len, uint32_t crc)
+{
+  uint8_t hdr[8], tail[4];
+  png_u32(hdr, (uint32_t)len);
+  memcpy(hdr+4, type, 4);
+  png_u32(tail, crc);
+  return fwrite(hdr, 1, 8, fp) == 8 && (len == 0 || fwrite(data, 1, len, fp) == len) && fwrite(tail, 1, 4, fp) == 4 ? 0 : -1;
+}
+
+
+//// png_chunk_crc() ////
+// returns the crc of a chunk's type & data
+static uint32_t png_chunk_crc(const char* type, const uint8_t* data, uint64_t len)
+{
+  uint32_t crc = crc32(0L, (const Bytef*)type, 4);
+  return len ? crc32(crc, data, len) : crc;
+}
+
+
+//// png_filter() ////
+// applies filter f to one row, prev is the unfiltered row above (zeros for the first
+// row), returns the sum of the absolute (signed) filtered bytes; the first pixel has no
+// left neighbour, so it is done separately & the rest of the loop can be vectorized
+static inline uint32_t png_filter(uint32_t f, const uint8_t* row, const uint8_t* prev, uint32_t len, uint8_t* dst)
+{
+  uint32_t sum = 0;
+  for (uint32_t i=0; i<3 && i<len; i++) {
+    // a & c are zero, paeth picks b
+    uint8_t v = row[i] - (f == 2 || f == 4 ? prev[i] : f == 3 ? prev[i] >> 1 : 0);
+    dst[i] = v;
+    sum += v < 128 ? v : 256 - v;
+  }
+  for (uint32_t i=3; i<len; i++) {
+    int a = row[i-3];
+    int b = prev[i];
+    int c = prev[i-3];
+    uint8_t v = row[i];
+    if (f == 1) {
+      v -= a;
+    } else if (f == 2) {
+      v -= b;
+    } else if (f == 3) {
+      v -= (a + b) >> 1;
+    } else if (f == 4) {
+      int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2*c);
+      v -= pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+    }
+    dst[i] = v;
+    sum += v < 128 ? v : 256 - v;
+  }
+  return sum;
+}
+
+
+//// png_filter_row() ////
+// filters one row with the filter that gives the smallest sum of absolute bytes (the
+// usual guess for the best compressing one), out gets the filter type & the row
+static void png_filter_row(const uint8_t* row, const uint8_t* prev, uint32_t len, uint8_t* out, uint8_t* scratch)
+{
+  uint32_t best = png_filter(0, row, prev, len, out+1);
+  out[0] = 0;
+  for (uint32_t f=1; f<5 && best > 0; f++) {
+    uint32_t sum = f == 1 ? png_filter(1, row, prev, len, scratch) :
+                   f == 2 ? png_filter(2, row, prev, len, scratch) :
+                   f == 3 ? png_filter(3, row, prev, len, scratch) :
+                            png_filter(4, row, prev, len, scratch);
+    if (sum < best) {
+      best = sum;
+      out[0] = f;
+      memcpy(out+1, scratch, len);
+    }
+  }
+}
+
+
+//// png_filter_group() ////
+// filters the rows of one group
+static void png_filter_group(const png_t* p, const png_group_t* g, uint8_t* scratch)
+{
+  uint32_t rgb_len = 3*p->img_w;
+  for (uint32_t y=g->row; y<g->row+g->nrows; y++) {
+    // the pending rows are preceded by the row above them (zeros above the first one)
+    const uint8_t* row = p->pending + (uint64_t)(y+1)*rgb_len;
+    png_filter_row(row, row - rgb_len, rgb_len, p->filtered + (uint64_t)y*p->line, scratch);
+  }
+}
+
+
+//// png_deflate_group() ////
+// deflates one filtered group, primed with dict (dict_len bytes), ended with a sync
+// flush, or with the final block if last
+static void png_deflate_group(const png_t* p, png_group_t* g, const uint8_t* dict, uint32_t dict_len, int last)
+{
+  const uint8_t* in = p->filtered + (uint64_t)g->row*p->line;
+  uint64_t len = (uint64_t)g->nrows*p->line;
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  g->ok = 0;
+  if (deflateInit2(&z, PNG_LEVEL, Z_DEFLATED, -15, 8, Z_FILTERED) != Z_OK) return;
+  uint64_t bound = deflateBound(&z, len) + 16;
+  if ((g->out = (uint8_t*)malloc(bound)) == NULL || (dict_len && deflateSetDictionary(&z, dict, dict_len) != Z_OK)) {
+    deflateEnd(&z);
+    return;
+  }
+  z.next_in   = (Bytef*)in;
+  z.avail_in  = len;
+  z.next_out  = g->out;
+  z.avail_out = bound;
+  int ret = deflate(&z, last ? Z_FINISH : Z_SYNC_FLUSH);
+  g->ok      = (last ? ret == Z_STREAM_END : ret == Z_OK) && z.avail_in == 0;
+  g->out_len = bound - z.avail_out;
+  deflateEnd(&z);
+  g->adler = adler32(1L, in, len);
+  g->crc   = png_chunk_crc("IDAT", g->out, g->out_len);
+}
+
+
+//// png_filter_task() ////
+// filters one group
+static void png_filter_task(void* arg, uint32_t worker, uint32_t task)
+{
+  png_job_t* j = (png_job_t*)arg;
+  png_filter_group(j->p, &j->groups[task], j->scratch + 3*(uint64_t)worker*j->p->img_w);
+}
+
+
+//// png_deflate_task() ////
+// deflates one group, each group's dictionary is the end of the one before it
+static void png_deflate_task(void* arg, uint32_t worker, uint32_t task)
+{
+  png_job_t* j = (png_job_t*)arg;
+  const png_t* p = j->p;
+  uint64_t start = (uint64_t)j->groups[task].row*p->line;
+  int last = j->last && task == j->ngroups-1;
+  if (task == 0) {
+    png_deflate_group(p, &j->groups[task], p->dict, p->dict_len, last);
+  } else {
+    uint32_t dict_len = start > PNG_WINDOW ? PNG_WINDOW : (uint32_t)start;
+    png_deflate_group(p, &j->groups[task], p->filtered + start - dict_len, dict_len, last);
+  }
+}
+
+
+//// png_flush() ////
+// filters & deflates the pending rows on all workers of s (NULL - on the calling thread)
+// & writes them out as one IDAT chunk per group, returns 0 on success
+static int png_flush(png_t* p, sched_t* s)
+{
+  uint32_t group_rows = PNG_GROUP_BYTES/p->line > 0 ? PNG_GROUP_BYTES/p->line : 1;
+  uint32_t ngroups = (p->npending + group_rows-1) / group_rows;
+  int last = p->row + p->npending == p->img_h;
+  png_group_t* groups = NULL;
+  if (ngroups == 0) return 0;
+  if ((groups = (png_group_t*)calloc(ngroups, sizeof(png_group_t))) == NULL) return -1;
+  for (uint32_t i=0; i<ngroups; i++) {
+    groups[i].row   = i*group_rows;
+    groups[i].nrows = p->npending-groups[i].row < group_rows ? p->npending-groups[i].row : group_rows;
+  }
+  // filter all groups first, each group's dictionary is the end of the one before it
+  png_job_t j = {p, groups, ngroups, NULL, last};
+  if ((j.scratch = (uint8_t*)malloc(3*(uint64_t)(s ? sched_nthreads(s) : 1)*p->img_w)) == NULL) {
+    free(groups);
+    p->ok = 0;
+    return -1;
+  }
+  if (s) {
+    sched_run(s, ngroups, png_filter_task, &j);
+    sched_run(s, ngroups, png_deflate_task, &j);
+  } else {
+    for (uint32_t i=0; i<ngroups; i++) png_filter_task(&j, 0, i);
+    for (uint32_t i=0; i<ngroups; i++) png_deflate_task(&j, 0, i);
+  }
+  free(j.scratch);
+  int ok = 1;
+  // write the groups in order, the zlib checksum is combined from theirs
+  for (uint32_t i=0; i<ngroups; i++) {
+    png_group_t* g = &groups[i];
+    if (ok && (!g->ok || png_chunk(p->fp, "IDAT", g->out, g->out_len, g->crc))) ok = 0;
+    p->adler = adler32_combine(p->adler, g->adler, (z_off_t)g->nrows*p->line);
+    free(g->out);
+  }
+  free(groups);
+  // the next dictionary is the end of all filtered bytes so far
+  uint64_t len = (uint64_t)p->npending*p->line;
+  if (len >= PNG_WINDOW) {
+    memcpy(p->dict, p->filtered + len - PNG_WINDOW, PNG_WINDOW);
+    p->dict_len = PNG_WINDOW;
+  } else {
+    uint32_t keep = p->dict_len + len > PNG_WINDOW ? PNG_WINDOW - (uint32_t)len : p->dict_len;
+    memmove(p->dict, p->dict + p->dict_len - keep, keep);
+    memcpy(p->dict + keep, p->filtered, len);
+    p->dict_len = keep + (uint32_t)len;
+  }
+  // the last row is the row above the next pending rows
+  uint64_t rgb_len = 3*(uint64_t)p->img_w;
+  memcpy(p->pending, p->pending + (uint64_t)p->npending*rgb_len, rgb_len);
+  p->row += p->npending;
+  p->npending = 0;
+  if (ok && last) {
+    uint8_t trailer[4];
+    png_u32(trailer, p->adler);
+    if (png_chunk(p->fp, "IDAT", trailer, 4, png_chunk_crc("IDAT", trailer, 4))) ok = 0;
+  }
+  if (!ok) p->ok = 0;
+  return ok ? 0 : -1;
+}
+
+
+//// png_open() ////
+png_t* png_open(const char* filename, uint32_t img_w, uint32_t img_h, uint32_t nthreads)
+{
+  png_t* p = NULL;
+  if (img_w == 0 || img_w > PNG_MAX_WIDTH || img_h == 0 || (p = (png_t*)calloc(1, sizeof(png_t))) == NULL) return NULL;
+  p->img_w = img_w;
+  p->img_h = img_h;
+  p->line  = 1 + 3*(uint64_t)img_w;
+  p->adler = 1;
+  p->ok    = 1;
+  // pending rows for two groups per worker
+  uint64_t max_pending = 2*(uint64_t)(nthreads ? nthreads : 1)*PNG_GROUP_BYTES/p->line;
+  p->max_pending = max_pending < 1 ? 1 : max_pending > img_h ? img_h : (uint32_t)max_pending;
+  if ((p->pending = (uint8_t*)calloc((uint64_t)(p->max_pending+1)*3*img_w, 1)) == NULL ||
+      (p->filtered = (uint8_t*)malloc((uint64_t)p->max_pending*p->line)) == NULL ||
+      (p->dict = (uint8_t*)malloc(PNG_WINDOW)) == NULL ||
+      (p->fp = fopen(filename, "wb")) == NULL) {
+    free(p->pending);
+    free(p->filtered);
+    free(p->dict);
+    free(p);
+    return NULL;
+  }
+  // signature, header & the zlib stream header (in its own IDAT chunk)
+  static const uint8_t sig[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  static const uint8_t zhdr[2] = {0x78, 0x9c};
+  uint8_t ihdr[13];
+  png_u32(ihdr, img_w);
+  png_u32(ihdr+4, img_h);
+  ihdr[8]  = 8;               // bit depth
+  ihdr[9]  = 2;               // rgb
+  ihdr[10] = 0;               // deflate
+  ihdr[11] = 0;               // adaptive filters
+  ihdr[12] = 0;               // no interlace
+  if (fwrite(sig, 1, 8, p->fp) != 8 || png_chunk(p->fp, "IHDR", ihdr, 13, png_chunk_crc("IHDR", ihdr, 13)) ||
+      png_chunk(p->fp, "IDAT", zhdr, 2, png_chunk_crc("IDAT", zhdr, 2))) {
+    fclose(p->fp);
+    free(p->pending);
+    free(p->filtered);
+    free(p->dict);
+    free(p);
+    return NULL;
+  }
+  return p;
+}
+
+
+//// png_put_rows() ////
+int png_put_rows(png_t* p, sched_t* s, const uint8_t* rgb, uint32_t nrows)
+{
+  uint64_t rgb_len = 3*(uint64_t)p->img_w;
+  if (nrows > p->img_h - p->row - p->npending) p->ok = 0;
+  while (p->ok && nrows) {
+    uint32_t n = p->max_pending - p->npending < nrows ? p->max_pending - p->npending : nrows;
+    memcpy(p->pending + (uint64_t)(p->npending+1)*rgb_len, rgb, n*rgb_len);
+    p->npending += n;
+    rgb   += n*rgb_len;
+    nrows -= n;
+    if (p->npending == p->max_pending || p->row + p->npending == p->img_h) png_flush(p, s);
+  }
+  return p->ok ? 0 : -1;
+}
+
+
+//// png_close() ////
+int png_close(png_t* p)
+{
+  int ret = p->ok && p->row == p->img_h && png_chunk(p->fp, "IEND", NULL, 0, png_chunk_crc("IEND", NULL, 0)) == 0 ? 0 : -1;
+  if (fclose(p->fp)) ret = -1;
+  free(p->pending);
+  free(p->filtered);
+  free(p->dict);
+  free(p);
+  return ret;
+}
@@ -0,0 +1,38 @@
+// png.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// RGB png image writer, groups of rows are filtered & deflated on all workers (pigz style)
+
+
+#ifndef __PNG_H__
+#define __PNG_H__
+
+
+//// includes ////
+#include <stdint.h>
+#include "sched.h"
+
+
+//// types ////
+// png_t
+// opaque image file open for writing, filled top to bottom
+typedef struct png_s png_t;
+
+
+//// functions ////
+// creates the img_w x img_h png file & writes its header, rows are collected for
+// nthreads workers (0 - one), returns NULL on error
+png_t* png_open(const char* filename, uint32_t img_w, uint32_t img_h, uint32_t nthreads);
+
+// appends nrows rows of packed rgb pixels; rows are collected until there are enough
+// for all workers (or the image is complete), then each group of rows is filtered &
+// deflated as a task on the workers of s (NULL - on the calling thread), primed with
+// the end of the group before it, & the streams are written out as one; returns 0 on
+// success
+int png_put_rows(png_t* p, sched_t* s, const uint8_t* rgb, uint32_t nrows);
+
+// closes the png file, returns 0 if all rows were written
+int png_close(png_t* p);
+
+
+#endif // __PNG_H__
+
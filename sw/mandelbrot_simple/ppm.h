@@ -0,0 +1,70 @@
+// ppm.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// binary (P6) ppm, png or Deep Zoom pyramid image writer, colors & iteration statistics
+// are done in parallel
+
+
+#ifndef __PPM_H__
+#define __PPM_H__
+
+
+//// includes ////
+#include <stdint.h>
+#include "sched.h"
+
+
+//// types ////
+// ppm_t
+// opaque image file open for writing, filled top to bottom a band of rows at a time
+typedef struct ppm_s ppm_t;
+
+// rgb_t
+// represents a RGB color value
+typedef struct {
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+} rgb_t;
+
+// ppm_stats_t
+// iteration statistics of the image
+typedef struct {
+  uint32_t min;               // minimal number of iterations
+  uint32_t max;               // maximal number of iterations
+  uint64_t sum;               // number of all iterations
+} ppm_stats_t;
+
+
+//// functions ////
+// creates the img_w x img_h output image file, a png file if filename ends with .png,
+// a Deep Zoom pyramid of png tiles for .dzi, otherwise a ppm file, colored with palette (one of ncolors entries per iteration
+// count, so counts must be below ncolors), the png rows are collected for the workers of s
+// (NULL - the calling thread only); returns NULL on error
+ppm_t* ppm_open(sched_t* s, const char* filename, uint32_t img_w, uint32_t img_h, const rgb_t* palette, uint32_t ncolors);
+
+// appends nrows rows of iterations to the image, colored on all workers (with avx2
+// gathers if the cpu supports them, s NULL - on the calling thread) into a buffer of the
+// rows, which is then written at the rows' offset (or appended, for pipes & devices, or
+// passed to the png or pyramid writer, which deflate on the same workers); returns
+// 0 on success
+int ppm_write_rows(ppm_t* p, sched_t* s, const uint32_t* iterations, uint32_t nrows);
+
+// colors the next nrows rows of iterations into the row buffer (as ppm_write_rows()),
+// without writing them, & returns the buffer in rgb, so pixels can be changed before
+// ppm_put_rows(); returns 0 on success
+int ppm_color_rows(ppm_t* p, sched_t* s, const uint32_t* iterations, uint32_t nrows, uint8_t** rgb);
+
+// writes out the nrows rows colored by ppm_color_rows() (png ones deflated on the workers
+// of s, NULL - on the calling thread), returns 0 on success
+int ppm_put_rows(ppm_t* p, sched_t* s, uint32_t nrows);
+
+// closes the image file & returns the iteration statistics of all written rows,
+// returns 0 on success
+int ppm_close(ppm_t* p, ppm_stats_t* stats);
+
+// writes img_w x img_h iterations as a whole image, returns 0 on success
+int ppm_write(sched_t* s, const char* filename, const uint32_t* iterations, uint32_t img_w, uint32_t img_h, const rgb_t* palette, uint32_t ncolors, ppm_stats_t* stats);
+
+
+#endif // __PPM_H__
+
@@ -0,0 +1,70 @@
+// prec.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// numeric precision policies & automatic per-view policy selection
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "prec.h"
+
+
+//// defines ////
+// guard bits on top of the pixel spacing
+#define PREC_GUARD_BITS     4U
+// usable mantissa bits of the policies (double-double loses a couple to renormalisation,
+// float is kept 4 bits short of 24, as beyond that ~1% of the pixels get a different count)
+#define PREC_FLOAT_BITS     20U
+#define PREC_DOUBLE_BITS    53U
+#define PREC_DD_BITS        104U
+
+
+//// policy names ////
+static const char* prec_names[] = {"auto", "float", "double", "dd", "perturb"};
+
+
+//// prec_parse() ////
+int prec_parse(const char* name, prec_t* prec)
+{
+  for (uint32_t i=0; i<sizeof(prec_names)/sizeof(prec_names[0]); i++) {
+    if (!strcmp(prec_names[i], name)) {
+      *prec = (prec_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+
+//// prec_name() ////
+const char* prec_name(prec_t prec)
+{
+  return prec_names[prec];
+}
+
+
+//// prec_bits() ////
+uint32_t prec_bits(double man_cx, double man_cy, double man_zoom, uint32_t img_w, uint32_t img_h, uint32_t niter)
+{
+  // largest magnitude in the calculation (|Zn| <= 2 until escape, c over the whole view)
+  double mag = fmax(2.0, fmax(fabs(man_cx) + (double)img_w/(double)img_h*man_zoom, fabs(man_cy) + man_zoom));
+  double pixel = 2.0*man_zoom/(double)img_h;
+  // rounding errors grow roughly with the square root of the number of iterations
+  double bits = log2(mag/pixel) + 0.5*log2((double)(niter > 1 ? niter : 1)) + PREC_GUARD_BITS;
+  return bits > 0.0 ? (uint32_t)ceil(bits) : 0;
+}
+
+
+//// prec_select() ////
+prec_t prec_select(double man_cx, double man_cy, double man_zoom, uint32_t img_w, uint32_t img_h, uint32_t niter)
+{
+  uint32_t bits = prec_bits(man_cx, man_cy, man_zoom, img_w, img_h, niter);
+  if (bits <= PREC_FLOAT_BITS)  return PREC_FLOAT;
+  if (bits <= PREC_DOUBLE_BITS) return PREC_DOUBLE;
+  if (bits <= PREC_DD_BITS)     return PREC_DD;
+  return PREC_PERTURB;
+}
+
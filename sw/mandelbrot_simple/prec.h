@@ -0,0 +1,42 @@
+// prec.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// numeric precision policies & automatic per-view policy selection
+
+
+#ifndef __PREC_H__
+#define __PREC_H__
+
+
+//// includes ////
+#include <stdint.h>
+
+
+//// types ////
+// prec_t
+// numeric policy of the escape time calculation, from the cheapest to the most precise
+typedef enum {
+  PREC_AUTO = 0,              // pick per view with prec_select()
+  PREC_FLOAT,                 // single precision, twice the SIMD lanes of double
+  PREC_DOUBLE,                // double precision
+  PREC_DD,                    // double-double (~106-bit mantissa)
+  PREC_PERTURB                // perturbation from a multi-limb fixed-point reference orbit
+} prec_t;
+
+
+//// functions ////
+// parses a policy name (auto, float, double, dd, perturb), returns 0 on success
+int prec_parse(const char* name, prec_t* prec);
+
+// returns the policy name
+const char* prec_name(prec_t prec);
+
+// returns the number of mantissa bits the view needs: enough to tell neighbouring
+// pixels apart, plus guard bits for the rounding errors accumulated over niter iterations
+uint32_t prec_bits(double man_cx, double man_cy, double man_zoom, uint32_t img_w, uint32_t img_h, uint32_t niter);
+
+// returns the cheapest policy that is still precise enough for the view
+prec_t prec_select(double man_cx, double man_cy, double man_zoom, uint32_t img_w, uint32_t img_h, uint32_t niter);
+
+
+#endif // __PREC_H__
+
@@ -0,0 +1,346 @@
+// prof.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// per-thread hardware counters (perf_event_open) of the phases of a run
+// NOTE: only user space is counted (exclude_kernel), which perf_event_paranoid 2 allows;
+// the counters of a thread are one group, scaled by its enabled / running time when the pmu
+// multiplexes it with other events
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "prof.h"
+
+
+//// defines ////
+// maximal number of distinct phases
+#define PROF_MAX_PHASES 16U
+// number of counters per thread
+#define PROF_NCOUNTERS  5U
+// count of a counter that isn't available
+#define PROF_NONE       UINT64_MAX
+// counter indices
+#define PROF_CLOCK      0U
+#define PROF_CYCLES     1U
+#define PROF_INSTR      2U
+#define PROF_BRANCH     3U
+#define PROF_CACHE      4U
+
+
+//// types ////
+// prof_thread_t
+// counters of one thread
+typedef struct {
+  int      fd[PROF_NCOUNTERS];              // -1 - not opened
+  int      err[PROF_NCOUNTERS];             // errno of the counters that didn't open
+  int      pos[PROF_NCOUNTERS];             // position in the group read, -1 - not opened
+  uint64_t last[3 + PROF_NCOUNTERS];        // last group read: nr, time enabled, time running, values
+  int      phase;                           // phase the counts go to, -1 - the current one
+} prof_thread_t;
+
+// prof_s
+// profile
+struct prof_s {
+  uint32_t       nthreads;
+  prof_thread_t* threads;
+  uint32_t       nphases;
+  const char*    names[PROF_MAX_PHASES];
+  double         wall[PROF_MAX_PHASES];     // seconds
+  uint64_t*      counts;                    // phase x thread x counter
+  int            current;                   // current phase, -1 - none
+  double         start;                     // start of the current phase
+};
+
+
+//// counter list ////
+// the task clock leads the group, it's a software event, so it's there without a pmu too
+static const struct {
+  uint32_t    type;
+  uint64_t    config;
+  const char* name;
+} prof_counters[PROF_NCOUNTERS] = {
+  {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK,    "task clock"},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,    "cycles"},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,  "instructions"},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch misses"},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,  "cache misses"},
+};
+
+
+//// prof_now() ////
+// returns monotonic time in seconds
+static double prof_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9*(double)ts.tv_nsec;
+}
+
+
+//// prof_group() ////
+// returns the group fd of a thread, -1 if none of its counters is open
+static int prof_group(const prof_thread_t* t)
+{
+  for (uint32_t k=0; k<PROF_NCOUNTERS; k++) {
+    if (t->fd[k] >= 0) return t->fd[k];
+  }
+  return -1;
+}
+
+
+//// prof_read() ////
+// reads the group of a thread into buf, returns 0 on success
+static int prof_read(const prof_thread_t* t, uint64_t* buf)
+{
+  int fd = prof_group(t);
+  if (fd < 0) return -1;
+  ssize_t n = read(fd, buf, (3 + PROF_NCOUNTERS)*sizeof(uint64_t));
+  return n >= (ssize_t)(3*sizeof(uint64_t)) && n == (ssize_t)((3 + buf[0])*sizeof(uint64_t)) ? 0 : -1;
+}
+
+
+//// prof_count() ////
+// adds the counts of a thread since its last read to its phase
+static void prof_count(prof_t* p, uint32_t thread)
+{
+  prof_thread_t* t = &p->threads[thread];
+  uint64_t buf[3 + PROF_NCOUNTERS];
+  if (prof_read(t, buf)) return;
+  int phase = t->phase >= 0 ? t->phase : p->current;
+  if (phase >= 0) {
+    uint64_t* c = &p->counts[((size_t)phase*p->nthreads + thread)*PROF_NCOUNTERS];
+    uint64_t enabled = buf[1] - t->last[1];
+    uint64_t running = buf[2] - t->last[2];
+    for (uint32_t k=0; k<PROF_NCOUNTERS; k++) {
+      if (t->pos[k] < 0 || c[k] == PROF_NONE) continue;
+      uint64_t delta = buf[3+t->pos[k]] - t->last[3+t->pos[k]];
+      if (running == 0 && enabled > 0) {
+        // the group never got on the pmu
+        c[k] = PROF_NONE;
+      } else if (running < enabled) {
+        c[k] += (uint64_t)((double)delta*(double)enabled/(double)running);
+      } else {
+        c[k] += delta;
+      }
+    }
+  }
+  memcpy(t->last, buf, sizeof(buf));
+}
+
+
+//// prof_find() ////
+// returns the index of phase name, adds it if it's new, -1 if there's no room for it
+static int prof_find(prof_t* p, const char* name)
+{
+  for (uint32_t i=0; i<p->nphases; i++) {
+    if (!strcmp(p->names[i], name)) return (int)i;
+  }
+  if (p->nphases == PROF_MAX_PHASES) return -1;
+  p->names[p->nphases] = name;
+  return (int)p->nphases++;
+}
+
+
+//// prof_create() ////
+prof_t* prof_create(uint32_t nthreads)
+{
+  prof_t* p = NULL;
+  if (nthreads == 0 || (p = (prof_t*)calloc(1, sizeof(prof_t))) == NULL) return NULL;
+  p->nthreads = nthreads;
+  p->current  = -1;
+  if ((p->threads = (prof_thread_t*)calloc(nthreads, sizeof(prof_thread_t))) == NULL ||
+      (p->counts = (uint64_t*)calloc((size_t)PROF_MAX_PHASES*nthreads*PROF_NCOUNTERS, sizeof(uint64_t))) == NULL) {
+    free(p->threads);
+    free(p);
+    return NULL;
+  }
+  for (uint32_t i=0; i<nthreads; i++) {
+    for (uint32_t k=0; k<PROF_NCOUNTERS; k++) {
+      p->threads[i].fd[k]  = -1;
+      p->threads[i].err[k] = ENOENT;
+      p->threads[i].pos[k] = -1;
+    }
+    p->threads[i].phase = -1;
+  }
+  return p;
+}
+
+
+//// prof_thread() ////
+void prof_thread(prof_t* p, uint32_t thread)
+{
+  prof_thread_t* t = &p->threads[thread];
+  // counters of an earlier thread
+  prof_count(p, thread);
+  for (uint32_t k=0; k<PROF_NCOUNTERS; k++) {
+    if (t->fd[k] >= 0) close(t->fd[k]);
+    t->fd[k]  = -1;
+    t->pos[k] = -1;
+  }
+  int group = -1;
+  int n = 0;
+  for (uint32_t k=0; k<PROF_NCOUNTERS; k++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = prof_counters[k].type;
+    attr.config         = prof_counters[k].config;
+    attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    // the calling thread, on any cpu
+    int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+    if (fd < 0) {
+      t->err[k] = errno;
+      continue;
+    }
+    if (group < 0) group = fd;
+    t->fd[k]  = fd;
+    t->err[k] = 0;
+    t->pos[k] = n++;
+  }
+  if (group >= 0 && prof_read(t, t->last)) {
+    for (uint32_t k=0; k<PROF_NCOUNTERS; k++) {
+      if (t->fd[k] >= 0) close(t->fd[k]);
+      t->fd[k]  = -1;
+      t->err[k] = EIO;
+      t->pos[k] = -1;
+    }
+  }
+}
+
+
+//// prof_thread_phase() ////
+void prof_thread_phase(prof_t* p, uint32_t thread, const char* name)
+{
+  p->threads[thread].phase = prof_find(p, name);
+}
+
+
+//// prof_phase() ////
+void prof_phase(prof_t* p, const char* name)
+{
+  if (p == NULL) return;
+  double t_now = prof_now();
+  for (uint32_t i=0; i<p->nthreads; i++) prof_count(p, i);
+  if (p->current >= 0) p->wall[p->current] += t_now - p->start;
+  p->current = -1;
+  if (name == NULL) return;
+  p->current = prof_find(p, name);
+  p->start = t_now;
+}
+
+
+//// prof_get() ////
+// returns the count of a counter of a thread in a phase, PROF_NONE if the thread didn't
+// open it
+static uint64_t prof_get(const prof_t* p, uint32_t phase, uint32_t thread, uint32_t counter)
+{
+  if (p->threads[thread].pos[counter] < 0) return PROF_NONE;
+  return p->counts[((size_t)phase*p->nthreads + thread)*PROF_NCOUNTERS + counter];
+}
+
+
+//// prof_field() ////
+// formats a count into buf, "-" if it isn't available
+static const char* prof_field(char* buf, size_t size, uint64_t v)
+{
+  if (v == PROF_NONE) snprintf(buf, size, "-");
+  else snprintf(buf, size, "%lu", v);
+  return buf;
+}
+
+
+//// prof_ratio() ////
+// formats num/den*scale into buf, "-" if either isn't available
+static const char* prof_ratio(char* buf, size_t size, uint64_t num, uint64_t den, double scale)
+{
+  if (num == PROF_NONE || den == PROF_NONE || den == 0) snprintf(buf, size, "-");
+  else snprintf(buf, size, "%.2f", (double)num/(double)den*scale);
+  return buf;
+}
+
+
+//// prof_row() ////
+// prints one line of the table, wall < 0 - no wall time (a thread of the phase)
+static void prof_row(FILE* fp, const char* phase, const char* thread, double wall, const uint64_t* c)
+{
+  char wall_buf[32], cpu_buf[32], cycles_buf[32], instr_buf[32], ipc_buf[32], branch_buf[32], cache_buf[32];
+  if (wall < 0.0) snprintf(wall_buf, sizeof(wall_buf), " ");
+  else snprintf(wall_buf, sizeof(wall_buf), "%.1f", wall*1e3);
+  if (c[PROF_CLOCK] == PROF_NONE) snprintf(cpu_buf, sizeof(cpu_buf), "-");
+  else snprintf(cpu_buf, sizeof(cpu_buf), "%.1f", (double)c[PROF_CLOCK]*1e-6);
+  fprintf(fp, "  %-10s %-6s %10s %10s %14s %14s %6s %10s %10s\n", phase, thread, wall_buf, cpu_buf,
+          prof_field(cycles_buf, sizeof(cycles_buf), c[PROF_CYCLES]),
+          prof_field(instr_buf, sizeof(instr_buf), c[PROF_INSTR]),
+          prof_ratio(ipc_buf, sizeof(ipc_buf), c[PROF_INSTR], c[PROF_CYCLES], 1.0),
+          prof_ratio(branch_buf, sizeof(branch_buf), c[PROF_BRANCH], c[PROF_INSTR], 1e3),
+          prof_ratio(cache_buf, sizeof(cache_buf), c[PROF_CACHE], c[PROF_INSTR], 1e3));
+}
+
+
+//// prof_print() ////
+void prof_print(const prof_t* p, FILE* fp)
+{
+  if (p == NULL) return;
+  // counters of the first thread, all threads open the same ones
+  const prof_thread_t* t0 = &p->threads[0];
+  char avail[128] = "", unavail[128] = "";
+  int err = 0;
+  for (uint32_t k=0; k<PROF_NCOUNTERS; k++) {
+    char* list = t0->pos[k] >= 0 ? avail : unavail;
+    size_t len = strlen(list);
+    snprintf(list + len, sizeof(avail) - len, "%s%s", len ? ", " : "", prof_counters[k].name);
+    if (t0->pos[k] < 0 && err == 0) err = t0->err[k];
+  }
+  if (avail[0] == '\0') {
+    fprintf(fp, "profile:            no counters (%s), wall time only\n", strerror(err));
+  } else if (unavail[0] != '\0') {
+    fprintf(fp, "profile:            %s (%s unavailable: %s)\n", avail, unavail, strerror(err));
+  } else {
+    fprintf(fp, "profile:            %s\n", avail);
+  }
+  fprintf(fp, "  %-10s %-6s %10s %10s %14s %14s %6s %10s %10s\n", "phase", "thread", "wall ms", "cpu ms", "cycles", "instructions", "IPC", "br-mis/ki", "$-mis/ki");
+  for (uint32_t ph=0; ph<p->nphases; ph++) {
+    // sum over the threads that have the counter
+    uint64_t total[PROF_NCOUNTERS];
+    for (uint32_t k=0; k<PROF_NCOUNTERS; k++) {
+      total[k] = PROF_NONE;
+      for (uint32_t i=0; i<p->nthreads; i++) {
+        uint64_t v = prof_get(p, ph, i, k);
+        if (v != PROF_NONE) total[k] = (total[k] == PROF_NONE ? 0 : total[k]) + v;
+      }
+    }
+    prof_row(fp, p->names[ph], "all", p->wall[ph], total);
+    for (uint32_t i=0; i<p->nthreads && p->nthreads > 1; i++) {
+      char thread[16];
+      uint64_t c[PROF_NCOUNTERS];
+      snprintf(thread, sizeof(thread), "%u", i);
+      for (uint32_t k=0; k<PROF_NCOUNTERS; k++) c[k] = prof_get(p, ph, i, k);
+      prof_row(fp, "", thread, -1.0, c);
+    }
+  }
+}
+
+
+//// prof_destroy() ////
+void prof_destroy(prof_t* p)
+{
+  if (p == NULL) return;
+  for (uint32_t i=0; i<p->nthreads; i++) {
+    for (uint32_t k=0; k<PROF_NCOUNTERS; k++) {
+      if (p->threads[i].fd[k] >= 0) close(p->threads[i].fd[k]);
+    }
+  }
+  free(p->counts);
+  free(p->threads);
+  free(p);
+}
+
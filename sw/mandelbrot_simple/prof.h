@@ -0,0 +1,51 @@
+// prof.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// per-thread hardware counters (perf_event_open) of the phases of a run
+
+
+#ifndef __PROF_H__
+#define __PROF_H__
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdint.h>
+
+
+//// types ////
+// prof_t
+// opaque profile of nthreads threads, split into named phases
+typedef struct prof_s prof_t;
+
+
+//// functions ////
+// creates a profile of nthreads threads, returns NULL on error
+prof_t* prof_create(uint32_t nthreads);
+
+// opens the counters (task clock, cycles, instructions, branch & cache misses) of the
+// calling thread, which is thread (0 .. nthreads-1) of the profile; counters that can't be
+// opened (no pmu, perf_event_paranoid, seccomp) are left out & reported by prof_print();
+// when another thread opened them before (short lived threads, like the writer's of each
+// band), its counts are added up first
+void prof_thread(prof_t* p, uint32_t thread);
+
+// makes the counts of thread always go to phase name, whatever the current phase is, for
+// threads that only do one kind of work (like the output writer's); call it before the
+// thread opens its counters
+void prof_thread_phase(prof_t* p, uint32_t thread, const char* name);
+
+// ends the current phase & starts phase name (NULL - none), the counts of all threads
+// since the last call go to the current phase; a phase that is started again continues
+// its counts; the threads should be idle, so that the counts end on the phase boundary
+void prof_phase(prof_t* p, const char* name);
+
+// prints wall & cpu time, the counts, IPC & misses per 1000 instructions of each phase,
+// summed over all threads & of each thread
+void prof_print(const prof_t* p, FILE* fp);
+
+// closes the counters & frees the profile (NULL - nothing)
+void prof_destroy(prof_t* p);
+
+
+#endif // __PROF_H__
+
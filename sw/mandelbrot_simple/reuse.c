@@ -0,0 +1,108 @@
+// reuse.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// frame-to-frame reuse of iteration counts on the fixed-point pixel grid (pans & exact zooms)
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "reuse.h"
+
+
+//// types ////
+// reuse_s
+// previous frame
+struct reuse_s {
+  uint32_t     img_w;
+  uint32_t     img_h;
+  int          valid;       // a frame is cached
+  reuse_grid_t grid;
+  uint32_t*    iterations;
+  int32_t*     map_x;       // cached column of each column of the new frame (-1 - none)
+  int32_t*     map_y;       // cached row of each row of the new frame (-1 - none)
+};
+
+
+//// reuse_map() ////
+// maps the n pixels of a new axis (p0 + i*ps) to the pixels of the cached axis (c0 + k*cs),
+// k = (p0 - c0 + i*ps) / cs where that division is exact, returns the number of mapped pixels
+static uint32_t reuse_map(FP p0, FP ps, FP c0, FP cs, uint32_t n, int32_t* map)
+{
+  uint32_t nmapped = 0;
+  for (uint32_t i=0; i<n; i++) {
+    __int128 d = (__int128)p0 - c0 + (__int128)i*ps;
+    map[i] = -1;
+    if (cs <= 0 || d < 0 || d % cs) continue;
+    __int128 k = d / cs;
+    if (k >= n) continue;
+    map[i] = (int32_t)k;
+    nmapped++;
+  }
+  return nmapped;
+}
+
+
+//// reuse_create() ////
+reuse_t* reuse_create(uint32_t img_w, uint32_t img_h)
+{
+  reuse_t* c = NULL;
+  if ((c = (reuse_t*)calloc(1, sizeof(reuse_t))) == NULL) return NULL;
+  c->img_w      = img_w;
+  c->img_h      = img_h;
+  c->iterations = (uint32_t*)malloc((size_t)img_w*img_h * sizeof(uint32_t));
+  c->map_x      = (int32_t*)malloc(img_w * sizeof(int32_t));
+  c->map_y      = (int32_t*)malloc(img_h * sizeof(int32_t));
+  if (c->iterations == NULL || c->map_x == NULL || c->map_y == NULL) {
+    reuse_destroy(c);
+    return NULL;
+  }
+  return c;
+}
+
+
+//// reuse_destroy() ////
+void reuse_destroy(reuse_t* c)
+{
+  if (c == NULL) return;
+  free(c->iterations);
+  free(c->map_x);
+  free(c->map_y);
+  free(c);
+}
+
+
+//// reuse_fill() ////
+uint64_t reuse_fill(const reuse_t* c, const reuse_grid_t* g, uint32_t* iterations, uint8_t* known)
+{
+  memset(known, 0, (size_t)c->img_w*c->img_h);
+  if (!c->valid) return 0;
+  // both axes map independently, the reused pixels are where a mapped row crosses a mapped column
+  if (!reuse_map(g->x0, g->xs, c->grid.x0, c->grid.xs, c->img_w, c->map_x)) return 0;
+  if (!reuse_map(g->y0, g->ys, c->grid.y0, c->grid.ys, c->img_h, c->map_y)) return 0;
+  uint64_t nreused = 0;
+  for (uint32_t y=0; y<c->img_h; y++) {
+    if (c->map_y[y] < 0) continue;
+    const uint32_t* src = c->iterations + (size_t)c->map_y[y]*c->img_w;
+    uint32_t* dst = iterations + (size_t)y*c->img_w;
+    uint8_t* dst_known = known + (size_t)y*c->img_w;
+    for (uint32_t x=0; x<c->img_w; x++) {
+      if (c->map_x[x] < 0) continue;
+      dst[x] = src[c->map_x[x]];
+      dst_known[x] = 1;
+      nreused++;
+    }
+  }
+  return nreused;
+}
+
+
+//// reuse_store() ////
+void reuse_store(reuse_t* c, const reuse_grid_t* g, const uint32_t* iterations)
+{
+  memcpy(c->iterations, iterations, (size_t)c->img_w*c->img_h * sizeof(uint32_t));
+  c->grid  = *g;
+  c->valid = 1;
+}
+
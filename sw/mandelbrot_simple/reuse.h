@@ -0,0 +1,48 @@
+// reuse.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// frame-to-frame reuse of iteration counts on the fixed-point pixel grid (pans & exact zooms)
+
+
+#ifndef __REUSE_H__
+#define __REUSE_H__
+
+
+//// includes ////
+#include <stdint.h>
+#include "fp.h"
+
+
+//// types ////
+// reuse_grid_t
+// fixed-point pixel grid of a frame, pixel (x, y) is at (x0 + x*xs, y0 + y*ys),
+// the same as the FPGA engine steps through it (see mandelbrot_coords.v)
+typedef struct {
+  FP x0;
+  FP y0;
+  FP xs;
+  FP ys;
+} reuse_grid_t;
+
+// reuse_t
+// opaque cache of the previous frame
+typedef struct reuse_s reuse_t;
+
+
+//// functions ////
+// creates an empty cache for img_w x img_h frames, returns NULL on error
+reuse_t* reuse_create(uint32_t img_w, uint32_t img_h);
+
+// frees the cache
+void reuse_destroy(reuse_t* c);
+
+// fills in the pixels of the frame on grid g that land exactly on a pixel of the cached
+// frame (integer pixel pans, power-of-two zooms & any other grid that lines up) &
+// marks them in known (one byte per pixel); returns the number of reused pixels
+uint64_t reuse_fill(const reuse_t* c, const reuse_grid_t* g, uint32_t* iterations, uint8_t* known);
+
+// replaces the cached frame with the frame on grid g
+void reuse_store(reuse_t* c, const reuse_grid_t* g, const uint32_t* iterations);
+
+
+#endif // __REUSE_H__
+
@@ -0,0 +1,308 @@
+// sched.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// persistent thread pool with per-thread work-stealing deques & 2D tile scheduler
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "sched.h"
+
+
+//// defines ////
+// number of tiles per worker the tile size is chosen for
+#define SCHED_TILES_PER_THREAD  32U
+// minimal tile edge (multiple of the widest SIMD kernel step)
+#define SCHED_TILE_MIN          16U
+// maximal tile edge
+#define SCHED_TILE_MAX          256U
+
+
+//// types ////
+// sched_deque_t
+// per-worker task deque, the owner pops from the bottom, thieves steal from the top
+typedef struct {
+  pthread_mutex_t lock;
+  uint32_t* tasks;
+  uint32_t  size;
+  uint32_t  top;
+  uint32_t  bottom;
+} sched_deque_t;
+
+// sched_worker_t
+// worker thread arguments
+typedef struct {
+  sched_t*  s;
+  uint32_t  id;
+} sched_worker_t;
+
+// sched_s
+// thread pool
+struct sched_s {
+  uint32_t        nthreads;
+  pthread_t*      threads;
+  sched_worker_t* workers;
+  sched_deque_t*  deques;
+  pthread_mutex_t lock;
+  pthread_cond_t  start_cond;
+  pthread_cond_t  done_cond;
+  uint64_t        generation;
+  uint32_t        running;
+  uint32_t        quit;
+  uint32_t        each;
+  sched_task_fn   fn;
+  void*           arg;
+};
+
+// sched_tiles_t
+// tile job description
+typedef struct {
+  sched_tile_fn fn;
+  void*         arg;
+  uint32_t      img_w;
+  uint32_t      img_h;
+  uint32_t      tile_w;
+  uint32_t      tile_h;
+  uint32_t      ntiles_x;
+} sched_tiles_t;
+
+
+//// sched_pop() ////
+static int sched_pop(sched_deque_t* d, uint32_t* task)
+{
+  int ok = 0;
+  pthread_mutex_lock(&d->lock);
+  if (d->bottom > d->top) {
+    *task = d->tasks[--d->bottom];
+    ok = 1;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return ok;
+}
+
+
+//// sched_steal() ////
+static int sched_steal(sched_deque_t* d, uint32_t* task)
+{
+  int ok = 0;
+  pthread_mutex_lock(&d->lock);
+  if (d->bottom > d->top) {
+    *task = d->tasks[d->top++];
+    ok = 1;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return ok;
+}
+
+
+//// sched_work() ////
+// runs own tasks first, then steals from the other workers until all deques are empty
+static void sched_work(sched_t* s, uint32_t id)
+{
+  // sched_each(), one task on every worker
+  if (s->each) {
+    s->fn(s->arg, id, id);
+    return;
+  }
+  uint32_t task;
+  for (;;) {
+    if (sched_pop(&s->deques[id], &task)) {
+      s->fn(s->arg, id, task);
+      continue;
+    }
+    uint32_t stolen = 0;
+    for (uint32_t i=1; i<s->nthreads && !stolen; i++) {
+      stolen = sched_steal(&s->deques[(id+i)%s->nthreads], &task);
+    }
+    if (!stolen) break;
+    s->fn(s->arg, id, task);
+  }
+}
+
+
+//// sched_thread() ////
+// worker thread, sleeps between jobs
+static void* sched_thread(void* p)
+{
+  sched_worker_t* w = (sched_worker_t*)p;
+  sched_t* s = w->s;
+  uint64_t generation = 0;
+  for (;;) {
+    pthread_mutex_lock(&s->lock);
+    while (s->generation == generation && !s->quit) pthread_cond_wait(&s->start_cond, &s->lock);
+    generation = s->generation;
+    uint32_t quit = s->quit;
+    pthread_mutex_unlock(&s->lock);
+    if (quit) break;
+    sched_work(s, w->id);
+    pthread_mutex_lock(&s->lock);
+    if (--s->running == 0) pthread_cond_signal(&s->done_cond);
+    pthread_mutex_unlock(&s->lock);
+  }
+  return NULL;
+}
+
+
+//// sched_create() ////
+sched_t* sched_create(uint32_t nthreads)
+{
+  if (nthreads == 0) {
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = ncpus > 0 ? (uint32_t)ncpus : 1;
+  }
+  sched_t* s = NULL;
+  if ((s = (sched_t*)calloc(1, sizeof(sched_t))) == NULL) return NULL;
+  s->nthreads = nthreads;
+  s->threads  = (pthread_t*)calloc(nthreads, sizeof(pthread_t));
+  s->workers  = (sched_worker_t*)calloc(nthreads, sizeof(sched_worker_t));
+  s->deques   = (sched_deque_t*)calloc(nthreads, sizeof(sched_deque_t));
+  if (s->threads == NULL || s->workers == NULL || s->deques == NULL) {
+    free(s->threads);
+    free(s->workers);
+    free(s->deques);
+    free(s);
+    return NULL;
+  }
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->start_cond, NULL);
+  pthread_cond_init(&s->done_cond, NULL);
+  for (uint32_t i=0; i<nthreads; i++) {
+    pthread_mutex_init(&s->deques[i].lock, NULL);
+    s->workers[i].s  = s;
+    s->workers[i].id = i;
+  }
+  // worker 0 is the calling thread
+  for (uint32_t i=1; i<nthreads; i++) {
+    if (pthread_create(&s->threads[i], NULL, sched_thread, &s->workers[i])) {
+      fprintf(stderr, "Can't create worker thread, exiting.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  return s;
+}
+
+
+//// sched_destroy() ////
+void sched_destroy(sched_t* s)
+{
+  if (s == NULL) return;
+  pthread_mutex_lock(&s->lock);
+  s->quit = 1;
+  pthread_cond_broadcast(&s->start_cond);
+  pthread_mutex_unlock(&s->lock);
+  for (uint32_t i=1; i<s->nthreads; i++) pthread_join(s->threads[i], NULL);
+  for (uint32_t i=0; i<s->nthreads; i++) {
+    pthread_mutex_destroy(&s->deques[i].lock);
+    free(s->deques[i].tasks);
+  }
+  pthread_cond_destroy(&s->done_cond);
+  pthread_cond_destroy(&s->start_cond);
+  pthread_mutex_destroy(&s->lock);
+  free(s->threads);
+  free(s->workers);
+  free(s->deques);
+  free(s);
+}
+
+
+//// sched_nthreads() ////
+uint32_t sched_nthreads(const sched_t* s)
+{
+  return s->nthreads;
+}
+
+
+//// sched_job() ////
+// wakes up the workers, runs the job on the calling thread too & waits for the workers
+static void sched_job(sched_t* s, sched_task_fn fn, void* arg, uint32_t each)
+{
+  pthread_mutex_lock(&s->lock);
+  s->fn      = fn;
+  s->arg     = arg;
+  s->each    = each;
+  s->running = s->nthreads-1;
+  s->generation++;
+  pthread_cond_broadcast(&s->start_cond);
+  pthread_mutex_unlock(&s->lock);
+  sched_work(s, 0);
+  pthread_mutex_lock(&s->lock);
+  while (s->running) pthread_cond_wait(&s->done_cond, &s->lock);
+  pthread_mutex_unlock(&s->lock);
+}
+
+
+//// sched_run() ////
+void sched_run(sched_t* s, uint32_t ntasks, sched_task_fn fn, void* arg)
+{
+  // deal tasks round-robin, so that each worker starts with tasks spread over the whole job
+  uint32_t per_worker = (ntasks + s->nthreads - 1) / s->nthreads;
+  for (uint32_t i=0; i<s->nthreads; i++) {
+    sched_deque_t* d = &s->deques[i];
+    if (d->size < per_worker) {
+      free(d->tasks);
+      if ((d->tasks = (uint32_t*)malloc(per_worker * sizeof(uint32_t))) == NULL) {
+        fprintf(stderr, "Can't allocate task deque, exiting.\n");
+        exit(EXIT_FAILURE);
+      }
+      d->size = per_worker;
+    }
+    d->top    = 0;
+    d->bottom = 0;
+  }
+  // reversed, so that owners pop their tasks in ascending order
+  for (uint32_t t=ntasks; t-->0; ) {
+    sched_deque_t* d = &s->deques[t%s->nthreads];
+    d->tasks[d->bottom++] = t;
+  }
+  sched_job(s, fn, arg, 0);
+}
+
+
+//// sched_each() ////
+void sched_each(sched_t* s, sched_task_fn fn, void* arg)
+{
+  sched_job(s, fn, arg, 1);
+}
+
+
+//// sched_tile_size() ////
+void sched_tile_size(const sched_t* s, uint32_t img_w, uint32_t img_h, uint32_t* tile_w, uint32_t* tile_h)
+{
+  uint64_t target = (uint64_t)s->nthreads * SCHED_TILES_PER_THREAD;
+  uint32_t edge = SCHED_TILE_MAX;
+  while (edge > SCHED_TILE_MIN && (uint64_t)((img_w+edge-1)/edge) * ((img_h+edge-1)/edge) < target) edge >>= 1;
+  *tile_w = edge;
+  *tile_h = edge;
+}
+
+
+//// sched_tile_task() ////
+static void sched_tile_task(void* arg, uint32_t worker, uint32_t task)
+{
+  sched_tiles_t* t = (sched_tiles_t*)arg;
+  uint32_t tile_x = (task % t->ntiles_x) * t->tile_w;
+  uint32_t tile_y = (task / t->ntiles_x) * t->tile_h;
+  uint32_t tile_w = t->img_w-tile_x < t->tile_w ? t->img_w-tile_x : t->tile_w;
+  uint32_t tile_h = t->img_h-tile_y < t->tile_h ? t->img_h-tile_y : t->tile_h;
+  t->fn(t->arg, worker, tile_x, tile_y, tile_w, tile_h);
+}
+
+
+//// sched_tiles() ////
+void sched_tiles(sched_t* s, uint32_t img_w, uint32_t img_h, sched_tile_fn fn, void* arg)
+{
+  sched_tiles_t t;
+  t.fn    = fn;
+  t.arg   = arg;
+  t.img_w = img_w;
+  t.img_h = img_h;
+  sched_tile_size(s, img_w, img_h, &t.tile_w, &t.tile_h);
+  t.ntiles_x = (img_w + t.tile_w - 1) / t.tile_w;
+  uint32_t ntiles_y = (img_h + t.tile_h - 1) / t.tile_h;
+  sched_run(s, t.ntiles_x * ntiles_y, sched_tile_task, &t);
+}
+
@@ -0,0 +1,53 @@
+// sched.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// persistent thread pool with per-thread work-stealing deques & 2D tile scheduler
+
+
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+
+//// includes ////
+#include <stdint.h>
+
+
+//// types ////
+// sched_t
+// opaque thread pool, workers stay alive until sched_destroy()
+typedef struct sched_s sched_t;
+
+// sched_task_fn
+// runs one task, worker is the index of the calling worker (0 .. nthreads-1)
+typedef void (*sched_task_fn)(void* arg, uint32_t worker, uint32_t task);
+
+// sched_tile_fn
+// renders one image tile (tile_x, tile_y) - (tile_x+tile_w-1, tile_y+tile_h-1)
+typedef void (*sched_tile_fn)(void* arg, uint32_t worker, uint32_t tile_x, uint32_t tile_y, uint32_t tile_w, uint32_t tile_h);
+
+
+//// functions ////
+// creates a pool of nthreads workers (0 - one per online cpu), the calling thread is worker 0
+sched_t* sched_create(uint32_t nthreads);
+
+// stops & frees the pool
+void sched_destroy(sched_t* s);
+
+// returns the number of workers in the pool
+uint32_t sched_nthreads(const sched_t* s);
+
+// runs tasks 0 .. ntasks-1 on all workers & waits for them to finish
+void sched_run(sched_t* s, uint32_t ntasks, sched_task_fn fn, void* arg);
+
+// runs fn once on every worker (task is the worker index) & waits for them to finish, for
+// per-thread setup like thread local counters
+void sched_each(sched_t* s, sched_task_fn fn, void* arg);
+
+// picks a tile size for the image, so that there are enough tiles per worker to balance the load
+void sched_tile_size(const sched_t* s, uint32_t img_w, uint32_t img_h, uint32_t* tile_w, uint32_t* tile_h);
+
+// splits the image into tiles & renders them on all workers
+void sched_tiles(sched_t* s, uint32_t img_w, uint32_t img_h, sched_tile_fn fn, void* arg);
+
+
+#endif // __SCHED_H__
+
@@ -0,0 +1,214 @@
+// ssaa.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// edge-adaptive supersampling, extra jittered samples only where the colors change
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "ssaa.h"
+
+
+//// defines ////
+// words of row scratch: edge pixel positions, 3 quadrant samples per edge pixel & the
+// 2 x 3*img_w bytes of edge detection
+#define SSAA_SCRATCH(w) (4*(uint64_t)(w) + (6*(uint64_t)(w) + 3)/4)
+
+
+//// types ////
+// ssaa_run_t
+// shared state of the row tasks
+typedef struct {
+  const ssaa_t* a;
+  ssaa_stats_t* stats;
+  uint32_t      grid;         // samples are jittered on a grid x grid raster of the pixel
+  uint32_t*     scratch;      // SSAA_SCRATCH(img_w) words of each worker
+} ssaa_run_t;
+
+
+//// ssaa_hash() ////
+// mixes 32 bits (lowbias32)
+static uint32_t ssaa_hash(uint32_t x)
+{
+  x ^= x >> 16;
+  x *= 0x7feb352dU;
+  x ^= x >> 15;
+  x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return x;
+}
+
+
+//// ssaa_edges() ////
+// finds the pixels of row y where any of the 8 neighbours differs in color by more than
+// threshold, from the min & max of each channel over the 3x3 neighbourhood (columns first);
+// lo & hi are scratch of 3*img_w bytes, returns the number of edge pixels stored in xs
+static uint32_t ssaa_edges(const ssaa_t* a, uint32_t y, uint8_t* lo, uint8_t* hi, uint32_t* xs)
+{
+  // locals, as the byte stores could alias a
+  const rgb_t* palette = a->palette;
+  uint32_t threshold = a->threshold;
+  uint32_t w = a->img_w;
+  uint32_t y0 = y > 0 ? y-1 : 0;
+  uint32_t y1 = y+1 < a->img_h ? y+1 : y;
+  const uint32_t* row = a->iterations + (uint64_t)y*w;
+  memset(lo, 255, 3*w);
+  memset(hi, 0, 3*w);
+  for (uint32_t ny=y0; ny<=y1; ny++) {
+    const uint32_t* nrow = a->iterations + (uint64_t)ny*w;
+    for (uint32_t x=0; x<w; x++) {
+      const uint8_t* c = &palette[nrow[x]].r;
+      for (uint32_t k=0; k<3; k++) {
+        lo[3*x+k] = c[k] < lo[3*x+k] ? c[k] : lo[3*x+k];
+        hi[3*x+k] = c[k] > hi[3*x+k] ? c[k] : hi[3*x+k];
+      }
+    }
+  }
+  uint32_t n = 0;
+  for (uint32_t x=0; x<w; x++) {
+    uint32_t x0 = x > 0 ? x-1 : 0;
+    uint32_t x1 = x+1 < w ? x+1 : x;
+    const uint8_t* c = &palette[row[x]].r;
+    int edge = 0;
+    for (uint32_t k=0; k<3; k++) {
+      uint32_t l = lo[3*x0+k], h = hi[3*x0+k];
+      l = lo[3*x+k]  < l ? lo[3*x+k]  : l;
+      h = hi[3*x+k]  > h ? hi[3*x+k]  : h;
+      l = lo[3*x1+k] < l ? lo[3*x1+k] : l;
+      h = hi[3*x1+k] > h ? hi[3*x1+k] : h;
+      edge |= h - c[k] > threshold || c[k] - l > threshold;
+    }
+    xs[n] = x;
+    n += edge;
+  }
+  return n;
+}
+
+
+//// ssaa_similar() ////
+// checks if two iteration counts have colors within threshold
+static int ssaa_similar(const ssaa_t* a, uint32_t i0, uint32_t i1)
+{
+  const rgb_t* c0 = &a->palette[i0];
+  const rgb_t* c1 = &a->palette[i1];
+  return (uint32_t)abs((int)c0->r - (int)c1->r) <= a->threshold &&
+         (uint32_t)abs((int)c0->g - (int)c1->g) <= a->threshold &&
+         (uint32_t)abs((int)c0->b - (int)c1->b) <= a->threshold;
+}
+
+
+//// ssaa_samples() ////
+// calculates the jittered samples in grid cells cells[0] .. cells[ncells-1] of pixels
+// (xs[i], y), one jittered sample per cell; results are stored pixel by pixel in out
+static void ssaa_samples(const ssaa_run_t* run, uint32_t worker, uint32_t y, const uint32_t* xs, uint32_t npix, const uint32_t* cells, uint32_t ncells, uint32_t* out)
+{
+  const ssaa_t* a = run->a;
+  double img_x[SSAA_CHUNK];
+  double img_y[SSAA_CHUNK];
+  uint32_t total = npix*ncells;
+  for (uint32_t i=0; i<total; i+=SSAA_CHUNK) {
+    uint32_t n = total-i < SSAA_CHUNK ? total-i : SSAA_CHUNK;
+    for (uint32_t j=0; j<n; j++) {
+      uint32_t x = xs[(i+j)/ncells];
+      uint32_t k = cells[(i+j)%ncells];
+      uint32_t h = ssaa_hash(ssaa_hash(y*0x9e3779b9U ^ x) + k);
+      img_x[j] = (double)x + ((double)(k % run->grid) + (double)(h & 0xffff)/65536.0)/(double)run->grid;
+      img_y[j] = (double)y + ((double)(k / run->grid) + (double)(h >> 16)/65536.0)/(double)run->grid;
+    }
+    a->points(a->arg, worker, img_x, img_y, n, out+i);
+  }
+}
+
+
+//// ssaa_average() ////
+// replaces the pixel with the average color of its own & n extra samples
+static void ssaa_average(const ssaa_t* a, uint32_t x, uint32_t y, const uint32_t* iter, uint32_t n)
+{
+  uint64_t i = (uint64_t)y*a->img_w + x;
+  const rgb_t* c = &a->palette[a->iterations[i]];
+  uint32_t r = c->r, g = c->g, b = c->b;
+  for (uint32_t k=0; k<n; k++) {
+    c = &a->palette[iter[k]];
+    r += c->r;
+    g += c->g;
+    b += c->b;
+  }
+  a->rgb[3*i+0] = (uint8_t)((r + (n+1)/2) / (n+1));
+  a->rgb[3*i+1] = (uint8_t)((g + (n+1)/2) / (n+1));
+  a->rgb[3*i+2] = (uint8_t)((b + (n+1)/2) / (n+1));
+}
+
+
+//// ssaa_row() ////
+// supersamples the edge pixels of one row: one sample in each of the other three
+// quadrants first, the rest of the grid only if they don't agree with the pixel's
+// own sample (which is in the first cell); the samples of several pixels are
+// calculated together to keep the kernel lanes busy
+static void ssaa_row(void* arg, uint32_t worker, uint32_t task)
+{
+  const ssaa_run_t* run = (const ssaa_run_t*)arg;
+  const ssaa_t* a = run->a;
+  uint32_t grid = run->grid;
+  uint32_t half = grid/2;
+  uint32_t probe_cells[3] = {half, half*grid, half*grid + half};
+  uint32_t rest_cells[SSAA_CHUNK];
+  uint32_t nrest = 0;
+  for (uint32_t k=1; k<a->samples; k++) {
+    if (k != probe_cells[0] && k != probe_cells[1] && k != probe_cells[2]) rest_cells[nrest++] = k;
+  }
+  uint32_t* xs = run->scratch + worker*SSAA_SCRATCH(a->img_w);
+  uint32_t* probes = xs + a->img_w;
+  uint8_t* lo = (uint8_t*)(probes + 3 * a->img_w);
+  uint8_t* hi = lo + 3 * a->img_w;
+
+  // edge pixels & their quadrant samples
+  uint32_t nedge = ssaa_edges(a, task, lo, hi, xs);
+  ssaa_samples(run, worker, task, xs, nedge, probe_cells, 3, probes);
+  run->stats[worker].pixels  += nedge;
+  run->stats[worker].samples += 3*(uint64_t)nedge;
+
+  // pixels, where the quadrants agree, are done, the others get the whole grid
+  uint32_t nfull = 0;
+  for (uint32_t i=0; i<nedge; i++) {
+    uint32_t own = a->iterations[(uint64_t)task*a->img_w + xs[i]];
+    const uint32_t* p = probes + 3*i;
+    if (nrest == 0 || (ssaa_similar(a, own, p[0]) && ssaa_similar(a, own, p[1]) && ssaa_similar(a, own, p[2]))) {
+      ssaa_average(a, xs[i], task, p, 3);
+    } else {
+      // probes of the pixels kept in the same order, so they are reused below
+      probes[3*nfull+0] = p[0];
+      probes[3*nfull+1] = p[1];
+      probes[3*nfull+2] = p[2];
+      xs[nfull++] = xs[i];
+    }
+  }
+  uint32_t iter[SSAA_CHUNK+3];
+  uint32_t group = nrest ? SSAA_CHUNK/nrest : 1;
+  for (uint32_t i=0; i<nfull; i+=group) {
+    uint32_t npix = nfull-i < group ? nfull-i : group;
+    uint32_t rest[SSAA_CHUNK];
+    ssaa_samples(run, worker, task, xs+i, npix, rest_cells, nrest, rest);
+    for (uint32_t p=0; p<npix; p++) {
+      memcpy(iter, probes+3*(i+p), 3*sizeof(uint32_t));
+      memcpy(iter+3, rest+p*nrest, nrest*sizeof(uint32_t));
+      ssaa_average(a, xs[i+p], task, iter, nrest+3);
+    }
+  }
+  run->stats[worker].samples += (uint64_t)nfull*nrest;
+}
+
+
+//// ssaa_image() ////
+int ssaa_image(const ssaa_t* a, sched_t* s, ssaa_stats_t* stats)
+{
+  ssaa_run_t run = {a, stats, (uint32_t)(sqrt((double)a->samples) + 0.5), NULL};
+  // scratch of each worker, allocated once instead of once per row
+  if ((run.scratch = (uint32_t*)malloc(sched_nthreads(s) * SSAA_SCRATCH(a->img_w) * sizeof(uint32_t))) == NULL) return -1;
+  sched_run(s, a->img_h, ssaa_row, &run);
+  free(run.scratch);
+  return 0;
+}
+
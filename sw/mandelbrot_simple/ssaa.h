@@ -0,0 +1,59 @@
+// ssaa.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// edge-adaptive supersampling, extra jittered samples only where the colors change
+// NOTE: the cost follows the share of edge pixels: ~2x the plain render with 4 samples on
+// smooth views, up to ~3x (4 samples) & ~7x (16 samples) on filament-dense ones
+
+
+#ifndef __SSAA_H__
+#define __SSAA_H__
+
+
+//// includes ////
+#include <stdint.h>
+#include "sched.h"
+#include "ppm.h"
+
+
+//// defines ////
+// maximal number of points passed to the points function at once
+#define SSAA_CHUNK 256U
+
+
+//// types ////
+// ssaa_points_fn
+// calculates number of iterations for n (at most SSAA_CHUNK) points at image
+// coordinates (img_x[i], img_y[i]) on the given worker, pixel (x, y) is sampled at (x, y)
+typedef void (*ssaa_points_fn)(void* arg, uint32_t worker, const double* img_x, const double* img_y, uint32_t n, uint32_t* iterations);
+
+// ssaa_t
+// supersampling parameters
+typedef struct {
+  ssaa_points_fn  points;     // sample calculation function
+  void*           arg;        // argument of points
+  const uint32_t* iterations; // image iterations array, one sample per pixel
+  uint32_t        img_w;      // image width
+  uint32_t        img_h;      // image height
+  const rgb_t*    palette;    // one color per iteration count
+  uint32_t        samples;    // samples per edge pixel, a square (4, 9, 16 .. 256)
+  uint32_t        threshold;  // color difference to a neighbour that makes a pixel an edge
+  uint8_t*        rgb;        // colored image, edge pixels are replaced with the samples' average
+} ssaa_t;
+
+// ssaa_stats_t
+// supersampling statistics
+typedef struct {
+  uint64_t pixels;            // number of supersampled (edge) pixels
+  uint64_t samples;           // number of extra samples
+} ssaa_stats_t;
+
+
+//// functions ////
+// finds the edge pixels of the image & supersamples them on all workers, stats has
+// one entry per worker; the jitter is a hash of the pixel position, so it's reproducible;
+// returns 0 on success, -1 if the row buffers can't be allocated (the image is left as it is)
+int ssaa_image(const ssaa_t* a, sched_t* s, ssaa_stats_t* stats);
+
+
+#endif // __SSAA_H__
+
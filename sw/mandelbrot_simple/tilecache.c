@@ -0,0 +1,447 @@
+// tilecache.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// tile cache of the tile server: in-memory LRU, on-disk cache, coalescing & cancellation
+// NOTE: all tiles are in one hash table, done tiles are also on the LRU list & queued
+// ones on the render queue; tiles somebody waits for (pinned) are never freed
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "tilecache.h"
+
+
+//// defines ////
+// maximal length of a tile file name
+#define TILECACHE_PATH_MAX  1024U
+
+
+//// types ////
+// tile_state_t
+// tile life cycle
+typedef enum {
+  TILE_QUEUED = 0,            // waiting on the render queue
+  TILE_RENDERING,             // taken by tilecache_next()
+  TILE_DONE                   // data valid, on the LRU list
+} tile_state_t;
+
+// tile_s
+// cache entry
+struct tile_s {
+  tile_key_t   key;
+  uint64_t     hash;
+  tile_state_t state;
+  uint32_t     waiters;       // requests waiting for or sending the tile
+  int          cancel;        // rendering, but nobody waits for it anymore
+  uint8_t*     data;
+  uint32_t     len;
+  tile_t*      hnext;         // hash chain
+  tile_t*      prev;          // LRU list or render queue, the most recent first
+  tile_t*      next;
+};
+
+// tile_list_t
+// doubly linked tile list
+typedef struct {
+  tile_t*  head;
+  tile_t*  tail;
+  uint32_t n;
+} tile_list_t;
+
+// tilecache_s
+// tile cache
+struct tilecache_s {
+  uint32_t          max_tiles;
+  char*             dir;
+  tile_t**          buckets;
+  uint32_t          nbuckets;   // power of 2
+  tile_list_t       lru;
+  tile_list_t       queue;
+  pthread_mutex_t   lock;
+  pthread_cond_t    done_cond;  // a tile is done
+  pthread_cond_t    queue_cond; // a tile is queued
+  uint32_t          quit;
+  tilecache_stats_t stats;
+};
+
+
+//// tile_hash() ////
+// returns the 64-bit FNV-1a hash of the key, also names the tile file
+static uint64_t tile_hash(const tile_key_t* key)
+{
+  uint64_t words[4] = {key->level, key->x, key->y, key->niter};
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (uint32_t i=0; i<4; i++) {
+    for (uint32_t b=0; b<64; b+=8) {
+      h ^= (words[i] >> b) & 0xff;
+      h *= 0x100000001b3ULL;
+    }
+  }
+  return h;
+}
+
+
+//// tile_key_eq() ////
+// compares two keys
+static int tile_key_eq(const tile_key_t* a, const tile_key_t* b)
+{
+  return a->level == b->level && a->x == b->x && a->y == b->y && a->niter == b->niter;
+}
+
+
+//// tile_list_push() ////
+// puts the tile at the head of the list
+static void tile_list_push(tile_list_t* l, tile_t* t)
+{
+  t->prev = NULL;
+  t->next = l->head;
+  if (l->head) l->head->prev = t; else l->tail = t;
+  l->head = t;
+  l->n++;
+}
+
+
+//// tile_list_remove() ////
+// takes the tile off the list
+static void tile_list_remove(tile_list_t* l, tile_t* t)
+{
+  if (t->prev) t->prev->next = t->next; else l->head = t->next;
+  if (t->next) t->next->prev = t->prev; else l->tail = t->prev;
+  t->prev = NULL;
+  t->next = NULL;
+  l->n--;
+}
+
+
+//// tilecache_find() ////
+// returns the tile with the key or NULL, the lock must be held
+static tile_t* tilecache_find(const tilecache_t* c, const tile_key_t* key, uint64_t hash)
+{
+  for (tile_t* t=c->buckets[hash & (c->nbuckets-1)]; t; t=t->hnext) {
+    if (t->hash == hash && tile_key_eq(&t->key, key)) return t;
+  }
+  return NULL;
+}
+
+
+//// tilecache_insert() ////
+// adds a new tile to the hash table, the lock must be held
+static tile_t* tilecache_insert(tilecache_t* c, const tile_key_t* key, uint64_t hash)
+{
+  tile_t* t = NULL;
+  if ((t = (tile_t*)calloc(1, sizeof(tile_t))) == NULL) return NULL;
+  t->key   = *key;
+  t->hash  = hash;
+  t->hnext = c->buckets[hash & (c->nbuckets-1)];
+  c->buckets[hash & (c->nbuckets-1)] = t;
+  return t;
+}
+
+
+//// tilecache_free() ////
+// removes the tile from the hash table & frees it, the tile must not be on a list
+// & the lock must be held
+static void tilecache_free(tilecache_t* c, tile_t* t)
+{
+  tile_t** p = &c->buckets[t->hash & (c->nbuckets-1)];
+  while (*p != t) p = &(*p)->hnext;
+  *p = t->hnext;
+  free(t->data);
+  free(t);
+}
+
+
+//// tilecache_evict() ////
+// frees the least recently used done tiles nobody waits for, until at most max_tiles
+// are left, the lock must be held
+static void tilecache_evict(tilecache_t* c)
+{
+  tile_t* t = c->lru.tail;
+  while (c->lru.n > c->max_tiles && t) {
+    tile_t* prev = t->prev;
+    if (t->waiters == 0) {
+      tile_list_remove(&c->lru, t);
+      tilecache_free(c, t);
+      c->stats.evicted++;
+    }
+    t = prev;
+  }
+}
+
+
+//// tilecache_path() ////
+// makes the tile file name from the key hash, returns 0 on success
+static int tilecache_path(const tilecache_t* c, uint64_t hash, const char* suffix, char* path)
+{
+  int n = snprintf(path, TILECACHE_PATH_MAX, "%s/%016llx.tile%s", c->dir, (unsigned long long)hash, suffix);
+  return n > 0 && (uint32_t)n < TILECACHE_PATH_MAX ? 0 : -1;
+}
+
+
+//// tilecache_load() ////
+// reads a tile file, the first line is the key (the name is only its hash), the rest
+// is the tile data; returns the data (malloc-ed) or NULL if there is no such tile
+static uint8_t* tilecache_load(const tilecache_t* c, const tile_key_t* key, uint64_t hash, uint32_t* len)
+{
+  char path[TILECACHE_PATH_MAX];
+  FILE* fp = NULL;
+  uint8_t* data = NULL;
+  tile_key_t fkey;
+  long size = 0;
+  if (c->dir == NULL || tilecache_path(c, hash, "", path)) return NULL;
+  if ((fp = fopen(path, "rb")) == NULL) return NULL;
+  if (fscanf(fp, "tile %u %lu %lu %u", &fkey.level, &fkey.x, &fkey.y, &fkey.niter) != 4 || fgetc(fp) != '\n' || !tile_key_eq(&fkey, key)) {
+    fclose(fp);
+    return NULL;
+  }
+  long start = ftell(fp);
+  if (start < 0 || fseek(fp, 0, SEEK_END) || (size = ftell(fp) - start) <= 0 || fseek(fp, start, SEEK_SET) ||
+      (data = (uint8_t*)malloc(size)) == NULL || fread(data, 1, size, fp) != (size_t)size) {
+    free(data);
+    fclose(fp);
+    return NULL;
+  }
+  fclose(fp);
+  *len = (uint32_t)size;
+  return data;
+}
+
+
+//// tilecache_store() ////
+// writes a tile file, to a temporary file first, so that readers never see a part of it
+static void tilecache_store(const tilecache_t* c, const tile_key_t* key, uint64_t hash, const uint8_t* data, uint32_t len)
+{
+  char path[TILECACHE_PATH_MAX];
+  char tmp_path[TILECACHE_PATH_MAX];
+  char suffix[32];
+  FILE* fp = NULL;
+  // the render thread is the only writer, but keep concurrent servers on one directory apart
+  snprintf(suffix, sizeof(suffix), ".%ld.tmp", (long)getpid());
+  if (c->dir == NULL || tilecache_path(c, hash, "", path) || tilecache_path(c, hash, suffix, tmp_path)) return;
+  if ((fp = fopen(tmp_path, "wb")) == NULL) return;
+  int ok = fprintf(fp, "tile %u %lu %lu %u\n", key->level, key->x, key->y, key->niter) > 0 && fwrite(data, 1, len, fp) == len;
+  if (fclose(fp)) ok = 0;
+  if (!ok || rename(tmp_path, path)) remove(tmp_path);
+}
+
+
+//// tilecache_create() ////
+tilecache_t* tilecache_create(uint32_t max_tiles, const char* dir)
+{
+  tilecache_t* c = NULL;
+  if ((c = (tilecache_t*)calloc(1, sizeof(tilecache_t))) == NULL) return NULL;
+  c->max_tiles = max_tiles;
+  // about two buckets per cached tile, queued tiles come & go
+  c->nbuckets = 1024;
+  while (c->nbuckets < 2*max_tiles && c->nbuckets < (1U << 30)) c->nbuckets *= 2;
+  if ((c->buckets = (tile_t**)calloc(c->nbuckets, sizeof(tile_t*))) == NULL ||
+      (dir && (c->dir = strdup(dir)) == NULL) ||
+      (dir && mkdir(dir, 0755) && errno != EEXIST)) {
+    free(c->buckets);
+    free(c->dir);
+    free(c);
+    return NULL;
+  }
+  pthread_mutex_init(&c->lock, NULL);
+  pthread_cond_init(&c->done_cond, NULL);
+  pthread_cond_init(&c->queue_cond, NULL);
+  return c;
+}
+
+
+//// tilecache_destroy() ////
+void tilecache_destroy(tilecache_t* c)
+{
+  if (c == NULL) return;
+  for (uint32_t i=0; i<c->nbuckets; i++) {
+    tile_t* t = c->buckets[i];
+    while (t) {
+      tile_t* next = t->hnext;
+      free(t->data);
+      free(t);
+      t = next;
+    }
+  }
+  pthread_cond_destroy(&c->queue_cond);
+  pthread_cond_destroy(&c->done_cond);
+  pthread_mutex_destroy(&c->lock);
+  free(c->buckets);
+  free(c->dir);
+  free(c);
+}
+
+
+//// tilecache_get() ////
+tile_t* tilecache_get(tilecache_t* c, const tile_key_t* key)
+{
+  uint64_t hash = tile_hash(key);
+  uint8_t* data = NULL;
+  uint32_t len = 0;
+  tile_t* t = NULL;
+  pthread_mutex_lock(&c->lock);
+  if ((t = tilecache_find(c, key, hash)) == NULL) {
+    // not in memory, look on the disk without holding up the others
+    pthread_mutex_unlock(&c->lock);
+    data = tilecache_load(c, key, hash, &len);
+    pthread_mutex_lock(&c->lock);
+    t = tilecache_find(c, key, hash);
+  }
+  if (t) {
+    // join the tile, a cancelled render goes on (or is queued again by tilecache_done())
+    if (t->state == TILE_DONE) {
+      tile_list_remove(&c->lru, t);
+      tile_list_push(&c->lru, t);
+      c->stats.mem_hits++;
+    } else {
+      __atomic_store_n(&t->cancel, 0, __ATOMIC_RELAXED);
+      c->stats.coalesced++;
+    }
+    t->waiters++;
+    free(data);
+  } else if ((t = tilecache_insert(c, key, hash)) != NULL) {
+    t->waiters = 1;
+    if (data) {
+      t->state = TILE_DONE;
+      t->data  = data;
+      t->len   = len;
+      tile_list_push(&c->lru, t);
+      c->stats.disk_hits++;
+      tilecache_evict(c);
+    } else {
+      t->state = TILE_QUEUED;
+      tile_list_push(&c->queue, t);
+      pthread_cond_signal(&c->queue_cond);
+    }
+  } else {
+    free(data);
+  }
+  pthread_mutex_unlock(&c->lock);
+  return t;
+}
+
+
+//// tilecache_wait() ////
+int tilecache_wait(tilecache_t* c, tile_t* t, uint32_t timeout_ms, const uint8_t** data, uint32_t* len)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec  += timeout_ms/1000;
+  ts.tv_nsec += (long)(timeout_ms%1000)*1000000L;
+  if (ts.tv_nsec >= 1000000000L) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
+  pthread_mutex_lock(&c->lock);
+  int ret = 0;
+  while (t->state != TILE_DONE && !c->quit && ret == 0) {
+    if (pthread_cond_timedwait(&c->done_cond, &c->lock, &ts) == ETIMEDOUT) ret = -2;
+  }
+  if (t->state == TILE_DONE) {
+    *data = t->data;
+    *len  = t->len;
+    ret = 1;
+  } else {
+    ret = ret == -2 ? 0 : -1;
+  }
+  pthread_mutex_unlock(&c->lock);
+  return ret;
+}
+
+
+//// tilecache_release() ////
+void tilecache_release(tilecache_t* c, tile_t* t)
+{
+  pthread_mutex_lock(&c->lock);
+  if (--t->waiters == 0) {
+    if (t->state == TILE_QUEUED) {
+      tile_list_remove(&c->queue, t);
+      tilecache_free(c, t);
+      c->stats.cancelled++;
+    } else if (t->state == TILE_RENDERING) {
+      __atomic_store_n(&t->cancel, 1, __ATOMIC_RELAXED);
+    } else {
+      tilecache_evict(c);
+    }
+  }
+  pthread_mutex_unlock(&c->lock);
+}
+
+
+//// tilecache_next() ////
+tile_t* tilecache_next(tilecache_t* c, tile_key_t* key)
+{
+  tile_t* t = NULL;
+  pthread_mutex_lock(&c->lock);
+  while (c->queue.head == NULL && !c->quit) pthread_cond_wait(&c->queue_cond, &c->lock);
+  if (!c->quit) {
+    t = c->queue.head;
+    tile_list_remove(&c->queue, t);
+    t->state = TILE_RENDERING;
+    *key = t->key;
+  }
+  pthread_mutex_unlock(&c->lock);
+  return t;
+}
+
+
+//// tilecache_cancelled() ////
+int tilecache_cancelled(const tile_t* t)
+{
+  return __atomic_load_n(&t->cancel, __ATOMIC_RELAXED);
+}
+
+
+//// tilecache_done() ////
+void tilecache_done(tilecache_t* c, tile_t* t, uint8_t* data, uint32_t len)
+{
+  // the key doesn't change while rendering, the file is written before anybody can evict the tile
+  if (data) tilecache_store(c, &t->key, t->hash, data, len);
+  pthread_mutex_lock(&c->lock);
+  if (data) {
+    t->state = TILE_DONE;
+    t->data  = data;
+    t->len   = len;
+    tile_list_push(&c->lru, t);
+    c->stats.rendered++;
+    tilecache_evict(c);
+    pthread_cond_broadcast(&c->done_cond);
+  } else if (t->waiters) {
+    // cancelled, but somebody asked for it again in the meantime
+    t->state = TILE_QUEUED;
+    tile_list_push(&c->queue, t);
+  } else {
+    tilecache_free(c, t);
+    c->stats.cancelled++;
+  }
+  pthread_mutex_unlock(&c->lock);
+}
+
+
+//// tilecache_shutdown() ////
+void tilecache_shutdown(tilecache_t* c)
+{
+  pthread_mutex_lock(&c->lock);
+  c->quit = 1;
+  pthread_cond_broadcast(&c->queue_cond);
+  pthread_cond_broadcast(&c->done_cond);
+  pthread_mutex_unlock(&c->lock);
+}
+
+
+//// tilecache_stats() ////
+void tilecache_stats(tilecache_t* c, tilecache_stats_t* stats)
+{
+  pthread_mutex_lock(&c->lock);
+  *stats = c->stats;
+  stats->tiles  = c->lru.n;
+  stats->queued = c->queue.n;
+  pthread_mutex_unlock(&c->lock);
+}
+
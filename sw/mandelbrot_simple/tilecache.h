@@ -0,0 +1,88 @@
+// tilecache.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// tile cache of the tile server: in-memory LRU, on-disk cache, coalescing & cancellation
+
+
+#ifndef __TILECACHE_H__
+#define __TILECACHE_H__
+
+
+//// includes ////
+#include <stdint.h>
+
+
+//// types ////
+// tile_key_t
+// identifies a tile, all tiles are rendered with the same palette & tile size
+typedef struct {
+  uint32_t level;
+  uint64_t x;                 // 0 .. 2^level-1
+  uint64_t y;
+  uint32_t niter;
+} tile_key_t;
+
+// tile_t
+// opaque cache entry, queued, being rendered or done
+typedef struct tile_s tile_t;
+
+// tilecache_t
+// opaque cache, shared by the connection threads & the render thread
+typedef struct tilecache_s tilecache_t;
+
+// tilecache_stats_t
+// cache statistics
+typedef struct {
+  uint64_t mem_hits;          // requests served from memory
+  uint64_t disk_hits;         // tiles loaded from the disk cache
+  uint64_t coalesced;         // requests that joined a queued or rendering tile
+  uint64_t rendered;          // tiles rendered
+  uint64_t cancelled;         // tiles dropped, because nobody waited for them anymore
+  uint64_t evicted;           // tiles evicted from memory
+  uint32_t tiles;             // tiles in memory
+  uint32_t queued;            // tiles waiting to be rendered
+} tilecache_stats_t;
+
+
+//// functions ////
+// creates a cache of up to max_tiles done tiles in memory, backed by tile files in
+// dir (NULL - no disk cache, the directory is created if needed), returns NULL on error
+tilecache_t* tilecache_create(uint32_t max_tiles, const char* dir);
+
+// frees the cache, the render thread & all waiters must be gone
+void tilecache_destroy(tilecache_t* c);
+
+// returns the tile for key & counts the caller as waiting for it: a done tile from
+// memory or disk, or the queued or rendering tile (the request is coalesced with the
+// earlier ones), or a newly queued tile; returns NULL on allocation failure
+tile_t* tilecache_get(tilecache_t* c, const tile_key_t* key);
+
+// waits up to timeout_ms for the tile, returns 1 & its data (valid until
+// tilecache_release()) if it's done, 0 on timeout & -1 after tilecache_shutdown()
+int tilecache_wait(tilecache_t* c, tile_t* t, uint32_t timeout_ms, const uint8_t** data, uint32_t* len);
+
+// stops waiting for the tile, a queued tile nobody waits for is dropped, a
+// rendering one is cancelled (see tilecache_cancelled())
+void tilecache_release(tilecache_t* c, tile_t* t);
+
+// takes the newest queued tile for rendering (the tiles of the latest view first),
+// blocks until there is one; returns NULL after tilecache_shutdown()
+tile_t* tilecache_next(tilecache_t* c, tile_key_t* key);
+
+// returns nonzero if nobody waits for the rendering tile anymore (can be polled
+// by the render workers without the lock)
+int tilecache_cancelled(const tile_t* t);
+
+// finishes the rendering tile with len bytes of data (malloc-ed, taken over by the
+// cache), writes it to the disk cache & wakes up the waiters; data NULL - the render
+// was cancelled, the tile is queued again if somebody asked for it in the meantime
+void tilecache_done(tilecache_t* c, tile_t* t, uint8_t* data, uint32_t len);
+
+// wakes up the render thread & makes tilecache_next() return NULL
+void tilecache_shutdown(tilecache_t* c);
+
+// returns the cache statistics
+void tilecache_stats(tilecache_t* c, tilecache_stats_t* stats);
+
+
+#endif // __TILECACHE_H__
+
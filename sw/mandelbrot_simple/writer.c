@@ -0,0 +1,162 @@
+// writer.c
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// asynchronous row writer, finished tiles go through a bounded ring buffer to a writer
+// thread, which only sequences them: as soon as rows are complete, they are written
+// out in order by a worker pool of its own
+// NOTE: the pool sleeps while there are no rows to write, so it only competes with the
+// render workers for the cpus while a batch is colored & encoded; the writer thread
+// is worker 0 of the pool, so it takes its share of the tasks while it waits for them
+
+
+//// includes ////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "writer.h"
+
+
+//// defines ////
+// number of finished tiles the ring buffer holds
+#define WRITER_RING     256U
+// complete rows the writer waits for before writing them (but the last ones)
+#define WRITER_MIN_ROWS 16U
+
+
+//// types ////
+// writer_tile_t
+// finished tile, only its rows & width matter
+typedef struct {
+  uint32_t y;
+  uint32_t h;
+  uint32_t w;
+} writer_tile_t;
+
+// writer_s
+// writer of one band
+struct writer_s {
+  uint32_t        img_w;
+  uint32_t        img_h;
+  uint32_t        nthreads;     // workers of the writer pool
+  writer_rows_fn  fn;
+  void*           arg;
+  pthread_t       thread;
+  pthread_mutex_t lock;
+  pthread_cond_t  not_empty;
+  pthread_cond_t  not_full;
+  writer_tile_t   ring[WRITER_RING];
+  uint32_t        head;         // next tile to pop
+  uint32_t        count;        // tiles in the ring
+  uint32_t        finishing;    // the band is rendered
+  uint32_t*       row_done;     // finished pixels of each row (writer thread only)
+  uint32_t        overlapped;   // rows written before finishing
+  int             ret;
+};
+
+
+//// writer_thread() ////
+// counts the finished pixels of each row & writes the complete rows, in batches of at
+// least WRITER_MIN_ROWS while the band is being rendered
+static void* writer_thread(void* arg)
+{
+  writer_t* w = (writer_t*)arg;
+  // created here, so that this thread may run jobs on it
+  sched_t* s = sched_create(w->nthreads);
+  uint32_t next = 0;
+  pthread_mutex_lock(&w->lock);
+  while (next < w->img_h) {
+    while (w->count == 0 && !w->finishing) pthread_cond_wait(&w->not_empty, &w->lock);
+    // take all finished tiles at once, the render workers go on meanwhile
+    uint32_t finishing = w->finishing;
+    uint32_t popped = w->count;
+    while (w->count) {
+      const writer_tile_t* t = &w->ring[w->head];
+      for (uint32_t y=t->y; y<t->y+t->h; y++) w->row_done[y] += t->w;
+      w->head = (w->head+1) % WRITER_RING;
+      w->count--;
+    }
+    if (popped) pthread_cond_broadcast(&w->not_full);
+    pthread_mutex_unlock(&w->lock);
+    uint32_t n = 0;
+    while (next+n < w->img_h && w->row_done[next+n] >= w->img_w) n++;
+    if (n && (n >= WRITER_MIN_ROWS || next+n == w->img_h || finishing)) {
+      if (w->ret == 0 && w->fn(w->arg, s, next, n)) w->ret = -1;
+      if (!finishing) w->overlapped += n;
+      next += n;
+    }
+    pthread_mutex_lock(&w->lock);
+    if (finishing && n == 0 && w->count == 0 && next < w->img_h) {
+      // rendered, but some rows were never finished
+      w->ret = -1;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&w->lock);
+  sched_destroy(s);
+  return NULL;
+}
+
+
+//// writer_create() ////
+writer_t* writer_create(uint32_t img_w, uint32_t img_h, uint32_t nthreads, writer_rows_fn fn, void* arg)
+{
+  writer_t* w = NULL;
+  if ((w = (writer_t*)calloc(1, sizeof(writer_t))) == NULL) return NULL;
+  if ((w->row_done = (uint32_t*)calloc(img_h ? img_h : 1, sizeof(uint32_t))) == NULL) {
+    free(w);
+    return NULL;
+  }
+  w->img_w    = img_w;
+  w->img_h    = img_h;
+  w->nthreads = nthreads ? nthreads : 1;
+  w->fn       = fn;
+  w->arg      = arg;
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->not_empty, NULL);
+  pthread_cond_init(&w->not_full, NULL);
+  if (pthread_create(&w->thread, NULL, writer_thread, w)) {
+    pthread_cond_destroy(&w->not_full);
+    pthread_cond_destroy(&w->not_empty);
+    pthread_mutex_destroy(&w->lock);
+    free(w->row_done);
+    free(w);
+    return NULL;
+  }
+  return w;
+}
+
+
+//// writer_push() ////
+void writer_push(writer_t* w, uint32_t tile_x, uint32_t tile_y, uint32_t tile_w, uint32_t tile_h)
+{
+  (void)tile_x;
+  pthread_mutex_lock(&w->lock);
+  while (w->count == WRITER_RING) pthread_cond_wait(&w->not_full, &w->lock);
+  writer_tile_t* t = &w->ring[(w->head + w->count) % WRITER_RING];
+  t->y = tile_y;
+  t->h = tile_h;
+  t->w = tile_w;
+  if (w->count++ == 0) pthread_cond_signal(&w->not_empty);
+  pthread_mutex_unlock(&w->lock);
+}
+
+
+//// writer_finish() ////
+int writer_finish(writer_t* w, uint32_t* overlapped)
+{
+  pthread_mutex_lock(&w->lock);
+  w->finishing = 1;
+  pthread_cond_signal(&w->not_empty);
+  pthread_mutex_unlock(&w->lock);
+  pthread_join(w->thread, NULL);
+  int ret = w->ret;
+  *overlapped = w->overlapped;
+  pthread_cond_destroy(&w->not_full);
+  pthread_cond_destroy(&w->not_empty);
+  pthread_mutex_destroy(&w->lock);
+  free(w->row_done);
+  free(w);
+  return ret;
+}
+
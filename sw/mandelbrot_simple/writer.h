@@ -0,0 +1,45 @@
+// writer.h
+// 2021, Rok Krajnc <rok.krajnc@gmail.com>
+// asynchronous row writer, finished tiles go through a bounded ring buffer to a writer
+// thread, which only sequences them: as soon as rows are complete, they are written
+// out in order by a worker pool of its own
+
+
+#ifndef __WRITER_H__
+#define __WRITER_H__
+
+
+//// includes ////
+#include <stdint.h>
+#include "sched.h"
+
+
+//// types ////
+// writer_t
+// opaque writer of one band of rows
+typedef struct writer_s writer_t;
+
+// writer_rows_fn
+// writes the complete rows row_y .. row_y+nrows-1 (relative to the band) on the writer
+// thread, in order, the work can be run on the writer's workers s (sched_run() is
+// allowed, the writer thread created them; NULL - none could be created); returns 0 on
+// success
+typedef int (*writer_rows_fn)(void* arg, sched_t* s, uint32_t row_y, uint32_t nrows);
+
+
+//// functions ////
+// starts the writer thread for a band of img_w x img_h pixels with a pool of nthreads
+// workers (the writer thread is one of them), returns NULL on error
+writer_t* writer_create(uint32_t img_w, uint32_t img_h, uint32_t nthreads, writer_rows_fn fn, void* arg);
+
+// tells the writer a tile of the band is finished (called by the render workers, blocks
+// while the ring buffer is full)
+void writer_push(writer_t* w, uint32_t tile_x, uint32_t tile_y, uint32_t tile_w, uint32_t tile_h);
+
+// waits until all rows are written & stops the writer thread; overlapped is the number
+// of rows written before the call (while the band was being rendered), returns 0 on success
+int writer_finish(writer_t* w, uint32_t* overlapped);
+
+
+#endif // __WRITER_H__
+